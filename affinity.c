@@ -0,0 +1,662 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// Affinity places the simulation on the machine's topology instead of letting threads float.
+// Systems connected through shared resources are grouped with a union-find over the resources,
+// ordered so that each group is contiguous, and the order is cut into NUMA nodes (in proportion
+// to their CPUs, moving a cut to the edge of a group whenever the group fits in one node) and then
+// into the cores of each node. Each resource then lives on the node where most of its systems run,
+// and is reallocated there by a thread pinned to that node, relying on the kernel placing a page
+// on the node that first touches it.
+//
+// The nodes and their CPUs are read from AFFINITY_NODE_PATH. On a machine with fewer nodes than
+// asked for, the CPUs are split into simulated nodes so that the placement can still be tried.
+
+#define _GNU_SOURCE
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <sched.h>
+
+// Helper functions just used by this C file
+
+static int affinity_read_nodes(Affinity *affinity, const cpu_set_t *allowed);
+static int affinity_simulate_nodes(Affinity *affinity, const cpu_set_t *allowed, int node_count);
+static int affinity_parse_cpulist(const char *text, const cpu_set_t *allowed, int *cpus);
+static int affinity_find(int *parent, int index);
+static int affinity_compare(const void *a, const void *b);
+static int affinity_place(Affinity *affinity, Manager *manager);
+static void affinity_count_links(Affinity *affinity, Manager *manager, const int *index_of);
+static void *affinity_relocate_thread(void *arg);
+
+/**
+ * Reads the topology and chooses a node and core for every system and a node for every resource.
+ *
+ * Nothing is moved or pinned until `affinity_apply`.
+ *
+ * @param[out] affinity         Pointer to the `Affinity` to initialize.
+ * @param[in]  manager          Pointer to the `Manager` holding the loaded scenario.
+ * @param[in]  simulated_nodes  Nodes to split the CPUs into if the machine has fewer, 0 to use the real ones only.
+ * @return                      0 on success, -1 if the topology could not be read or memory ran out.
+ */
+int affinity_init(Affinity *affinity, Manager *manager, int simulated_nodes) {
+    cpu_set_t allowed;
+    int cpu, result;
+
+    memset(affinity, 0, sizeof(Affinity));
+
+    // Only the CPUs this process may run on are used
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return -1;
+    }
+
+    result = affinity_read_nodes(affinity, &allowed);
+    if (result != 0 || affinity->node_count < simulated_nodes) {
+        affinity_clean(affinity);
+        result = affinity_simulate_nodes(affinity, &allowed, simulated_nodes > 0 ? simulated_nodes : 1);
+    }
+    if (result != 0) {
+        affinity_clean(affinity);
+        return -1;
+    }
+
+    // The scenario was loaded by this thread, so its resources start on this thread's node
+    cpu = sched_getcpu();
+    affinity->home_node = -1;
+    for (int n = 0; n < affinity->node_count && affinity->home_node < 0; n++) {
+        for (int c = 0; c < affinity->nodes[n].cpu_count; c++) {
+            if (affinity->nodes[n].cpus[c] == cpu) {
+                affinity->home_node = n;
+            }
+        }
+    }
+    if (affinity->home_node < 0) {
+        affinity->home_node = 0;
+    }
+
+    if (affinity_place(affinity, manager) != 0) {
+        affinity_clean(affinity);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Moves every resource to its node and gives every system its CPU.
+ *
+ * Must be called before any thread uses the resources, and before the telemetry, history or
+ * partitions take pointers to them. Systems are pinned as their threads are created.
+ *
+ * @param[in]     affinity  Pointer to the `Affinity` chosen for this scenario.
+ * @param[in,out] manager   Pointer to the `Manager`.
+ * @return                  0 on success, -1 if some resources could not be moved (they stay where they are).
+ */
+int affinity_apply(Affinity *affinity, Manager *manager) {
+    AffinityRelocation *relocations;
+    Resource **relocated, **by_id, *resource;
+    System *system;
+    pthread_t *threads;
+    pthread_attr_t attributes;
+    cpu_set_t set;
+    int *started;
+    int n, i, c, result = 0;
+
+    relocations = (AffinityRelocation *)malloc(sizeof(AffinityRelocation) * affinity->node_count);
+    threads = (pthread_t *)malloc(sizeof(pthread_t) * affinity->node_count);
+    started = (int *)calloc(affinity->node_count, sizeof(int));
+    relocated = (Resource **)calloc(affinity->resource_count + 1, sizeof(Resource *));
+    by_id = (Resource **)calloc(manager->resource_array.next_id + 1, sizeof(Resource *));
+    if (relocations == NULL || threads == NULL || started == NULL || relocated == NULL || by_id == NULL) {
+        free(relocations);
+        free(threads);
+        free(started);
+        free(relocated);
+        free(by_id);
+        return -1;
+    }
+
+    // One thread per node, created on that node so that what it allocates is local to it
+    for (n = 0; n < affinity->node_count; n++) {
+        relocations[n].affinity = affinity;
+        relocations[n].manager = manager;
+        relocations[n].relocated = relocated;
+        relocations[n].node = n;
+
+        CPU_ZERO(&set);
+        for (c = 0; c < affinity->nodes[n].cpu_count; c++) {
+            CPU_SET(affinity->nodes[n].cpus[c], &set);
+        }
+        pthread_attr_init(&attributes);
+        pthread_attr_setaffinity_np(&attributes, sizeof(set), &set);
+        started[n] = (pthread_create(&threads[n], &attributes, affinity_relocate_thread, &relocations[n]) == 0);
+        pthread_attr_destroy(&attributes);
+    }
+    for (n = 0; n < affinity->node_count; n++) {
+        if (started[n]) {
+            pthread_join(threads[n], NULL);
+        }
+    }
+
+    // Swap the copies in, first in every system using them and then in the array
+    for (i = 0; i < affinity->resource_count; i++) {
+        resource = manager->resource_array.resources[i];
+        by_id[resource->id] = (relocated[i] != NULL) ? relocated[i] : resource;
+        if (relocated[i] == NULL) {
+            result = -1;
+        }
+    }
+
+    for (i = 0; i < affinity->system_count; i++) {
+        system = manager->system_array.systems[i];
+        if (system->consumed.resource != NULL) {
+            system->consumed.resource = by_id[system->consumed.resource->id];
+        }
+        if (system->produced.resource != NULL) {
+            system->produced.resource = by_id[system->produced.resource->id];
+        }
+        system->cpu = affinity->system_cpus[i];
+    }
+
+    for (i = 0; i < affinity->resource_count; i++) {
+        resource = manager->resource_array.resources[i];
+        if (relocated[i] == NULL) {
+            continue;
+        }
+        manager->resource_array.resources[i] = relocated[i];
+
+        // The copy has its own semaphore and keeps the name, so only the old structure goes
+        sem_destroy(&resource->mutex);
+        free(resource);
+    }
+
+    free(relocations);
+    free(threads);
+    free(started);
+    free(relocated);
+    free(by_id);
+    return result;
+}
+
+/**
+ * Restricts a thread to a set of CPUs.
+ *
+ * @param[in] thread  The thread to pin.
+ * @param[in] cpus    CPUs it may run on.
+ * @param[in] count   Number of CPUs.
+ * @return            0 on success, -1 otherwise.
+ */
+int affinity_pin_thread(pthread_t thread, const int *cpus, int count) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    for (int i = 0; i < count; i++) {
+        CPU_SET(cpus[i], &set);
+    }
+
+    return (pthread_setaffinity_np(thread, sizeof(set), &set) == 0) ? 0 : -1;
+}
+
+/**
+ * Prints the topology, what was placed on each node and how many resource accesses cross nodes
+ * compared with floating threads.
+ *
+ * @param[in] affinity  Pointer to the `Affinity`.
+ */
+void affinity_print(Affinity *affinity) {
+    AffinityNode *node;
+    int n, i, systems, resources;
+
+    printf("Affinity: %d %s node%s\n", affinity->node_count, affinity->simulated ? "simulated" : "NUMA",
+           affinity->node_count == 1 ? "" : "s");
+    for (n = 0; n < affinity->node_count; n++) {
+        node = &affinity->nodes[n];
+        systems = 0;
+        resources = 0;
+        for (i = 0; i < affinity->system_count; i++) {
+            systems += (affinity->system_nodes[i] == n);
+        }
+        for (i = 0; i < affinity->resource_count; i++) {
+            resources += (affinity->resource_nodes[i] == n);
+        }
+
+        printf("  Node %d: %d CPU%s (", node->id, node->cpu_count, node->cpu_count == 1 ? "" : "s");
+        for (i = 0; i < node->cpu_count && i < 8; i++) {
+            printf("%s%d", i > 0 ? " " : "", node->cpus[i]);
+        }
+        printf("%s), %d systems, %d resources%s\n", node->cpu_count > 8 ? " ..." : "", systems, resources,
+               n == affinity->home_node ? ", home" : "");
+    }
+
+    printf("Cross-node links: %.1f of %d with floating threads, %d placed\n",
+           affinity->cross_before, affinity->links, affinity->cross_after);
+    printf("Cross-node accesses/s at standard rates: %.0f of %.0f with floating threads, %.0f placed",
+           affinity->rate_before, affinity->links_rate, affinity->rate_after);
+    if (affinity->rate_before > 0 && affinity->rate_after <= affinity->rate_before) {
+        printf(" (%.0f%% fewer)", 100.0 * (1.0 - affinity->rate_after / affinity->rate_before));
+    }
+    else if (affinity->rate_before > 0) {
+        printf(" (%.0f%% more, too few systems to share each node)", 100.0 * (affinity->rate_after / affinity->rate_before - 1.0));
+    }
+    printf("\n\n");
+}
+
+/**
+ * Frees the topology and placement.
+ *
+ * @param[in,out] affinity  Pointer to the `Affinity` to clean.
+ */
+void affinity_clean(Affinity *affinity) {
+    for (int n = 0; n < affinity->node_count; n++) {
+        free(affinity->nodes[n].cpus);
+    }
+    free(affinity->nodes);
+    free(affinity->system_nodes);
+    free(affinity->system_cpus);
+    free(affinity->resource_nodes);
+    affinity->nodes = NULL;
+    affinity->node_count = 0;
+    affinity->system_nodes = NULL;
+    affinity->system_cpus = NULL;
+    affinity->resource_nodes = NULL;
+}
+
+/**
+ * Reads the NUMA nodes and their CPUs, keeping only nodes with a CPU this process may use.
+ *
+ * @param[out] affinity  Pointer to the `Affinity`, given its nodes sorted by node number.
+ * @param[in]  allowed   CPUs this process may run on.
+ * @return               0 on success, -1 if there is no readable node with a usable CPU.
+ */
+static int affinity_read_nodes(Affinity *affinity, const cpu_set_t *allowed) {
+    char path[512], text[4096];
+    int cpus[CPU_SETSIZE];
+    struct dirent *entry;
+    AffinityNode swap;
+    DIR *directory;
+    FILE *file;
+    int id, count, capacity = 0, i, j;
+
+    directory = opendir(AFFINITY_NODE_PATH);
+    if (directory == NULL) {
+        return -1;
+    }
+
+    // One pass to size the node array, a second to fill it
+    while ((entry = readdir(directory)) != NULL) {
+        capacity += (sscanf(entry->d_name, "node%d", &id) == 1);
+    }
+    affinity->nodes = (AffinityNode *)malloc(sizeof(AffinityNode) * (capacity > 0 ? capacity : 1));
+    if (affinity->nodes == NULL) {
+        closedir(directory);
+        return -1;
+    }
+
+    rewinddir(directory);
+    while ((entry = readdir(directory)) != NULL && affinity->node_count < capacity) {
+        if (sscanf(entry->d_name, "node%d", &id) != 1) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s/cpulist", AFFINITY_NODE_PATH, entry->d_name);
+        file = fopen(path, "r");
+        if (file == NULL) {
+            continue;
+        }
+        count = (fgets(text, sizeof(text), file) != NULL) ? affinity_parse_cpulist(text, allowed, cpus) : 0;
+        fclose(file);
+
+        // Nodes with only memory, or only CPUs this process may not use, cannot run anything
+        if (count == 0) {
+            continue;
+        }
+
+        affinity->nodes[affinity->node_count].id = id;
+        affinity->nodes[affinity->node_count].cpu_count = count;
+        affinity->nodes[affinity->node_count].cpus = (int *)malloc(sizeof(int) * count);
+        if (affinity->nodes[affinity->node_count].cpus == NULL) {
+            break;
+        }
+        memcpy(affinity->nodes[affinity->node_count].cpus, cpus, sizeof(int) * count);
+        affinity->node_count++;
+    }
+    closedir(directory);
+
+    // Directory order is arbitrary, the few nodes are put in order by insertion
+    for (i = 1; i < affinity->node_count; i++) {
+        for (j = i; j > 0 && affinity->nodes[j - 1].id > affinity->nodes[j].id; j--) {
+            swap = affinity->nodes[j];
+            affinity->nodes[j] = affinity->nodes[j - 1];
+            affinity->nodes[j - 1] = swap;
+        }
+    }
+
+    return (affinity->node_count > 0) ? 0 : -1;
+}
+
+/**
+ * Splits the usable CPUs into contiguous simulated nodes, sharing CPUs if there are fewer CPUs than nodes.
+ *
+ * @param[out] affinity    Pointer to the `Affinity`, given its nodes.
+ * @param[in]  allowed     CPUs this process may run on.
+ * @param[in]  node_count  Number of nodes to make.
+ * @return                 0 on success, -1 if memory ran out.
+ */
+static int affinity_simulate_nodes(Affinity *affinity, const cpu_set_t *allowed, int node_count) {
+    int cpus[CPU_SETSIZE];
+    int total = 0, first, last, n, c;
+
+    for (c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, allowed)) {
+            cpus[total++] = c;
+        }
+    }
+    if (total == 0) {
+        return -1;
+    }
+
+    affinity->nodes = (AffinityNode *)calloc(node_count, sizeof(AffinityNode));
+    if (affinity->nodes == NULL) {
+        return -1;
+    }
+    affinity->simulated = 1;
+
+    for (n = 0; n < node_count; n++) {
+        first = (total >= node_count) ? n * total / node_count : n % total;
+        last = (total >= node_count) ? (n + 1) * total / node_count : first + 1;
+
+        affinity->nodes[n].id = n;
+        affinity->nodes[n].cpu_count = last - first;
+        affinity->nodes[n].cpus = (int *)malloc(sizeof(int) * (last - first));
+        if (affinity->nodes[n].cpus == NULL) {
+            return -1;
+        }
+        memcpy(affinity->nodes[n].cpus, cpus + first, sizeof(int) * (last - first));
+        affinity->node_count++;
+    }
+
+    return 0;
+}
+
+/**
+ * Parses a kernel CPU list such as "0-3,8-11".
+ *
+ * @param[in]  text     The list.
+ * @param[in]  allowed  CPUs to keep, any others are skipped.
+ * @param[out] cpus     Set to each CPU kept, room for CPU_SETSIZE.
+ * @return              Number of CPUs kept.
+ */
+static int affinity_parse_cpulist(const char *text, const cpu_set_t *allowed, int *cpus) {
+    int first, last, count = 0;
+    char *end;
+
+    while (*text >= '0' && *text <= '9') {
+        first = (int)strtol(text, &end, 10);
+        last = first;
+        if (*end == '-') {
+            last = (int)strtol(end + 1, &end, 10);
+        }
+
+        for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, allowed)) {
+                cpus[count++] = cpu;
+            }
+        }
+
+        text = (*end == ',') ? end + 1 : end;
+    }
+
+    return count;
+}
+
+/**
+ * Finds the group of a resource in the union-find, halving the path on the way.
+ *
+ * @param[in,out] parent  Parent of each resource.
+ * @param[in]     index   Index of the resource.
+ * @return                Index of the resource representing its group.
+ */
+static int affinity_find(int *parent, int index) {
+    while (parent[index] != index) {
+        parent[index] = parent[parent[index]];
+        index = parent[index];
+    }
+    return index;
+}
+
+/**
+ * Orders systems by group, then by the resource they use, so neighbours end up together.
+ *
+ * @param[in] a  Pointer to an `AffinityRow`.
+ * @param[in] b  Pointer to an `AffinityRow`.
+ * @return       Negative if `a` comes first, positive if `b` does.
+ */
+static int affinity_compare(const void *a, const void *b) {
+    const AffinityRow *first = (const AffinityRow *)a;
+    const AffinityRow *second = (const AffinityRow *)b;
+
+    if (first->component != second->component) {
+        return (first->component < second->component) ? -1 : 1;
+    }
+    if (first->resource != second->resource) {
+        return (first->resource < second->resource) ? -1 : 1;
+    }
+    return first->system - second->system;
+}
+
+/**
+ * Chooses the node and CPU of every system and the node of every resource.
+ *
+ * @param[in,out] affinity  Pointer to the `Affinity`, with its nodes read.
+ * @param[in]     manager   Pointer to the `Manager`.
+ * @return                  0 on success, -1 if memory ran out.
+ */
+static int affinity_place(Affinity *affinity, Manager *manager) {
+    int systems = manager->system_array.size;
+    int resources = manager->resource_array.size;
+    int *parent = (int *)malloc(sizeof(int) * (resources + 1));
+    int *index_of = (int *)malloc(sizeof(int) * (manager->resource_array.next_id + 1));
+    double *tally = (double *)calloc((resources + 1) * affinity->node_count, sizeof(double));
+    AffinityRow *rows = (AffinityRow *)malloc(sizeof(AffinityRow) * (systems + 1));
+    int total_cpus = 0, cpus_before = 0, start = 0, end, share, first, last, best;
+    int consumed, produced, n, i, k;
+    double rate;
+    System *system;
+
+    affinity->system_count = systems;
+    affinity->resource_count = resources;
+    affinity->system_nodes = (int *)malloc(sizeof(int) * (systems + 1));
+    affinity->system_cpus = (int *)malloc(sizeof(int) * (systems + 1));
+    affinity->resource_nodes = (int *)malloc(sizeof(int) * (resources + 1));
+    if (parent == NULL || index_of == NULL || tally == NULL || rows == NULL ||
+        affinity->system_nodes == NULL || affinity->system_cpus == NULL || affinity->resource_nodes == NULL) {
+        free(parent);
+        free(index_of);
+        free(tally);
+        free(rows);
+        return -1;
+    }
+
+    for (i = 0; i < resources; i++) {
+        parent[i] = i;
+        index_of[manager->resource_array.resources[i]->id] = i;
+    }
+
+    // Join the resources every system links together
+    for (i = 0; i < systems; i++) {
+        system = manager->system_array.systems[i];
+        if (system->consumed.resource != NULL && system->produced.resource != NULL) {
+            consumed = affinity_find(parent, index_of[system->consumed.resource->id]);
+            produced = affinity_find(parent, index_of[system->produced.resource->id]);
+            parent[consumed] = produced;
+        }
+    }
+
+    for (i = 0; i < systems; i++) {
+        system = manager->system_array.systems[i];
+        consumed = (system->consumed.resource != NULL) ? index_of[system->consumed.resource->id] : -1;
+        produced = (system->produced.resource != NULL) ? index_of[system->produced.resource->id] : -1;
+
+        rows[i].system = i;
+        rows[i].resource = (consumed >= 0 && (produced < 0 || consumed < produced)) ? consumed : produced;
+        // A system using no resource is a group of its own
+        rows[i].component = (rows[i].resource >= 0) ? affinity_find(parent, rows[i].resource) : resources + i;
+    }
+    qsort(rows, systems, sizeof(AffinityRow), affinity_compare);
+
+    for (n = 0; n < affinity->node_count; n++) {
+        total_cpus += affinity->nodes[n].cpu_count;
+    }
+
+    // Cut the order into nodes in proportion to their CPUs, then each node's slice into its CPUs
+    for (n = 0; n < affinity->node_count; n++) {
+        cpus_before += affinity->nodes[n].cpu_count;
+        end = (n == affinity->node_count - 1) ? systems : (int)((long long)systems * cpus_before / total_cpus);
+        share = (int)((long long)systems * affinity->nodes[n].cpu_count / total_cpus);
+
+        // Rather than split a group that would fit in one node, move the cut to its nearer edge
+        if (end > start && end < systems && rows[end - 1].component == rows[end].component) {
+            for (first = end; first > 0 && rows[first - 1].component == rows[end].component; first--) {
+            }
+            for (last = end; last < systems && rows[last].component == rows[end].component; last++) {
+            }
+            if (last - first <= share) {
+                end = (end - first <= last - end && first >= start) ? first : last;
+            }
+        }
+        if (end < start) {
+            end = start;
+        }
+
+        for (i = start; i < end; i++) {
+            affinity->system_nodes[rows[i].system] = n;
+            k = (int)((long long)(i - start) * affinity->nodes[n].cpu_count / (end - start));
+            affinity->system_cpus[rows[i].system] = affinity->nodes[n].cpus[k];
+        }
+        start = end;
+    }
+
+    // Each resource goes to the node whose systems access it most often
+    for (i = 0; i < systems; i++) {
+        system = manager->system_array.systems[i];
+        rate = 1000.0 / (system->processing_time > 0 ? system->processing_time : 1);
+        if (system->consumed.resource != NULL) {
+            tally[index_of[system->consumed.resource->id] * affinity->node_count + affinity->system_nodes[i]] += rate;
+        }
+        if (system->produced.resource != NULL) {
+            tally[index_of[system->produced.resource->id] * affinity->node_count + affinity->system_nodes[i]] += rate;
+        }
+    }
+    for (i = 0; i < resources; i++) {
+        best = affinity->home_node;
+        for (n = 0; n < affinity->node_count; n++) {
+            if (tally[i * affinity->node_count + n] > tally[i * affinity->node_count + best]) {
+                best = n;
+            }
+        }
+        affinity->resource_nodes[i] = best;
+    }
+
+    // A single scheduler thread goes where most systems are
+    for (n = 0, best = 0; n < affinity->node_count; n++) {
+        tally[n] = 0;
+    }
+    for (i = 0; i < systems; i++) {
+        tally[affinity->system_nodes[i]]++;
+    }
+    for (n = 0; n < affinity->node_count; n++) {
+        if (tally[n] > tally[best]) {
+            best = n;
+        }
+    }
+    affinity->busiest_node = best;
+
+    affinity_count_links(affinity, manager, index_of);
+
+    free(parent);
+    free(index_of);
+    free(tally);
+    free(rows);
+    return 0;
+}
+
+/**
+ * Counts the links between systems and resources that cross nodes, before and after placement.
+ *
+ * Before placement every resource is on the home node and a floating thread is on any CPU
+ * equally often, so a link crosses nodes as often as a CPU is outside the home node.
+ *
+ * @param[in,out] affinity  Pointer to the `Affinity`, with its placement chosen.
+ * @param[in]     manager   Pointer to the `Manager`.
+ * @param[in]     index_of  Index in the resource array of each resource id.
+ */
+static void affinity_count_links(Affinity *affinity, Manager *manager, const int *index_of) {
+    Resource *ends[2];
+    System *system;
+    double away, rate;
+    int total_cpus = 0, n, i, e, r;
+
+    for (n = 0; n < affinity->node_count; n++) {
+        total_cpus += affinity->nodes[n].cpu_count;
+    }
+    away = 1.0 - (double)affinity->nodes[affinity->home_node].cpu_count / total_cpus;
+
+    for (i = 0; i < affinity->system_count; i++) {
+        system = manager->system_array.systems[i];
+        ends[0] = system->consumed.resource;
+        ends[1] = system->produced.resource;
+        rate = 1000.0 / (system->processing_time > 0 ? system->processing_time : 1);
+
+        for (e = 0; e < 2; e++) {
+            if (ends[e] == NULL) {
+                continue;
+            }
+            r = index_of[ends[e]->id];
+
+            affinity->links++;
+            affinity->links_rate += rate;
+            affinity->cross_before += away;
+            affinity->rate_before += away * rate;
+            if (affinity->resource_nodes[r] != affinity->system_nodes[i]) {
+                affinity->cross_after++;
+                affinity->rate_after += rate;
+            }
+        }
+    }
+}
+
+/**
+ * Reallocates the resources placed on one node, from a thread running on that node.
+ *
+ * Copies are padded to whole cache lines so resources never share one.
+ *
+ * @param[in] arg  Pointer to the `AffinityRelocation` for the node.
+ * @return         NULL once done.
+ */
+static void *affinity_relocate_thread(void *arg) {
+    AffinityRelocation *relocation = (AffinityRelocation *)arg;
+    Affinity *affinity = relocation->affinity;
+    size_t size = (sizeof(Resource) + AFFINITY_CACHE_LINE - 1) / AFFINITY_CACHE_LINE * AFFINITY_CACHE_LINE;
+    void *memory;
+    Resource *copy;
+
+    for (int i = 0; i < affinity->resource_count; i++) {
+        if (affinity->resource_nodes[i] != relocation->node) {
+            continue;
+        }
+        if (posix_memalign(&memory, AFFINITY_CACHE_LINE, size) != 0) {
+            continue;
+        }
+
+        // Writing the whole copy here is what places its pages on this node
+        copy = (Resource *)memory;
+        memset(copy, 0, size);
+        memcpy(copy, relocation->manager->resource_array.resources[i], sizeof(Resource));
+        sem_init(&copy->mutex, 0, 1);
+        copy->node = affinity->nodes[relocation->node].id;
+        relocation->relocated[i] = copy;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,192 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// The benchmark runs generated scenarios of increasing size end to end, with the manager and the
+// systems running exactly as they do in a normal simulation but without the display, and reports
+// how the whole process scales: conversions completed and events handled per second, how long
+// events wait for the manager, and the memory and threads the process uses.
+
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Helper functions just used by this C file
+
+static int bench_run_size(const ScenarioConfig *config, int seconds, int use_wheel, int shards);
+static void bench_stop(Manager *manager);
+
+/**
+ * Benchmarks a generated scenario at each of the given sizes and prints one row per size.
+ *
+ * @param[in] config     Shape of the scenarios, its `systems` is replaced by each size in turn.
+ * @param[in] sizes      Number of systems to generate for each run.
+ * @param[in] count      Number of sizes.
+ * @param[in] seconds    Wall time each run lasts.
+ * @param[in] use_wheel  non-zero to drive the systems from a scheduler instead of a thread each.
+ * @param[in] shards     Number of manager shards handling events, 1 for a single manager.
+ * @return               0 if every run completed, 1 otherwise.
+ */
+int bench_run(const ScenarioConfig *config, const int *sizes, int count, int seconds, int use_wheel, int shards) {
+    ScenarioConfig sized = *config;
+    int result = 0;
+
+    printf("Scenario: seed %llu, fan-in %d, fan-out %d, depth %d, %d hot (%d%%), mean processing time %d ms, %s, %d manager shard%s\n",
+           config->seed, config->fan_in, config->fan_out, config->depth, config->hot, config->hot_share, config->pt_mean,
+           use_wheel ? "scheduler" : "thread per system", shards > 1 ? shards : 1, shards > 1 ? "s" : "");
+    printf("%10s %10s %8s %14s %12s %12s %12s %10s\n",
+           "Systems", "Resources", "Threads", "Conversions/s", "Events/s", "Avg lag us", "Max lag us", "RSS MB");
+    fflush(stdout);
+
+    for (int i = 0; i < count; i++) {
+        sized.systems = sizes[i];
+        if (bench_run_size(&sized, seconds, use_wheel, shards) != 0) {
+            fprintf(stderr, "Could not run a scenario of %d systems\n", sizes[i]);
+            result = 1;
+        }
+        fflush(stdout);
+    }
+
+    return result;
+}
+
+/**
+ * Generates and runs a single scenario, then prints its row.
+ *
+ * Threads and memory are measured at the end of the run, while everything is still running.
+ *
+ * @param[in] config     Shape and size of the scenario.
+ * @param[in] seconds    Wall time the run lasts.
+ * @param[in] use_wheel  non-zero to drive the systems from a scheduler.
+ * @param[in] shards     Number of manager shards handling events.
+ * @return               0 on success, -1 if the scenario could not be generated or sharded.
+ */
+static int bench_run_size(const ScenarioConfig *config, int seconds, int use_wheel, int shards) {
+    Manager manager;
+    Scheduler scheduler;
+    pthread_t manager_t;
+    unsigned long long conversions = 0;
+    long long start_ns, elapsed_ns;
+    long rss_kb;
+    int threads, unthreaded = 0;
+
+    manager_init(&manager);
+    manager.quiet = 1;
+    manager.log.level = LOG_LEVEL_NONE;
+    if (scenario_generate(&manager, config) != 0 || manager_shard(&manager, shards) != 0) {
+        manager_clean(&manager);
+        return -1;
+    }
+
+    // The scheduler must be in place before the manager can reschedule anything
+    if (use_wheel) {
+        scheduler_init(&scheduler, &manager);
+    }
+
+    start_ns = clock_now_ns();
+    pthread_create(&manager_t, NULL, manager_thread, &manager);
+    manager_start_shards(&manager);
+    if (use_wheel) {
+        pthread_create(&scheduler.thread, NULL, scheduler_thread, &scheduler);
+    }
+    else {
+        for (int i = 0; i < manager.system_array.size; i++) {
+            manager_spawn_system(&manager, manager.system_array.systems[i]);
+            unthreaded += !manager.system_array.systems[i]->threaded;
+        }
+    }
+
+    sleep(seconds);
+    threads = bench_thread_count();
+    rss_kb = bench_rss_kb();
+
+    bench_stop(&manager);
+    elapsed_ns = clock_now_ns() - start_ns;
+    pthread_join(manager_t, NULL);
+    manager_join_shards(&manager);
+    if (use_wheel) {
+        pthread_join(scheduler.thread, NULL);
+        scheduler_clean(&scheduler);
+    }
+    else {
+        manager_join_systems(&manager);
+    }
+
+    for (int i = 0; i < manager.system_array.size; i++) {
+        conversions += manager.system_array.systems[i]->conversions;
+    }
+
+    printf("%10d %10d %8d %14.0f %12.0f %12.1f %12.1f %10.1f\n",
+           manager.system_array.size, manager.resource_array.size, threads,
+           conversions / (elapsed_ns / 1e9), manager.events_handled / (elapsed_ns / 1e9),
+           manager.events_handled > 0 ? manager.event_lag_ns / 1e3 / manager.events_handled : 0.0,
+           manager.event_lag_max_ns / 1e3, rss_kb / 1024.0);
+    if (manager.shard_count > 0) {
+        printf("%10s %.1f%% of events were forwarded between shards\n", "",
+               manager.events_handled > 0 ? 100.0 * manager.events_forwarded / manager.events_handled : 0.0);
+    }
+    if (unthreaded > 0) {
+        printf("%10s %d systems could not get a thread and never ran, try --wheel\n", "", unthreaded);
+    }
+
+    manager_clean(&manager);
+    return 0;
+}
+
+/**
+ * Terminates every system and stops the manager, the same way running out of oxygen does.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+static void bench_stop(Manager *manager) {
+    __atomic_store_n(&manager->simulation_running, 0, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < manager->system_array.size; i++) {
+        manager_set_system_status(manager, manager->system_array.systems[i], TERMINATE);
+    }
+}
+
+/**
+ * Reads the resident memory of this process.
+ *
+ * @return  Resident set size in kilobytes, or 0 if it is unavailable.
+ */
+long bench_rss_kb(void) {
+    FILE *file = fopen("/proc/self/statm", "r");
+    long size = 0, resident = 0;
+
+    if (file == NULL) {
+        return 0;
+    }
+    if (fscanf(file, "%ld %ld", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(file);
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Reads the number of threads in this process.
+ *
+ * @return  Number of threads, or 0 if it is unavailable.
+ */
+int bench_thread_count(void) {
+    FILE *file = fopen("/proc/self/status", "r");
+    char line[128];
+    int threads = 0;
+
+    if (file == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "Threads:", 8) == 0) {
+            threads = atoi(line + 8);
+            break;
+        }
+    }
+    fclose(file);
+
+    return threads;
+}
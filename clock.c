@@ -0,0 +1,18 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+#include "defs.h"
+#include <time.h>
+
+/**
+ * Reads the monotonic clock.
+ *
+ * Used wherever elapsed time matters (rates, wait times), since it never jumps with wall clock changes.
+ *
+ * @return  Nanoseconds since an arbitrary fixed point.
+ */
+long long clock_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
@@ -0,0 +1,549 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// A clustered run splits the systems across several partition processes forked from the coordinator.
+// The coordinator keeps the manager thread; each partition runs the threads of its own systems.
+//
+// Resources used by a single partition stay in that process's private memory. Resources used by several
+// partitions are moved into shared memory with process-shared semaphores before forking, so a transfer
+// across the boundary is an ordinary consume or store on the shared copy. Events travel from each
+// partition to the coordinator, and status or rate changes travel back, over single-producer
+// single-consumer rings in shared memory. Since partitions are forked and never exec, every process sees
+// its `System`s and `Resource`s at the same addresses, so messages can carry those pointers as they are.
+//
+// The display keeps working because the telemetry segment is a shared mapping created before forking.
+
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// Helper functions just used by this C file
+
+static void cluster_assign(Cluster *cluster, Manager *manager);
+static int cluster_ring_push(ClusterRing *ring, const ClusterMessage *message);
+static int cluster_ring_pop(ClusterRing *ring, ClusterMessage *message);
+static void cluster_partition_run(Cluster *cluster, int partition);
+static void *cluster_collector_thread(void *arg);
+
+/**
+ * Initializes a `Cluster`: partitions the manager's systems and resources and prepares shared memory.
+ *
+ * Must be called before any thread is started, since the resources used by several partitions are
+ * swapped for shared memory copies and every system is repointed at them.
+ *
+ * @param[out]    cluster          Pointer to the `Cluster` to initialize.
+ * @param[in,out] manager          Pointer to the `Manager` holding the scenario.
+ * @param[in]     partition_count  Number of partition processes (at least 1).
+ * @return                         0 on success, -1 if memory could not be allocated.
+ */
+int cluster_init(Cluster *cluster, Manager *manager, int partition_count) {
+    int systems = manager->system_array.size;
+    int resources = manager->resource_array.size;
+    int i, index;
+    System *system;
+
+    memset(cluster, 0, sizeof(Cluster));
+    cluster->manager = manager;
+    cluster->partition_count = (partition_count > 0) ? partition_count : 1;
+    cluster->system_partition = (int *)calloc(systems > 0 ? systems : 1, sizeof(int));
+    cluster->resource_partition = (int *)calloc(resources > 0 ? resources : 1, sizeof(int));
+    cluster->original = (Resource **)calloc(resources > 0 ? resources : 1, sizeof(Resource *));
+    cluster->children = (pid_t *)calloc(cluster->partition_count, sizeof(pid_t));
+
+    if (cluster->system_partition == NULL || cluster->resource_partition == NULL ||
+        cluster->original == NULL || cluster->children == NULL) {
+        cluster_clean(cluster);
+        return -1;
+    }
+
+    cluster_assign(cluster, manager);
+
+    // Map the rings and the shared copies of resources used by several partitions
+    cluster->control_size = sizeof(ClusterControl) + sizeof(ClusterRing) * 2 * cluster->partition_count;
+    cluster->control = mmap(NULL, cluster->control_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (cluster->control == MAP_FAILED) {
+        cluster->control = NULL;
+        cluster_clean(cluster);
+        return -1;
+    }
+
+    if (cluster->shared_count > 0) {
+        cluster->shared = mmap(NULL, sizeof(Resource) * cluster->shared_count, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (cluster->shared == MAP_FAILED) {
+            cluster->shared = NULL;
+            cluster_clean(cluster);
+            return -1;
+        }
+    }
+
+    index = 0;
+    for (i = 0; i < resources; i++) {
+        if (cluster->resource_partition[i] >= 0) {
+            continue;
+        }
+
+        // The copy keeps the name and telemetry slot, but needs a semaphore shared between processes
+        cluster->original[i] = manager->resource_array.resources[i];
+        cluster->shared[index] = *cluster->original[i];
+        sem_init(&cluster->shared[index].mutex, 1, 1);
+        manager->resource_array.resources[i] = &cluster->shared[index];
+        index++;
+    }
+
+    for (i = 0; i < systems; i++) {
+        system = manager->system_array.systems[i];
+        if (system->consumed.resource != NULL && cluster->original[system->consumed.resource->id] != NULL) {
+            system->consumed.resource = manager->resource_array.resources[system->consumed.resource->id];
+        }
+        if (system->produced.resource != NULL && cluster->original[system->produced.resource->id] != NULL) {
+            system->produced.resource = manager->resource_array.resources[system->produced.resource->id];
+        }
+    }
+
+    manager->cluster = cluster;
+    return 0;
+}
+
+/**
+ * Cleans up a `Cluster`, moving shared resources back to the heap so the manager can destroy them.
+ *
+ * @param[in,out] cluster  Pointer to the `Cluster` to clean.
+ */
+void cluster_clean(Cluster *cluster) {
+    Manager *manager = cluster->manager;
+    System *system;
+    int i, resources;
+
+    if (manager != NULL && cluster->original != NULL && cluster->shared != NULL) {
+        resources = manager->resource_array.size;
+
+        for (i = 0; i < manager->system_array.size; i++) {
+            system = manager->system_array.systems[i];
+            if (system->consumed.resource != NULL && cluster->original[system->consumed.resource->id] != NULL) {
+                system->consumed.resource = cluster->original[system->consumed.resource->id];
+            }
+            if (system->produced.resource != NULL && cluster->original[system->produced.resource->id] != NULL) {
+                system->produced.resource = cluster->original[system->produced.resource->id];
+            }
+        }
+
+        for (i = 0; i < resources; i++) {
+            if (cluster->original[i] != NULL) {
+                cluster->original[i]->amount = manager->resource_array.resources[i]->amount;
+                sem_destroy(&manager->resource_array.resources[i]->mutex);
+                manager->resource_array.resources[i] = cluster->original[i];
+            }
+        }
+    }
+
+    if (manager != NULL && manager->cluster == cluster) {
+        manager->cluster = NULL;
+    }
+
+    if (cluster->shared != NULL) {
+        munmap(cluster->shared, sizeof(Resource) * cluster->shared_count);
+    }
+    if (cluster->control != NULL) {
+        munmap(cluster->control, cluster->control_size);
+    }
+
+    free(cluster->system_partition);
+    free(cluster->resource_partition);
+    free(cluster->original);
+    free(cluster->children);
+    memset(cluster, 0, sizeof(Cluster));
+}
+
+/**
+ * Prints which systems each partition owns and how much of the flow graph crosses partitions.
+ *
+ * @param[in] cluster  Pointer to the `Cluster`.
+ */
+void cluster_print(const Cluster *cluster) {
+    Manager *manager = cluster->manager;
+    int p, i;
+
+    printf("Partitions:\n");
+    printf("-------------------------\n");
+    for (p = 0; p < cluster->partition_count; p++) {
+        printf("Partition %d:", p);
+        for (i = 0; i < manager->system_array.size; i++) {
+            if (cluster->system_partition[i] == p) {
+                printf(" [%s]", manager->system_array.systems[i]->name);
+            }
+        }
+        printf("\n");
+    }
+
+    printf("Shared resources:");
+    for (i = 0; i < manager->resource_array.size; i++) {
+        if (cluster->resource_partition[i] < 0) {
+            printf(" [%s]", manager->resource_array.resources[i]->name);
+        }
+    }
+    printf("%s\n", cluster->shared_count == 0 ? " none" : "");
+    printf("Cross-partition links: %d of %d\n\n", cluster->cross_links, cluster->total_links);
+}
+
+/**
+ * Forks one process per partition and starts collecting their events.
+ *
+ * Must be called from the only running thread, since a forked child only keeps the calling thread.
+ *
+ * @param[in,out] cluster  Pointer to the `Cluster`.
+ * @return                 0 on success, -1 if a partition or the event collector could not be started (any started
+ *                         partitions are stopped).
+ */
+int cluster_start(Cluster *cluster) {
+    int p;
+    pid_t pid;
+
+    // Make sure buffered output is not written once per process
+    fflush(stdout);
+
+    for (p = 0; p < cluster->partition_count; p++) {
+        pid = fork();
+
+        if (pid == 0) {
+            cluster_partition_run(cluster, p);
+            _exit(0);
+        }
+
+        if (pid < 0) {
+            cluster_stop(cluster);
+            return -1;
+        }
+        cluster->children[p] = pid;
+    }
+
+    if (pthread_create(&cluster->collector, NULL, cluster_collector_thread, cluster) != 0) {
+        cluster_stop(cluster);
+        return -1;
+    }
+    cluster->collector_started = 1;
+    return 0;
+}
+
+/**
+ * Tells every partition to terminate and waits for them and for the event collector to finish.
+ *
+ * @param[in,out] cluster  Pointer to the `Cluster`.
+ */
+void cluster_stop(Cluster *cluster) {
+    int p;
+
+    __atomic_store_n(&cluster->control->terminate, 1, __ATOMIC_RELEASE);
+
+    for (p = 0; p < cluster->partition_count; p++) {
+        if (cluster->children[p] > 0) {
+            waitpid(cluster->children[p], NULL, 0);
+            cluster->children[p] = 0;
+        }
+    }
+
+    if (cluster->collector_started) {
+        pthread_join(cluster->collector, NULL);
+        cluster->collector_started = 0;
+    }
+}
+
+/**
+ * Sends a system's new status and rate multiplier to the partition that runs it.
+ *
+ * Only called from the manager thread, the single producer of every command ring.
+ *
+ * @param[in,out] cluster  Pointer to the `Cluster`.
+ * @param[in]     system   Pointer to the `System` that changed.
+ */
+void cluster_send_system(Cluster *cluster, System *system) {
+    ClusterMessage message;
+
+    memset(&message, 0, sizeof(ClusterMessage));
+    message.system = system;
+    message.status = system->status;
+    message.rate_multiplier = system->rate_multiplier;
+    cluster_ring_push(&cluster->control->rings[2 * cluster->system_partition[system->id] + 1], &message);
+}
+
+/**
+ * Assigns every resource and system to a partition, following the resource flow graph.
+ *
+ * Each system belongs with the resource it produces (or consumes, if it produces nothing), and a
+ * resource weighs as much as the systems that belong with it. Resources are ordered breadth-first
+ * through the graph, where two resources are neighbours if one system links them, and the order is cut
+ * into partitions of roughly equal weight. Neighbouring resources therefore land together and only
+ * the resources at a cut, or shared by systems on both sides of one, cross a partition boundary.
+ *
+ * @param[in,out] cluster  Pointer to the `Cluster` whose assignment arrays are filled.
+ * @param[in]     manager  Pointer to the `Manager` holding the scenario.
+ */
+static void cluster_assign(Cluster *cluster, Manager *manager) {
+    int systems = manager->system_array.size;
+    int resources = manager->resource_array.size;
+    int *weight = (int *)calloc(resources + 1, sizeof(int));
+    int *degree = (int *)calloc(resources + 1, sizeof(int));
+    int *offset = (int *)calloc(resources + 2, sizeof(int));
+    int *neighbour = (int *)calloc(2 * systems + 1, sizeof(int));
+    int *order = (int *)calloc(resources + 1, sizeof(int));
+    int *visited = (int *)calloc(resources + 1, sizeof(int));
+    int i, j, r, head, tail, total = 0, target, accumulated = 0, partition = 0, home, c, p;
+    System *system;
+
+    if (weight == NULL || degree == NULL || offset == NULL || neighbour == NULL || order == NULL || visited == NULL) {
+        // Without scratch memory everything goes to partition 0
+        for (i = 0; i < resources; i++) {
+            cluster->resource_partition[i] = 0;
+        }
+        goto done;
+    }
+
+    // Weigh each resource by the systems that belong with it, and count the links between resources
+    for (i = 0; i < systems; i++) {
+        system = manager->system_array.systems[i];
+        if (system->produced.resource != NULL) {
+            weight[system->produced.resource->id]++;
+        } else if (system->consumed.resource != NULL) {
+            weight[system->consumed.resource->id]++;
+        }
+        total++;
+
+        if (system->produced.resource != NULL && system->consumed.resource != NULL) {
+            degree[system->produced.resource->id]++;
+            degree[system->consumed.resource->id]++;
+        }
+    }
+
+    for (i = 0; i < resources; i++) {
+        offset[i + 1] = offset[i] + degree[i];
+        degree[i] = 0;
+    }
+    for (i = 0; i < systems; i++) {
+        system = manager->system_array.systems[i];
+        if (system->produced.resource != NULL && system->consumed.resource != NULL) {
+            c = system->consumed.resource->id;
+            p = system->produced.resource->id;
+            neighbour[offset[c] + degree[c]++] = p;
+            neighbour[offset[p] + degree[p]++] = c;
+        }
+    }
+
+    // Breadth-first order over every connected group of resources in turn
+    tail = 0;
+    for (i = 0; i < resources; i++) {
+        if (visited[i]) {
+            continue;
+        }
+        visited[i] = 1;
+        order[tail++] = i;
+
+        for (head = tail - 1; head < tail; head++) {
+            r = order[head];
+            for (j = offset[r]; j < offset[r + 1]; j++) {
+                if (!visited[neighbour[j]]) {
+                    visited[neighbour[j]] = 1;
+                    order[tail++] = neighbour[j];
+                }
+            }
+        }
+    }
+
+    // Cut the order into partitions of roughly equal weight
+    target = (total + cluster->partition_count - 1) / cluster->partition_count;
+    for (i = 0; i < resources; i++) {
+        r = order[i];
+        if (accumulated >= target * (partition + 1) && partition < cluster->partition_count - 1) {
+            partition++;
+        }
+        cluster->resource_partition[r] = partition;
+        accumulated += weight[r];
+    }
+
+done:
+    // Systems follow their home resource, resources touched from another partition become shared
+    cluster->cross_links = 0;
+    cluster->total_links = 0;
+    for (i = 0; i < systems; i++) {
+        system = manager->system_array.systems[i];
+        home = 0;
+        if (system->produced.resource != NULL) {
+            home = cluster->resource_partition[system->produced.resource->id];
+        } else if (system->consumed.resource != NULL) {
+            home = cluster->resource_partition[system->consumed.resource->id];
+        }
+        cluster->system_partition[i] = home;
+    }
+
+    // Count the links first, since marking a resource shared hides which partition it was cut into
+    for (i = 0; i < systems; i++) {
+        system = manager->system_array.systems[i];
+        if (system->consumed.resource != NULL) {
+            cluster->total_links++;
+            if (cluster->resource_partition[system->consumed.resource->id] != cluster->system_partition[i]) {
+                cluster->cross_links++;
+            }
+        }
+        if (system->produced.resource != NULL) {
+            cluster->total_links++;
+        }
+    }
+
+    // Reuse the breadth-first flags to mark resources consumed from outside their partition
+    for (i = 0; i < systems; i++) {
+        system = manager->system_array.systems[i];
+        if (system->consumed.resource != NULL && visited != NULL && visited[system->consumed.resource->id] != -1 &&
+            cluster->resource_partition[system->consumed.resource->id] != cluster->system_partition[i]) {
+            visited[system->consumed.resource->id] = -1;
+        }
+    }
+
+    cluster->shared_count = 0;
+    for (i = 0; i < resources; i++) {
+        if (visited != NULL && visited[i] == -1) {
+            cluster->resource_partition[i] = -1;
+            cluster->shared_count++;
+        }
+    }
+
+    free(weight);
+    free(degree);
+    free(offset);
+    free(neighbour);
+    free(order);
+    free(visited);
+}
+
+/**
+ * Pushes a message onto a ring, dropping it if the ring is full.
+ *
+ * @param[in,out] ring     Pointer to the `ClusterRing`, of which the caller is the only producer.
+ * @param[in]     message  Pointer to the message to copy in.
+ * @return                 0 on success, -1 if the ring was full.
+ */
+static int cluster_ring_push(ClusterRing *ring, const ClusterMessage *message) {
+    unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if (tail - head >= CLUSTER_RING_SIZE) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    ring->messages[tail & (CLUSTER_RING_SIZE - 1)] = *message;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Pops the oldest message from a ring.
+ *
+ * @param[in,out] ring     Pointer to the `ClusterRing`, of which the caller is the only consumer.
+ * @param[out]    message  Pointer to copy the message into.
+ * @return                 Non-zero if a message was popped; zero if the ring was empty.
+ */
+static int cluster_ring_pop(ClusterRing *ring, ClusterMessage *message) {
+    unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head == tail) {
+        return 0;
+    }
+
+    *message = ring->messages[head & (CLUSTER_RING_SIZE - 1)];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * Runs one partition inside its forked process.
+ *
+ * Starts a thread for each of the partition's systems, then relays their events to the coordinator
+ * and applies the coordinator's commands until every one of its systems has terminated.
+ *
+ * @param[in,out] cluster    Pointer to the `Cluster`.
+ * @param[in]     partition  Index of the partition this process runs.
+ */
+static void cluster_partition_run(Cluster *cluster, int partition) {
+    Manager *manager = cluster->manager;
+    ClusterRing *events = &cluster->control->rings[2 * partition];
+    ClusterRing *commands = &cluster->control->rings[2 * partition + 1];
+    ClusterMessage message;
+    Event event;
+    System *system;
+    pthread_t *threads;
+    int i, count = 0, running;
+
+    // The coordinator decides when the mission ends, so a partition never exits on its own signal
+    signal(SIGINT, SIG_IGN);
+
+    threads = (pthread_t *)malloc(sizeof(pthread_t) * (manager->system_array.size > 0 ? manager->system_array.size : 1));
+    if (threads == NULL) {
+        return;
+    }
+
+    for (i = 0; i < manager->system_array.size; i++) {
+        if (cluster->system_partition[i] == partition) {
+            pthread_create(&threads[count++], NULL, system_thread, manager->system_array.systems[i]);
+        }
+    }
+
+    memset(&message, 0, sizeof(ClusterMessage));
+    running = count;
+    while (running > 0) {
+        while (event_queue_pop(&manager->event_queue, &event)) {
+            message.event = event;
+            cluster_ring_push(events, &message);
+        }
+
+        while (cluster_ring_pop(commands, &message)) {
+            message.system->rate_multiplier = message.rate_multiplier;
+            message.system->status = message.status;
+        }
+
+        running = 0;
+        for (i = 0; i < manager->system_array.size; i++) {
+            system = manager->system_array.systems[i];
+            if (cluster->system_partition[i] != partition) {
+                continue;
+            }
+            if (__atomic_load_n(&cluster->control->terminate, __ATOMIC_ACQUIRE)) {
+                system->status = TERMINATE;
+            }
+            running += (system->status != TERMINATE);
+        }
+
+        usleep(CLUSTER_POLL_TIME * 1000);
+    }
+
+    for (i = 0; i < count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+/**
+ * Moves events from every partition's ring onto the coordinator's event queue.
+ *
+ * @param[in] arg  Pointer to the `Cluster` object.
+ * @return    NULL once the cluster has been told to terminate.
+ */
+static void *cluster_collector_thread(void *arg) {
+    Cluster *cluster = (Cluster *)arg;
+    ClusterMessage message;
+    int p;
+
+    while (!__atomic_load_n(&cluster->control->terminate, __ATOMIC_ACQUIRE)) {
+        for (p = 0; p < cluster->partition_count; p++) {
+            while (cluster_ring_pop(&cluster->control->rings[2 * p], &message)) {
+                event_queue_push(&cluster->manager->event_queue, &message.event);
+            }
+        }
+        usleep(CLUSTER_POLL_TIME * 1000);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,389 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// The control server listens on a local (Unix domain) socket and changes the running simulation.
+// Each command is one line, and every reply ends with a line that is either "ok" or "error: <reason>".
+// Names containing spaces can be written in double quotes, and "-" stands for no resource.
+//
+//   add resource NAME AMOUNT MAX_CAPACITY
+//   add system NAME CONSUMED AMOUNT PRODUCED AMOUNT PROCESSING_TIME
+//   remove system NAME
+//   remove resource NAME
+//   list
+//
+// The server thread is the only writer of the system and resource arrays while the simulation runs.
+// Clients are served one at a time, so `nc -U PATH` or `socat - UNIX-CONNECT:PATH` is enough to drive it.
+
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define CONTROL_MAX_TOKENS 8
+
+// Helper functions just used by this C file
+
+static void *control_thread(void *arg);
+static void control_serve(Control *control, int client);
+static void control_execute(Control *control, char *line, int client);
+static int control_tokenize(char *line, char *tokens[], int max_tokens);
+static int control_parse_number(const char *text, int *value);
+static void control_reply(int client, const char *text);
+static Resource *control_find_resource(Manager *manager, const char *name);
+static System *control_find_system(Manager *manager, const char *name);
+
+/**
+ * Starts the control server on a local socket.
+ *
+ * Any file already at `path` is replaced.
+ *
+ * @param[out]    control  Pointer to the `Control` to initialize.
+ * @param[in,out] manager  Pointer to the `Manager` whose simulation is changed by commands.
+ * @param[in]     path     Filesystem path of the socket.
+ * @return                 0 on success, -1 if the socket could not be created.
+ */
+int control_start(Control *control, Manager *manager, const char *path) {
+    struct sockaddr_un address;
+
+    control->manager = manager;
+    control->running = 0;
+    control->path[0] = '\0';
+
+    if (strlen(path) >= sizeof(address.sun_path) || strlen(path) >= sizeof(control->path)) {
+        return -1;
+    }
+
+    control->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (control->fd < 0) {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+
+    if (bind(control->fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(control->fd, 4) != 0) {
+        close(control->fd);
+        return -1;
+    }
+
+    strcpy(control->path, path);
+    control->running = 1;
+    if (pthread_create(&control->thread, NULL, control_thread, control) != 0) {
+        control->running = 0;
+        close(control->fd);
+        unlink(control->path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Stops the control server and removes its socket.
+ *
+ * Once this returns nothing else adds or removes systems, so their threads can be joined.
+ *
+ * @param[in,out] control  Pointer to the `Control` to stop.
+ */
+void control_stop(Control *control) {
+    if (!control->running) {
+        return;
+    }
+
+    __atomic_store_n(&control->running, 0, __ATOMIC_RELEASE);
+    pthread_join(control->thread, NULL);
+    close(control->fd);
+    unlink(control->path);
+}
+
+/**
+ * Accepts clients until the server is stopped.
+ *
+ * @param[in] arg  Pointer to the `Control` object.
+ * @return    NULL once the server is stopped.
+ */
+static void *control_thread(void *arg) {
+    Control *control = (Control *)arg;
+    struct pollfd listener = { control->fd, POLLIN, 0 };
+    int client;
+
+    while (__atomic_load_n(&control->running, __ATOMIC_ACQUIRE)) {
+        if (poll(&listener, 1, CONTROL_POLL_TIME) <= 0) {
+            continue;
+        }
+
+        client = accept(control->fd, NULL, NULL);
+        if (client >= 0) {
+            control_serve(control, client);
+            close(client);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Reads commands from one client, line by line, until it disconnects or the server is stopped.
+ *
+ * @param[in,out] control  Pointer to the `Control`.
+ * @param[in]     client   Socket of the connected client.
+ */
+static void control_serve(Control *control, int client) {
+    struct pollfd reader = { client, POLLIN, 0 };
+    char buffer[CONTROL_LINE_LENGTH];
+    char *newline;
+    int length = 0, received, discarding = 0;
+
+    while (__atomic_load_n(&control->running, __ATOMIC_ACQUIRE)) {
+        if (poll(&reader, 1, CONTROL_POLL_TIME) <= 0) {
+            continue;
+        }
+
+        received = (int)recv(client, buffer + length, sizeof(buffer) - 1 - length, 0);
+        if (received <= 0) {
+            return;
+        }
+        length += received;
+        buffer[length] = '\0';
+
+        // Drop the rest of a line that was too long, up to and including its end
+        if (discarding) {
+            newline = strchr(buffer, '\n');
+            if (newline == NULL) {
+                length = 0;
+                continue;
+            }
+            length -= (int)(newline + 1 - buffer);
+            memmove(buffer, newline + 1, length + 1);
+            discarding = 0;
+        }
+
+        // Run every complete line, keeping any partial line for the next read
+        while ((newline = strchr(buffer, '\n')) != NULL) {
+            *newline = '\0';
+            control_execute(control, buffer, client);
+            length -= (int)(newline + 1 - buffer);
+            memmove(buffer, newline + 1, length + 1);
+        }
+
+        if (length == (int)sizeof(buffer) - 1) {
+            control_reply(client, "error: line too long\n");
+            length = 0;
+            discarding = 1;
+        }
+    }
+}
+
+/**
+ * Runs a single command and replies to the client.
+ *
+ * @param[in,out] control  Pointer to the `Control`.
+ * @param[in,out] line     The command, split in place into tokens.
+ * @param[in]     client   Socket to reply to.
+ */
+static void control_execute(Control *control, char *line, int client) {
+    Manager *manager = control->manager;
+    char *tokens[CONTROL_MAX_TOKENS];
+    char reply[CONTROL_LINE_LENGTH];
+    Resource **resources, *resource, *consumed, *produced;
+    System **systems, *system;
+    ResourceAmount consume, produce;
+    int count, i, size, amount, capacity, consume_amount = 0, produce_amount = 0, processing_time;
+
+    count = control_tokenize(line, tokens, CONTROL_MAX_TOKENS);
+    if (count == 0) {
+        return;
+    }
+
+    if (strcmp(tokens[0], "list") == 0 && count == 1) {
+        size = resource_array_snapshot(&manager->resource_array, &resources);
+        for (i = 0; i < size; i++) {
+            snprintf(reply, sizeof(reply), "resource \"%s\" %d/%d\n", resources[i]->name,
+                     resource_read_amount(resources[i]), resources[i]->max_capacity);
+            control_reply(client, reply);
+        }
+        size = system_array_snapshot(&manager->system_array, &systems);
+        for (i = 0; i < size; i++) {
+            snprintf(reply, sizeof(reply), "system \"%s\" %s\n", systems[i]->name, system_status_name(systems[i]->status));
+            control_reply(client, reply);
+        }
+        control_reply(client, "ok\n");
+    }
+    else if (strcmp(tokens[0], "add") == 0 && count == 5 && strcmp(tokens[1], "resource") == 0) {
+        if (control_find_resource(manager, tokens[2]) != NULL) {
+            control_reply(client, "error: resource already exists\n");
+            return;
+        }
+        if (control_parse_number(tokens[3], &amount) != 0 || control_parse_number(tokens[4], &capacity) != 0 ||
+            amount < 0 || capacity <= 0 || amount > capacity) {
+            control_reply(client, "error: amount must be between 0 and a positive capacity\n");
+            return;
+        }
+
+        resource_create(&resource, tokens[2], amount, capacity);
+        if (resource == NULL || manager_add_resource(manager, resource) != 0) {
+            resource_destroy(resource);
+            control_reply(client, "error: could not add resource\n");
+            return;
+        }
+        control_reply(client, "ok\n");
+    }
+    else if (strcmp(tokens[0], "add") == 0 && count == 8 && strcmp(tokens[1], "system") == 0) {
+        consumed = control_find_resource(manager, tokens[3]);
+        produced = control_find_resource(manager, tokens[5]);
+
+        if (control_find_system(manager, tokens[2]) != NULL) {
+            control_reply(client, "error: system already exists\n");
+            return;
+        }
+        if ((consumed == NULL && strcmp(tokens[3], "-") != 0) || (produced == NULL && strcmp(tokens[5], "-") != 0)) {
+            control_reply(client, "error: unknown resource\n");
+            return;
+        }
+        // The amount of a missing resource is not used, so it may be anything such as "-"
+        if ((consumed != NULL && (control_parse_number(tokens[4], &consume_amount) != 0 || consume_amount <= 0)) ||
+            (produced != NULL && (control_parse_number(tokens[6], &produce_amount) != 0 || produce_amount <= 0)) ||
+            control_parse_number(tokens[7], &processing_time) != 0 || processing_time <= 0) {
+            control_reply(client, "error: amounts and processing time must be positive\n");
+            return;
+        }
+
+        resource_amount_init(&consume, consumed, consume_amount);
+        resource_amount_init(&produce, produced, produce_amount);
+        system_create(&system, tokens[2], consume, produce, processing_time, &manager->event_queue);
+        if (system == NULL || manager_add_system(manager, system) != 0) {
+            system_destroy(system);
+            control_reply(client, "error: could not add system\n");
+            return;
+        }
+        control_reply(client, "ok\n");
+    }
+    else if (strcmp(tokens[0], "remove") == 0 && count == 3 && strcmp(tokens[1], "system") == 0) {
+        system = control_find_system(manager, tokens[2]);
+        if (system == NULL || manager_remove_system(manager, system) != 0) {
+            control_reply(client, "error: could not remove system\n");
+            return;
+        }
+        control_reply(client, "ok\n");
+    }
+    else if (strcmp(tokens[0], "remove") == 0 && count == 3 && strcmp(tokens[1], "resource") == 0) {
+        resource = control_find_resource(manager, tokens[2]);
+        if (resource == NULL || manager_remove_resource(manager, resource) != 0) {
+            control_reply(client, "error: could not remove resource (unknown, or still used by a system)\n");
+            return;
+        }
+        control_reply(client, "ok\n");
+    }
+    else {
+        control_reply(client, "error: unknown command\n");
+    }
+}
+
+/**
+ * Splits a line into whitespace separated tokens, where a double quoted token may contain spaces.
+ *
+ * @param[in,out] line        The line, modified in place.
+ * @param[out]    tokens      Set to the start of each token.
+ * @param[in]     max_tokens  Size of `tokens`.
+ * @return                    Number of tokens found, or `max_tokens + 1` if there were too many.
+ */
+static int control_tokenize(char *line, char *tokens[], int max_tokens) {
+    int count = 0;
+    char end;
+
+    while (*line != '\0') {
+        while (*line == ' ' || *line == '\t' || *line == '\r') {
+            line++;
+        }
+        if (*line == '\0') {
+            break;
+        }
+        if (count == max_tokens) {
+            return max_tokens + 1;
+        }
+
+        end = ' ';
+        if (*line == '"') {
+            end = '"';
+            line++;
+        }
+        tokens[count++] = line;
+
+        while (*line != '\0' && *line != end && !(end == ' ' && (*line == '\t' || *line == '\r'))) {
+            line++;
+        }
+        if (*line != '\0') {
+            *line++ = '\0';
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Parses a whole token as a whole number.
+ *
+ * @param[in]  text   The token.
+ * @param[out] value  Set to the number on success.
+ * @return            0 on success, -1 if the token is not a number or does not fit in an int.
+ */
+static int control_parse_number(const char *text, int *value) {
+    char *end;
+    long number = strtol(text, &end, 10);
+
+    if (end == text || *end != '\0' || number < INT_MIN || number > INT_MAX) {
+        return -1;
+    }
+
+    *value = (int)number;
+    return 0;
+}
+
+/**
+ * Sends a reply to the client, ignoring a client that has gone away.
+ *
+ * @param[in] client  Socket to reply to.
+ * @param[in] text    Text to send.
+ */
+static void control_reply(int client, const char *text) {
+    send(client, text, strlen(text), MSG_NOSIGNAL);
+}
+
+/**
+ * Finds a resource in the simulation by name.
+ *
+ * @param[in] manager  Pointer to the `Manager`.
+ * @param[in] name     Name to look for.
+ * @return             The `Resource`, or NULL if there is none with that name.
+ */
+static Resource *control_find_resource(Manager *manager, const char *name) {
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        if (strcmp(manager->resource_array.resources[i]->name, name) == 0) {
+            return manager->resource_array.resources[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Finds a system in the simulation by name.
+ *
+ * @param[in] manager  Pointer to the `Manager`.
+ * @param[in] name     Name to look for.
+ * @return             The `System`, or NULL if there is none with that name.
+ */
+static System *control_find_system(Manager *manager, const char *name) {
+    for (int i = 0; i < manager->system_array.size; i++) {
+        if (strcmp(manager->system_array.systems[i]->name, name) == 0) {
+            return manager->system_array.systems[i];
+        }
+    }
+    return NULL;
+}
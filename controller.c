@@ -0,0 +1,213 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+#include "defs.h"
+#include <stdlib.h>
+
+// The level every controlled resource is steered towards, midway between the low threshold and full
+#define PID_SETPOINT ((THRESHOLD_RESOURCE_LOW + 1.0) / 2.0)
+
+/**
+ * Initializes the `Controller` for the manager's current resources.
+ *
+ * Every resource that is both produced and consumed is controlled. Each controlled resource starts
+ * from a feed-forward bias: the multiplier at which its producers exactly match its consumers'
+ * demand, with the consumers themselves running at the bias of whatever they produce. Producers are
+ * switched to `STANDARD` and run at that bias, so the PID terms only have to correct the remainder.
+ *
+ * @param[out]    controller  Pointer to the `Controller` to initialize.
+ * @param[in,out] manager     Pointer to the `Manager` whose producers will be controlled.
+ */
+void controller_init(Controller *controller, Manager *manager) {
+    int i, pass, n;
+    double *supply, *demand, multiplier;
+    System *system;
+    PidState *state;
+
+    // States are indexed by resource id
+    controller->size = manager->resource_array.next_id;
+    controller->last_update_ns = clock_now_ns();
+    n = controller->size > 0 ? controller->size : 1;
+    controller->states = (PidState *)calloc(n, sizeof(PidState));
+    supply = (double *)calloc(n, sizeof(double));
+    demand = (double *)calloc(n, sizeof(double));
+
+    if (controller->states == NULL || supply == NULL || demand == NULL) {
+        free(controller->states);
+        controller->states = NULL;
+        controller->size = 0;
+        free(supply);
+        free(demand);
+        return;
+    }
+
+    // supply is the standard production rate of each resource, in units per millisecond
+    for (i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        if (system->produced.resource != NULL && system->processing_time > 0) {
+            supply[system->produced.resource->id] += (double)system->produced.amount / system->processing_time;
+        }
+    }
+
+    for (i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        if (system->consumed.resource != NULL) {
+            demand[system->consumed.resource->id] = 1;
+        }
+    }
+
+    for (i = 0; i < controller->size; i++) {
+        controller->states[i].controlled = (supply[i] > 0 && demand[i] > 0);
+        controller->states[i].bias = 1.0;
+    }
+
+    // Demand depends on the consumers' own bias, so settle the chain one link per pass
+    for (pass = 0; pass <= controller->size; pass++) {
+        for (i = 0; i < controller->size; i++) {
+            demand[i] = 0;
+        }
+
+        for (i = 0; i < manager->system_array.size; i++) {
+            system = manager->system_array.systems[i];
+            if (system->consumed.resource == NULL || system->processing_time <= 0) {
+                continue;
+            }
+
+            multiplier = 1.0;
+            if (system->produced.resource != NULL && controller->states[system->produced.resource->id].controlled) {
+                multiplier = controller->states[system->produced.resource->id].bias;
+            }
+            demand[system->consumed.resource->id] += system->consumed.amount * multiplier / system->processing_time;
+        }
+
+        for (i = 0; i < controller->size; i++) {
+            state = &controller->states[i];
+            if (state->controlled) {
+                state->bias = demand[i] / supply[i];
+                if (state->bias > RATE_MULTIPLIER_MAX) {
+                    state->bias = RATE_MULTIPLIER_MAX;
+                } else if (state->bias < RATE_MULTIPLIER_MIN) {
+                    state->bias = RATE_MULTIPLIER_MIN;
+                }
+            }
+            state->output = state->bias;
+        }
+    }
+
+    for (i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        if (system->produced.resource == NULL || !controller->states[system->produced.resource->id].controlled) {
+            continue;
+        }
+
+        if (system->status == SLOW || system->status == FAST) {
+            system->status = STANDARD;
+        }
+        system->rate_multiplier = controller->states[system->produced.resource->id].bias;
+    }
+
+    free(supply);
+    free(demand);
+}
+
+/**
+ * Cleans up the `Controller`.
+ *
+ * @param[in,out] controller  Pointer to the `Controller` to clean.
+ */
+void controller_clean(Controller *controller) {
+    free(controller->states);
+    controller->states = NULL;
+    controller->size = 0;
+}
+
+/**
+ * Checks whether the `Controller` steers the producers of a resource.
+ *
+ * Only resources known when the controller was initialized can be controlled, so the manager
+ * keeps reacting to events about resources added later the way it does without the controller.
+ *
+ * @param[in] controller  Pointer to the `Controller`.
+ * @param[in] resource    Pointer to the `Resource`.
+ * @return                non-zero if the controller adjusts the resource's producers.
+ */
+int controller_controls(const Controller *controller, const Resource *resource) {
+    return controller->states != NULL && resource->id >= 0 && resource->id < controller->size &&
+           controller->states[resource->id].controlled;
+}
+
+/**
+ * Updates the rate multiplier of every controlled producer.
+ *
+ * Runs at most once every `MANAGER_WAIT_TIME` milliseconds. For each controlled resource the error
+ * is the distance of its level (amount / max_capacity) below the setpoint, and the producers' new
+ * multiplier is `bias + Kp * error + Ki * integral + Kd * derivative`, clamped to
+ * [`RATE_MULTIPLIER_MIN`, `RATE_MULTIPLIER_MAX`]. The integral is frozen while the output is
+ * saturated in the direction of the error so it does not wind up while a resource is pinned.
+ *
+ * @param[in,out] controller  Pointer to the `Controller`.
+ * @param[in,out] manager     Pointer to the `Manager` whose producers are adjusted.
+ */
+void controller_update(Controller *controller, Manager *manager) {
+    int i, resource_count, system_count;
+    long long now = clock_now_ns();
+    double dt, level, error, derivative, integral, output;
+    Resource **resources, *resource;
+    System **systems, *system;
+    PidState *state;
+
+    dt = (now - controller->last_update_ns) / 1e9;
+    if (controller->states == NULL || dt * 1000 < MANAGER_WAIT_TIME) {
+        return;
+    }
+    controller->last_update_ns = now;
+
+    // Resources and systems may be added or removed while running, so states are found by id
+    resource_count = resource_array_snapshot(&manager->resource_array, &resources);
+    for (i = 0; i < resource_count; i++) {
+        resource = resources[i];
+        if (resource->id >= controller->size) {
+            continue;
+        }
+        state = &controller->states[resource->id];
+        if (!state->controlled || resource->max_capacity <= 0) {
+            continue;
+        }
+
+        level = (double)resource_read_amount(resource) / resource->max_capacity;
+        error = PID_SETPOINT - level;
+        // Levels move in whole production batches, so smooth the derivative to avoid kicking on every batch
+        derivative = state->derivative + PID_DERIVATIVE_SMOOTHING * ((error - state->previous_error) / dt - state->derivative);
+        state->derivative = derivative;
+        integral = state->integral + error * dt;
+        output = state->bias + PID_KP * error + PID_KI * integral + PID_KD * derivative;
+
+        // Only keep integrating when it does not push further into saturation
+        if ((output < RATE_MULTIPLIER_MAX || error < 0) && (output > RATE_MULTIPLIER_MIN || error > 0)) {
+            state->integral = integral;
+        }
+
+        if (output > RATE_MULTIPLIER_MAX) {
+            output = RATE_MULTIPLIER_MAX;
+        } else if (output < RATE_MULTIPLIER_MIN) {
+            output = RATE_MULTIPLIER_MIN;
+        }
+
+        state->previous_error = error;
+        state->output = output;
+    }
+
+    system_count = system_array_snapshot(&manager->system_array, &systems);
+    for (i = 0; i < system_count; i++) {
+        system = systems[i];
+        if (system->produced.resource == NULL || system->produced.resource->id >= controller->size ||
+            system->status == TERMINATE || system->status == DISABLED) {
+            continue;
+        }
+
+        state = &controller->states[system->produced.resource->id];
+        if (state->controlled) {
+            manager_set_system_rate(manager, system, state->output);
+        }
+    }
+}
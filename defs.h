@@ -2,6 +2,8 @@
 // Austin Pham 101333594
 
 #include <semaphore.h>
+#include <pthread.h>
+#include <sys/types.h>
 
 // Don't worry about these! These are special codes that allow us to do some formatting in the terminal
 // Such as clearing the line before printing or moving the location of the "cursor" that will print.
@@ -26,21 +28,203 @@
 #define STATUS_PRODUCED     10
 
 #define THRESHOLD_RESOURCE_LOW 0.3  // Percentage of resource before it is considered low.
+#define RESOURCE_MAX_POOLS 16       // Most local pools a hot resource is split into
+#define FLOW_TIME_CONSTANT_MS 100.0 // Time constant of each resource's exponentially weighted net flow rate
+#define FLOW_WARNING_HORIZON 2.0    // Warn when a resource is projected to run out within this many producer reaction times
+#define FLOW_REACTION_SMOOTHING 0.2 // Weight of each producer's processing time in a resource's reaction time
 #define MANAGER_WAIT_TIME 5         // Milliseconds for the manager to wait between popping the queue
 #define SYSTEM_WAIT_TIME 20         // Milliseconds between loops of the system when production cannot occur
 
+#define CONTROL_STATUS 0            // Manager flips producers between SLOW and FAST in reaction to events
+#define CONTROL_PID    1            // Manager continuously adjusts producer rate multipliers from resource levels
+
+#define PID_KP 2.0                  // Proportional gain, multiplier change per unit of level error
+#define PID_KI 0.5                  // Integral gain, per second of accumulated level error
+#define PID_KD 0.05                 // Derivative gain, seconds of level error trend
+#define PID_DERIVATIVE_SMOOTHING 0.2 // Weight of each new derivative sample in its moving average
+#define RATE_MULTIPLIER_MIN 0.25    // Slowest a controlled producer may run, as a multiple of its standard rate
+#define RATE_MULTIPLIER_MAX 4.0     // Fastest a controlled producer may run, as a multiple of its standard rate
+
+#define WHEEL_LEVELS 4              // Levels in the timing wheel, each one 64 times coarser than the last
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_TICK_MS 1             // Milliseconds per tick of the finest wheel level
+
+#define SYSTEM_PHASE_IDLE       0   // Waiting to consume (or store), or backing off after a failure
+#define SYSTEM_PHASE_PROCESSING 1   // Inputs consumed, processing until the timer expires
+#define SYSTEM_SHAPE_GENERAL 0      // Reserves its output along with its input, or uses no resource, run by `system_run`
+#define SYSTEM_SHAPE_SOURCE 1       // Only produces
+#define SYSTEM_SHAPE_SINK 2         // Only consumes
+#define SYSTEM_SHAPE_CONVERTER 3    // Consumes one resource and produces another, storing after each conversion
+
+#define TICK_ENGINE_DT_MS 1.0       // Virtual milliseconds advanced per tick of the lockstep engine
+
+#define TELEMETRY_DEFAULT_NAME "/p2_telemetry"   // POSIX shared memory name the telemetry is published under
+#define TELEMETRY_NAME_LENGTH 32    // Longest resource or system name kept in the telemetry, including the terminator
+#define TELEMETRY_MAX_RESOURCES 4096
+#define TELEMETRY_MAX_SYSTEMS 131072
+#define TELEMETRY_MAGIC 0x50325431  // Marks an initialized telemetry segment ("P2T1")
+
+#define CLUSTER_RING_SIZE 4096      // Messages per shared memory ring between a partition and the coordinator, a power of two
+#define CLUSTER_POLL_TIME 1         // Milliseconds between polls of the shared memory rings
+
+#define CONTROL_LINE_LENGTH 256     // Longest command accepted on the control socket
+#define CONTROL_POLL_TIME 100       // Milliseconds between checks for the control server being stopped
+
+#define HISTORY_DEFAULT_RESOLUTION 100  // Milliseconds between history samples
+#define HISTORY_DEFAULT_CHUNKS 64       // Chunks kept per series, which fixes each series' memory
+#define HISTORY_CHUNK_BYTES 240         // Encoded bytes per chunk
+#define HISTORY_KIND_RESOURCE 0         // Series of a resource's amount
+#define HISTORY_KIND_SYSTEM 1           // Series of a system's status
+
+#define SCENARIO_DEFAULT_SEED 1         // Seed of the generated scenario when none is given
+#define SCENARIO_DEFAULT_FAN_IN 2       // Systems producing each generated resource
+#define SCENARIO_DEFAULT_FAN_OUT 2      // Systems consuming each generated resource
+#define SCENARIO_DEFAULT_DEPTH 4        // Layers of resources between the sources and the sinks
+#define SCENARIO_DEFAULT_HOT 4          // Shared hot resources feeding the first layer
+#define SCENARIO_DEFAULT_HOT_SHARE 50   // Percentage of first layer producers that draw on a hot resource
+#define SCENARIO_DEFAULT_PT_MEAN 20     // Mean processing time of generated systems, in milliseconds
+#define SCENARIO_PT_UNIFORM 0           // Processing times uniform between half and one and a half times the mean
+#define SCENARIO_PT_EXPONENTIAL 1       // Processing times exponentially distributed around the mean
+#define SCENARIO_PT_BIMODAL 2           // Most systems fast, one in ten many times slower, with the same mean
+#define BENCH_DEFAULT_SECONDS 3         // Wall time each benchmarked scenario runs for
+#define BENCH_MAX_SIZES 16              // Most scenario sizes one benchmark runs
+
+#define LOG_RING_SIZE 4096          // Records the log ring holds before new ones are dropped, a power of two
+#define LOG_BATCH 64                // Most records formatted and written by one writev
+#define LOG_LINE_LENGTH 160         // Longest formatted log line
+#define LOG_POLL_TIME 1             // Milliseconds the log writer sleeps when the ring is empty
+#define LOG_LEVEL_NONE 0            // Log nothing
+#define LOG_LEVEL_NOTICE 1          // Log why the simulation terminated
+#define LOG_LEVEL_EVENTS 2          // Also log every event the manager handles, the default
+#define LOG_KIND_EVENT 0            // An event handled by the manager
+#define LOG_KIND_NO_OXYGEN 1        // Oxygen ran out, terminating every system
+#define LOG_KIND_DESTINATION 2      // The destination was reached, terminating every system
+
+#define FORECAST_HORIZON_MS 60000   // Virtual milliseconds a forecast runs ahead before giving up on an outcome
+#define FORECAST_DESTINATION "Distance"   // Resource whose filling ends the mission at its destination
+#define FORECAST_OXYGEN "Oxygen"          // Resource whose running out ends the mission early
+
+#define HOST_DEFAULT_SECONDS 30     // Wall time after which the host stops any mission still running
+#define MISSION_LOADED 0            // Loaded and waiting to be started
+#define MISSION_RUNNING 1           // Taking turns on the host's workers
+#define MISSION_ENDED 2             // Ended by itself or stopped, never run again
+#define MISSION_OUTCOME_NONE 0          // Not ended yet
+#define MISSION_OUTCOME_DESTINATION 1   // FORECAST_DESTINATION filled
+#define MISSION_OUTCOME_NO_OXYGEN 2     // FORECAST_OXYGEN ran out
+#define MISSION_OUTCOME_STOPPED 3       // Stopped by the host before it ended
+
+#define AFFINITY_NODE_PATH "/sys/devices/system/node"   // Where the kernel lists NUMA nodes and their CPUs
+#define AFFINITY_CACHE_LINE 64          // Relocated resources are aligned so no two share a cache line
+
+#define EVENT_DRAIN_MAX 1024        // Most events the manager takes off the queue in one batch
+
 #define PRIORITY_HIGH 3
 #define PRIORITY_MED 2
 #define PRIORITY_LOW 1
 
+// Telemetry slot for a single resource, published behind a seqlock
+typedef struct TelemetryResource {
+    unsigned int sequence;       // Odd while the slot is being written
+    int amount;
+    int max_capacity;
+    int removed;                 // Non-zero once the resource has been removed from the simulation
+    char name[TELEMETRY_NAME_LENGTH];
+} TelemetryResource;
+
+// Telemetry slot for a single system, published behind a seqlock
+typedef struct TelemetrySystem {
+    unsigned int sequence;       // Odd while the slot is being written
+    int status;
+    double rate_multiplier;
+    int removed;                 // Non-zero once the system has been removed from the simulation
+    char name[TELEMETRY_NAME_LENGTH];
+} TelemetrySystem;
+
+// Layout of the shared memory segment read by the display and external monitors
+typedef struct TelemetrySegment {
+    unsigned int magic;          // TELEMETRY_MAGIC once the header is initialized
+    int resource_count;          // Slots in use, only ever grows
+    int system_count;            // Slots in use, only ever grows
+    int simulation_running;
+    int control_mode;
+    TelemetryResource resources[TELEMETRY_MAX_RESOURCES];
+    TelemetrySystem systems[TELEMETRY_MAX_SYSTEMS];
+} TelemetrySegment;
+
+// A mapping of the telemetry segment, either as the publishing simulation or as a reader
+typedef struct Telemetry {
+    TelemetrySegment *segment;   // NULL if telemetry is not available
+    char name[64];               // Shared memory name, empty if the segment is anonymous
+    int owner;                   // non-zero if this process created (and will unlink) the segment
+} Telemetry;
+
+// One local share of a pooled resource, on a cache line of its own
+typedef struct ResourcePool {
+    int amount __attribute__((aligned(64)));
+    int limit;                       // Share of the resource's capacity this pool may hold
+    unsigned long long operations;   // Takes and stores served by this pool alone
+    int flow_pending;                // Change not yet recorded in the resource's flow rate
+    sem_t mutex;
+} ResourcePool;
+
+// Contention counters for one lock, or for the waits of one system across every lock
+typedef struct LockStats {
+    unsigned long long acquisitions;
+    unsigned long long contended;    // Acquisitions that found the lock already held
+    unsigned long long wait_ns;      // Total time spent waiting to acquire
+    unsigned long long max_wait_ns;
+    unsigned long long hold_ns;      // Total time the lock was held (only kept for locks)
+    unsigned long long max_hold_ns;
+    long long acquired_ns;           // When the current holder acquired the lock
+} LockStats;
+
+// Entry of the lock profiler's report, pointing at the counters being ranked
+typedef struct LockprofRow {
+    const char *name;
+    const LockStats *stats;
+} LockprofRow;
+
 // Represents the resource amounts for the entire rocket
 typedef struct Resource {
+    int id;          // Unique id assigned when first added to a ResourceArray, never reused
     char *name;      // Dynamically allocated string
     int amount;
     int max_capacity;
+    int reserved;    // Space promised to conversions in progress, amount + reserved never exceeds max_capacity
     sem_t mutex;
+    TelemetryResource *telemetry;  // Slot the amount is published to, NULL if not published
+    int history_index;             // Series the amount is recorded in, -1 until first sampled
+    int profiled;                  // non-zero if acquisitions of `mutex` are recorded in `lock_stats`
+    LockStats lock_stats;
+    int node;                      // NUMA node the resource was allocated on by `affinity_apply`, -1 if not placed
+    int pending_status;            // Status the manager gives its producers once the current batch is handled, -1 if none
+    int shard;                     // Manager shard deciding the statuses of its producers, 0 when unsharded
+    ResourcePool *pools;           // Local pools holding the amount when the resource is pooled, otherwise NULL
+    int pool_count;
+    unsigned long long rebalances; // Times a pool ran dry or filled and the pools were evened out, under `mutex`
+    double flow_rate;              // Exponentially weighted net flow in units per second, negative while draining
+    long long flow_time_ns;        // When `flow_rate` was last updated, 0 if never
+    double reaction_ms;            // Smoothed processing time of the producers storing into it, 0 until one has
+    int low_warned;                // non-zero once a STATUS_LOW warning is raised, until the flow recovers
 } Resource;
 
+// An intrusive timer linked into a `TimerWheel` slot
+typedef struct TimerNode {
+    struct TimerNode *next;
+    struct TimerNode *prev;
+    unsigned long long expires;     // Wheel tick at which the timer fires
+    int pending;                    // non-zero while linked into the wheel
+    void *owner;                    // The object the timer belongs to (e.g. a System)
+} TimerNode;
+
+// Hierarchical timing wheel: O(1) insert and cancel, amortized O(1) expiry
+typedef struct TimerWheel {
+    TimerNode slots[WHEEL_LEVELS][WHEEL_SLOTS];  // Sentinel heads of circular lists
+    unsigned long long current;                  // Tick the wheel has been advanced to
+    int count;                                   // Number of pending timers
+} TimerWheel;
+
 // Represents the amount of a resource consumed/produced for a single system
 typedef struct ResourceAmount {
     Resource *resource;
@@ -49,13 +233,29 @@ typedef struct ResourceAmount {
 
 // A system which consumes resources, waits for `processing_time` milliseconds, then produced the produced resource
 typedef struct System {
+    int id;         // Unique id assigned when first added to a SystemArray, never reused
     char *name;     // Dynamically allocated string
     ResourceAmount consumed;
     ResourceAmount produced;
     int amount_stored;
+    int reserve_output;              // non-zero to reserve output space before each conversion starts
+    int reserved;                    // Output space reserved by the conversion in progress, 0 if none
+    LockStats lock_waits;            // Time this system spent waiting on profiled locks
     int processing_time;
     int status; 
+    double rate_multiplier;          // Scales how fast the system processes, 1.0 is its standard rate
     struct EventQueue *event_queue;  // Pointer to event queue shared by all systems and manager
+    TimerNode timer;                 // Wakeup timer when driven by a `Scheduler` instead of its own thread
+    int phase;                       // SYSTEM_PHASE_IDLE or SYSTEM_PHASE_PROCESSING when driven by a `Scheduler`
+    double phase_duration;           // Milliseconds the current processing phase was scheduled for
+    TelemetrySystem *telemetry;      // Slot the status is published to, NULL if not published
+    int history_index;               // Series the status is recorded in, -1 until first sampled
+    pthread_t thread;                // Thread running the system, valid if `threaded` is non-zero
+    int threaded;
+    unsigned long long conversions;  // Conversions completed, only written by the thread running the system
+    int cpu;                         // CPU its thread is pinned to, -1 to let it float
+    int shape;                       // SYSTEM_SHAPE_ of its resources and reservation setting
+    void (*run)(struct System *system);  // Loop body for its shape, run repeatedly by `system_thread`
 } System;
 
 // Used to send notifications to the manager about an issue / state of the system
@@ -65,6 +265,7 @@ typedef struct Event {
     int status;     
     int priority;   // Higher values indicate higher priority
     int amount;     // Amount of the resource in question
+    long long created_ns;  // `clock_now_ns` when the event was raised, to measure how long it waited
 } Event;
 
 // Linked List Node for the Event queue
@@ -78,44 +279,461 @@ typedef struct EventQueue {
     EventNode *head;
     int size;
     sem_t mutex;
+    int profiled;   // non-zero if acquisitions of `mutex` are recorded in `lock_stats`
+    LockStats lock_stats;
 } EventQueue;
 
+// Allocations that may still be read by another thread, freed once nothing can read them
+typedef struct RetiredList {
+    void **items;
+    int size;
+    int capacity;
+} RetiredList;
+
+// Size and backing array of a `SystemArray` as one reader may iterate them, published together
+typedef struct SystemArrayView {
+    System **systems;
+    int size;
+} SystemArrayView;
+
 // A basic dynamic array to store all of the systems in the simulation
+// Readers may iterate while a single writer adds or removes systems, see `system_array_snapshot`
 typedef struct SystemArray {
     System **systems;
     int size;
     int capacity;
+    int next_id;          // Id given to the next system added, one more than the highest id so far
+    SystemArrayView *view;  // Latest published view, read by `system_array_snapshot`
+    RetiredList retired;  // Replaced backing arrays and views, kept until the array is cleaned
 } SystemArray;
 
+// Size and backing array of a `ResourceArray` as one reader may iterate them, published together
+typedef struct ResourceArrayView {
+    Resource **resources;
+    int size;
+} ResourceArrayView;
+
 // A basic resource array to store all resources in the simulation
+// Readers may iterate while a single writer adds or removes resources, see `resource_array_snapshot`
 typedef struct ResourceArray {
     Resource **resources;
     int size;
     int capacity;
+    int next_id;          // Id given to the next resource added, one more than the highest id so far
+    ResourceArrayView *view;  // Latest published view, read by `resource_array_snapshot`
+    RetiredList retired;  // Replaced backing arrays and views, kept until the array is cleaned
 } ResourceArray;
 
+// PID state for a single controlled resource
+typedef struct PidState {
+    int controlled;          // non-zero if the resource has both producers and consumers
+    double bias;             // Multiplier the producers start from
+    double integral;         // Accumulated level error, in seconds
+    double previous_error;
+    double derivative;       // Smoothed rate of change of the error, per second
+    double output;           // Multiplier most recently applied to the producers
+} PidState;
+
+// Continuous rate controller, one `PidState` per resource id
+typedef struct Controller {
+    PidState *states;
+    int size;
+    long long last_update_ns;
+} Controller;
+
+// Drives every system's `system_step` continuations from a single thread using a timing wheel
+typedef struct Scheduler {
+    TimerWheel wheel;
+    sem_t mutex;             // Guards the wheel, shared by the scheduler thread and the manager
+    long long start_ns;      // Clock reading at tick 0
+    int active;              // Number of systems that have not terminated
+    struct Manager *manager;
+    pthread_t thread;
+} Scheduler;
+
+// Fixed-timestep engine advancing every system in lockstep, with state kept as structure-of-arrays
+typedef struct TickEngine {
+    int system_count;
+    int resource_count;
+
+    // System state, one entry per system
+    float *remaining;          // Virtual milliseconds until the system acts again, 0 when it acts this tick
+    float *duration;           // Processing time of one conversion at the system's status and multiplier
+    int *processing_time;      // Standard processing time in milliseconds
+    int *status;
+    double *rate_multiplier;
+    int *phase;                // SYSTEM_PHASE_IDLE (backing off) or SYSTEM_PHASE_PROCESSING
+    int *amount_stored;
+    int *consumed_index;       // Index into the resource arrays, -1 if nothing is consumed
+    int *consumed_amount;
+    int *produced_index;       // Index into the resource arrays, -1 if nothing is produced
+    int *produced_amount;
+    int *last_result;          // Status of the system's most recent consume or store, STATUS_OK if it succeeded
+    long long *conversions;    // Completed conversions
+
+    // Resource state, one entry per resource
+    int *amount;
+    int *max_capacity;
+    double *first_empty_time;  // Virtual milliseconds at which the resource was first empty (0 if it started empty), -1 if never
+    double *first_full_time;   // Virtual milliseconds at which the resource first filled, -1 if never
+
+    int *ready;                // Scratch list of systems acting this tick
+    int ready_count;           // Systems in `ready` after the last tick
+    long long tick;
+    int use_avx2;              // non-zero if the AVX2 kernels are used
+} TickEngine;
+
+// A message travelling between a partition process and the coordinator
+typedef struct ClusterMessage {
+    Event event;               // Event reported by a partition's system (partition to coordinator)
+    System *system;            // System whose status or rate changed (coordinator to partition)
+    int status;
+    double rate_multiplier;
+} ClusterMessage;
+
+// Single-producer single-consumer ring in shared memory
+typedef struct ClusterRing {
+    unsigned int head __attribute__((aligned(64)));  // Next message to read, only advanced by the consumer
+    unsigned int tail __attribute__((aligned(64)));  // Next message to write, only advanced by the producer
+    unsigned int dropped;                            // Messages lost because the ring was full
+    ClusterMessage messages[CLUSTER_RING_SIZE];
+} ClusterRing;
+
+// Shared memory seen by the coordinator and every partition process
+typedef struct ClusterControl {
+    int terminate;             // Set by the coordinator once the simulation is over
+    ClusterRing rings[];       // Two per partition: events (even index) and commands (odd index)
+} ClusterControl;
+
+// A simulation split across several processes, each owning a partition of the systems and resources
+typedef struct Cluster {
+    int partition_count;
+    int *system_partition;     // Partition owning each system, by system id
+    int *resource_partition;   // Partition owning each resource, by resource id, -1 if shared by several
+    int shared_count;          // Resources used by more than one partition
+    Resource **original;       // Heap resource replaced by a shared copy, by resource id, NULL if not shared
+    Resource *shared;          // Shared memory copies of the resources used by several partitions
+    ClusterControl *control;
+    size_t control_size;
+    pid_t *children;
+    int cross_links;           // System to resource links that cross a partition boundary
+    int total_links;
+    struct Manager *manager;
+    pthread_t collector;
+    int collector_started;     // Whether `collector` was created and must be joined
+} Cluster;
+
+// A fixed-size log entry, formatted into text by the log writer thread
+typedef struct LogRecord {
+    unsigned long long sequence;  // Ring position the slot is ready for, see `log_write`
+    int kind;                     // LOG_KIND_EVENT, LOG_KIND_NO_OXYGEN or LOG_KIND_DESTINATION
+    int status;
+    int amount;
+    System *system;
+    Resource *resource;
+} LogRecord;
+
+// Bounded lock-free ring of log records, drained by a writer thread so logging never waits on I/O
+typedef struct Log {
+    unsigned long long head __attribute__((aligned(64)));  // Next record to write out, only advanced by the writer
+    unsigned long long tail __attribute__((aligned(64)));  // Next free slot, claimed by writers with a compare-and-swap
+    unsigned long long dropped;       // Records lost because the ring was full
+    unsigned long long reported;      // Drops already reported in the output
+    int level;                        // Highest LOG_LEVEL_ recorded
+    int fd;                           // Where the records are written
+    int running;                      // non-zero while the writer thread runs
+    LogRecord *records;
+    pthread_t thread;
+} Log;
+
+// One of several event handlers, owning a range of resources and the systems producing them
+typedef struct ManagerShard {
+    int index;
+    struct Manager *manager;
+    EventQueue *queue;        // Events from the shard's systems, the manager's own queue for shard 0
+    EventQueue own_queue;     // Backs `queue` for every shard but shard 0
+    EventQueue inbox;         // Events forwarded by other shards about this shard's resources
+    SystemArray systems;      // Systems whose statuses this shard decides, owned by the manager's array
+    unsigned long long events_handled;
+    unsigned long long events_forwarded;  // Events passed on to the shard owning their resource
+    long long event_lag_ns;
+    long long event_lag_max_ns;
+    pthread_t thread;
+    int threaded;             // non-zero if `thread` runs the shard
+} ManagerShard;
+
 // Container structure which contains all of the core data for our simulation
 typedef struct Manager {
     int simulation_running; // non-zero if the simulation is running, zero if it should be stopped
+    int control_mode;       // CONTROL_STATUS or CONTROL_PID
+    int reserve_output;     // non-zero if systems reserve output space before converting
+    int lockprof;           // non-zero if resource and event queue locks are profiled
+    int quiet;              // non-zero to not display the state
+    unsigned long long events_handled;  // Events popped by the manager
+    long long event_lag_ns;             // Total time events waited in the queue before being handled
+    long long event_lag_max_ns;         // Longest time an event waited in the queue
+    unsigned long long events_forwarded;  // Events passed between shards, added up when the shards are joined
+    ManagerShard *shards;   // Non-NULL when event handling is split across shards, see `manager_shard`
+    int shard_count;        // Number of shards, 0 when unsharded
+    Controller controller;
+    Scheduler *scheduler;   // Non-NULL when systems are driven by a scheduler rather than their own threads
+    Telemetry telemetry;
+    Cluster *cluster;       // Non-NULL when systems run in separate partition processes
     SystemArray system_array;
     ResourceArray resource_array;
+    SystemArray removed_systems;      // Systems removed while running, freed once every thread is done with them
+    ResourceArray removed_resources;  // Resources removed while running, freed once every thread is done with them
     EventQueue event_queue;
+    Log log;                // Event and termination messages, written out by a separate thread once started
+    struct Forecast *forecast;  // Non-NULL when forecasts of the mission's outcome are shown with the state
 } Manager;
 
+// Local socket accepting commands that add and remove systems and resources while running
+typedef struct Control {
+    int fd;
+    char path[108];         // Filesystem path of the socket, unlinked when the server stops
+    int running;            // Cleared to stop the server thread
+    Manager *manager;
+    pthread_t thread;
+} Control;
+
+// A run of consecutive samples of one series, encoded as varint deltas
+// Each token is a varint: (zigzag(delta) << 1) for a new value, or (count << 1 | 1) for a run of repeats
+typedef struct HistoryChunk {
+    long long first_sample;   // Sample number (since the history started) of the first value
+    int first_value;          // Stored as is, every later value is a delta from the one before
+    int last_value;
+    int count;                // Samples in the chunk, including the first
+    int min;
+    int max;
+    long long sum;
+    int used;                 // Bytes of `data` in use
+    int last_token;           // Offset of the last token, -1 if there is none yet
+    int last_run;             // Length of the run the last token encodes, 0 if it is a value
+    unsigned char data[HISTORY_CHUNK_BYTES];
+} HistoryChunk;
+
+// Fixed-size ring of chunks holding the history of one resource or system
+typedef struct HistorySeries {
+    char name[TELEMETRY_NAME_LENGTH];
+    int kind;                 // HISTORY_KIND_RESOURCE or HISTORY_KIND_SYSTEM
+    HistoryChunk *chunks;
+    int head;                 // Chunk being appended to
+    int used_chunks;          // Chunks holding samples, the oldest are overwritten once all are used
+} HistorySeries;
+
+// Position while decoding a series, one sample at a time
+typedef struct HistoryCursor {
+    const HistorySeries *series;
+    const HistoryChunk *chunk;  // Chunk being decoded, NULL once past the newest
+    int age;                    // Position of `chunk` from the oldest chunk of the series
+    long long sample;           // Sample number of the next value
+    int offset;                 // Next byte of `chunk->data` to decode
+    int value;
+    int run_left;               // Repeats of `value` still to return
+    int emitted;                // Values returned so far from `chunk`
+} HistoryCursor;
+
+// Summary of a series over a window
+typedef struct HistoryStats {
+    long long count;
+    int min;
+    int max;
+    double average;
+} HistoryStats;
+
+// Samples every resource's amount and every system's status at a fixed resolution
+typedef struct History {
+    HistorySeries *series;
+    int size;
+    int capacity;
+    int resolution_ms;
+    int chunks_per_series;
+    long long samples;        // Sampling rounds taken so far
+    long long start_ns;
+    int running;              // Cleared to stop the sampling thread
+    sem_t mutex;              // Held while sampling and while querying
+    Manager *manager;
+    pthread_t thread;
+} History;
+
+// CPUs of one NUMA node
+typedef struct AffinityNode {
+    int id;                 // Node number in AFFINITY_NODE_PATH, or its index when simulated
+    int *cpus;
+    int cpu_count;
+} AffinityNode;
+
+// Order in which systems are cut into nodes and cores, systems sharing resources next to each other
+typedef struct AffinityRow {
+    int system;             // Index in the system array
+    int component;          // Group of systems connected through shared resources
+    int resource;           // Index of the lowest numbered resource it uses, -1 if none
+} AffinityRow;
+
+// Placement of systems on cores and resources on NUMA nodes, grouping systems that share resources
+typedef struct Affinity {
+    AffinityNode *nodes;
+    int node_count;
+    int simulated;          // non-zero if the nodes were made up by splitting the CPUs rather than read
+    int home_node;          // Node of the thread that loaded the scenario, where resources start out
+    int busiest_node;       // Node given the most systems, where a single scheduler thread is pinned
+    int system_count;
+    int resource_count;
+    int *system_nodes;      // Node of each system, by index in the system array
+    int *system_cpus;       // CPU of each system, by index in the system array
+    int *resource_nodes;    // Node of each resource, by index in the resource array
+    int links;              // Pairs of a system and a resource it consumes or produces
+    double links_rate;      // Accesses per second over every link, at standard rates
+    double cross_before;    // Links expected to cross nodes with floating threads and resources on the home node
+    double rate_before;     // Accesses per second expected to cross nodes before placement
+    int cross_after;        // Links crossing nodes after placement
+    double rate_after;      // Accesses per second crossing nodes after placement
+} Affinity;
+
+// Work handed to the thread that reallocates one node's resources
+typedef struct AffinityRelocation {
+    Affinity *affinity;
+    Manager *manager;
+    Resource **relocated;   // Set to each new copy, by index in the resource array
+    int node;
+} AffinityRelocation;
+
+// Parameters of a generated scenario, a layered DAG of resources
+// Sources feed the first layer, each layer feeds the next and sinks drain the last
+typedef struct ScenarioConfig {
+    unsigned long long seed;
+    int systems;            // Systems to generate, the resource count follows from the fan-in and fan-out
+    int fan_in;             // Systems producing each layered resource
+    int fan_out;            // Systems consuming each layered resource, on average
+    int depth;              // Layers of resources
+    int hot;                // Shared hot resources, each consumed by many first layer producers
+    int hot_share;          // Percentage of first layer producers drawing on a hot resource
+    int pt_mean;            // Mean processing time in milliseconds
+    int pt_distribution;    // SCENARIO_PT_UNIFORM, SCENARIO_PT_EXPONENTIAL or SCENARIO_PT_BIMODAL
+} ScenarioConfig;
+
+// Outcome of one forecast, times are virtual milliseconds after the live state was captured
+typedef struct ForecastResult {
+    long long runs;           // Forecasts completed so far, 0 if there is no result yet
+    long long taken_ns;       // `clock_now_ns` when the live state was captured
+    long long capture_ns;     // Time spent reading the live state
+    long long simulate_ns;    // Time spent running the forecast
+    double simulated_ms;      // Virtual milliseconds simulated
+    double destination_ms;    // When FORECAST_DESTINATION fills, -1 if it does not within the horizon
+    double oxygen_ms;         // When FORECAST_OXYGEN runs out, -1 if it does not within the horizon
+} ForecastResult;
+
+// Periodically runs the rest of the mission ahead in a `TickEngine`, from a capture of the live state
+typedef struct Forecast {
+    int interval_ms;          // Milliseconds between the starts of two forecasts
+    int horizon_ms;           // Virtual milliseconds each forecast runs ahead at most
+    int running;              // Cleared to stop the forecast thread
+    long long start_ns;
+    long long stop_ns;
+    long long capture_total_ns;
+    long long capture_max_ns;
+    long long simulate_total_ns;
+    ForecastResult first;     // Result of the first forecast, kept to compare with how the mission ended
+    ForecastResult result;    // Latest result, read and written under `mutex`
+    TickEngine engine;        // Reused from one forecast to the next
+    sem_t mutex;
+    Manager *manager;
+    pthread_t thread;
+} Forecast;
+
+// One simulation hosted alongside others, run in turns by the host's workers rather than threads of its own
+typedef struct Mission {
+    int id;
+    int state;                  // MISSION_LOADED, MISSION_RUNNING or MISSION_ENDED
+    int claimed;                // Set while a worker is taking a turn, so only one runs the mission at a time
+    int outcome;                // MISSION_OUTCOME_ of how it ended
+    Manager manager;            // The mission's own systems, resources and event queue
+    Scheduler scheduler;        // Wakes the mission's systems, polled by whichever worker takes the turn
+    long long started_ns;
+    long long ended_ns;
+    unsigned long long turns;   // Turns workers have taken on the mission
+    unsigned long long steps;   // System steps run in those turns
+    long long busy_ns;          // Worker time spent on the mission
+} Mission;
+
+// Runs many independent missions in one process on a shared pool of worker threads
+typedef struct Host {
+    Mission **missions;         // Allocated one by one, so nothing a mission points into ever moves
+    int mission_count;
+    int live;                   // Missions started and not yet ended
+    int running;                // Cleared to stop the workers
+    unsigned int next;          // Position of the next turn, shared by the workers to go round the missions in order
+    int worker_count;
+    pthread_t *workers;
+} Host;
+
+// Steady-state flow of a single resource, derived from the systems that consume and produce it
+typedef struct ResourceFlow {
+    Resource *resource;
+    double production_rate;  // Units per millisecond at the chosen statuses
+    double consumption_rate; // Units per millisecond at the chosen statuses
+    double net_rate;         // production_rate - consumption_rate
+    double time_to_empty;    // Milliseconds until empty at net_rate, negative if it never empties
+    double time_to_full;     // Milliseconds until full at net_rate, negative if it never fills
+    int producer_count;
+    int consumer_count;
+    int bottleneck;          // non-zero if the resource is expected to starve its consumers
+} ResourceFlow;
+
+// Load-time analysis of the resource flow graph, one entry per resource id
+typedef struct FlowAnalysis {
+    ResourceFlow *flows;
+    int size;
+    double mission_horizon;  // Milliseconds until the first sink resource fills, negative if none do
+} FlowAnalysis;
+
 // Manager functions
 void manager_init(Manager *manager);
 void manager_clean(Manager *manager);
 void manager_run(Manager *manager);
+void manager_set_system_status(Manager *manager, System *system, int status);
+void manager_set_system_rate(Manager *manager, System *system, double rate_multiplier);
+int manager_add_resource(Manager *manager, Resource *resource);
+int manager_add_system(Manager *manager, System *system);
+int manager_remove_resource(Manager *manager, Resource *resource);
+int manager_remove_system(Manager *manager, System *system);
+void manager_spawn_system(Manager *manager, System *system);
+void manager_join_systems(Manager *manager);
+int manager_shard(Manager *manager, int shard_count);
+void manager_start_shards(Manager *manager);
+void manager_join_shards(Manager *manager);
+int manager_pool_resources(Manager *manager, int min_users);
+void manager_print_pools(Manager *manager);
 
 // System functions
 void system_create(System **system, const char *name, ResourceAmount consumed, ResourceAmount produced, int processing_time, EventQueue *event_queue);
 void system_destroy(System *system);
 void system_run(System *system);
+void system_set_reserve_output(System *system, int reserve_output);
+int system_step(System *system);
+double system_adjusted_processing_time(const System *system);
+double system_scaled_processing_time(int processing_time, int status, double rate_multiplier);
+const char *system_status_name(int status);
+void system_publish(System *system);
+void system_release(System *system);
 
 // Resource functions
 void resource_create(Resource **resource, const char *name, int amount, int max_capacity);
 void resource_destroy(Resource *resource);
 
+void resource_publish(Resource *resource);
+void resource_lock(Resource *resource);
+int resource_trylock(Resource *resource);
+void resource_unlock(Resource *resource);
+int resource_read_amount(const Resource *resource);
+int resource_record_flow(Resource *resource, int delta, double processing_ms);
+int resource_pool(Resource *resource, int pool_count);
+int resource_pool_take(Resource *resource, int pool, int amount, int *flow_status);
+int resource_pool_put(Resource *resource, int pool, int amount, double processing_ms);
+int resource_pool_total(Resource *resource, int exact);
+void resource_pool_sync(Resource *resource);
+
 // ResourceAmount functions
 void resource_amount_init(ResourceAmount *resource_amount, Resource *resource, int amount);
 
@@ -127,16 +745,148 @@ void event_queue_init(EventQueue *queue);
 void event_queue_clean(EventQueue *queue);
 void event_queue_push(EventQueue *queue, const Event *event); 
 int event_queue_pop(EventQueue *queue, Event* event);
+int event_queue_drain(EventQueue *queue, EventNode **batch, int max_events);
+void event_batch_free(EventNode *batch);
 
 // Dynamic array functions for systems and resources
 void system_array_init(SystemArray *array);
 void system_array_clean(SystemArray *array);
 void system_array_add(SystemArray *array, System *system);
+int system_array_remove(SystemArray *array, System *system);
+int system_array_snapshot(const SystemArray *array, System ***systems);
 
 void resource_array_init(ResourceArray *array);
 void resource_array_clean(ResourceArray *array);
 void resource_array_add(ResourceArray *array, Resource *resource);
+int resource_array_remove(ResourceArray *array, Resource *resource);
+int resource_array_snapshot(const ResourceArray *array, Resource ***resources);
+
+void retired_list_init(RetiredList *list);
+void retired_list_clean(RetiredList *list);
+void retired_list_add(RetiredList *list, void *item);
+
+// Flow analysis functions
+void flow_analysis_init(FlowAnalysis *analysis, Manager *manager);
+void flow_analysis_clean(FlowAnalysis *analysis);
+void flow_analysis_apply(FlowAnalysis *analysis, Manager *manager);
+void flow_analysis_print(const FlowAnalysis *analysis, const Manager *manager);
+
+// Controller functions
+void controller_init(Controller *controller, Manager *manager);
+void controller_clean(Controller *controller);
+void controller_update(Controller *controller, Manager *manager);
+int controller_controls(const Controller *controller, const Resource *resource);
+
+// TimerWheel functions
+void timer_wheel_init(TimerWheel *wheel, unsigned long long start);
+void timer_wheel_insert(TimerWheel *wheel, TimerNode *node, unsigned long long expires);
+void timer_wheel_cancel(TimerWheel *wheel, TimerNode *node);
+TimerNode *timer_wheel_advance(TimerWheel *wheel, unsigned long long now);
+
+// Scheduler functions
+void scheduler_init(Scheduler *scheduler, Manager *manager);
+void scheduler_clean(Scheduler *scheduler);
+void scheduler_add(Scheduler *scheduler, System *system);
+void scheduler_reschedule(Scheduler *scheduler, System *system);
+void *scheduler_thread(void *arg);
+int scheduler_poll(Scheduler *scheduler);
+
+// TickEngine functions
+int tick_engine_init(TickEngine *engine, Manager *manager, int replicas);
+int tick_engine_capture(TickEngine *engine, System **systems, int system_count, Resource **resources, int resource_count);
+void tick_engine_clean(TickEngine *engine);
+void tick_engine_set_status(TickEngine *engine, int index, int status);
+void tick_engine_step(TickEngine *engine);
+void tick_engine_print(const TickEngine *engine, const Manager *manager);
+
+// Telemetry functions
+int telemetry_init(Telemetry *telemetry, const char *name, Manager *manager);
+int telemetry_attach(Telemetry *telemetry, const char *name);
+void telemetry_clean(Telemetry *telemetry);
+void telemetry_add_resource(Telemetry *telemetry, Resource *resource);
+void telemetry_add_system(Telemetry *telemetry, System *system);
+void telemetry_set_running(Telemetry *telemetry, int running);
+void telemetry_remove_resource(Telemetry *telemetry, Resource *resource);
+void telemetry_remove_system(Telemetry *telemetry, System *system);
+int telemetry_read_resource(const TelemetrySegment *segment, int index, TelemetryResource *out);
+int telemetry_read_system(const TelemetrySegment *segment, int index, TelemetrySystem *out);
+void telemetry_print(const TelemetrySegment *segment);
+
+// Cluster functions
+int cluster_init(Cluster *cluster, Manager *manager, int partition_count);
+void cluster_clean(Cluster *cluster);
+void cluster_print(const Cluster *cluster);
+int cluster_start(Cluster *cluster);
+void cluster_stop(Cluster *cluster);
+void cluster_send_system(Cluster *cluster, System *system);
+
+// History functions
+int history_init(History *history, Manager *manager, int resolution_ms, int chunks_per_series);
+void history_clean(History *history);
+int history_start(History *history);
+void history_stop(History *history);
+int history_find(History *history, int kind, const char *name);
+int history_range(History *history, int series, long long from_ms, long long to_ms, int *values, int max_values, long long *first_ms);
+int history_window(History *history, int series, long long from_ms, long long to_ms, HistoryStats *stats);
+int history_export_csv(History *history, const char *path);
+void history_print(History *history);
+
+// Lock profiler functions
+void lockprof_enable(Manager *manager);
+void lockprof_acquire(sem_t *mutex, LockStats *stats);
+int lockprof_try_acquire(sem_t *mutex, LockStats *stats);
+void lockprof_release(sem_t *mutex, LockStats *stats);
+void lockprof_set_current(System *system);
+int lockprof_report_requested(void);
+void lockprof_print(Manager *manager);
+
+// Control functions
+int control_start(Control *control, Manager *manager, const char *path);
+void control_stop(Control *control);
+
+// Log functions
+void log_init(Log *log, int level);
+int log_start(Log *log, int fd);
+void log_stop(Log *log);
+void log_write(Log *log, int level, int kind, System *system, Resource *resource, int amount, int status);
+
+// Affinity functions
+int affinity_init(Affinity *affinity, Manager *manager, int simulated_nodes);
+int affinity_apply(Affinity *affinity, Manager *manager);
+int affinity_pin_thread(pthread_t thread, const int *cpus, int count);
+void affinity_print(Affinity *affinity);
+void affinity_clean(Affinity *affinity);
+
+// Scenario generator and benchmark functions
+void scenario_config_init(ScenarioConfig *config);
+int scenario_generate(Manager *manager, const ScenarioConfig *config);
+int bench_run(const ScenarioConfig *config, const int *sizes, int count, int seconds, int use_wheel, int shards);
+long bench_rss_kb(void);
+int bench_thread_count(void);
+
+// Host functions
+int host_init(Host *host, int mission_count, int worker_count, void (*load)(Manager *manager));
+void host_clean(Host *host);
+int host_start(Host *host);
+void host_stop(Host *host);
+int host_start_mission(Host *host, int index);
+int host_stop_mission(Host *host, int index);
+int host_live(Host *host);
+void host_print(Host *host, long long elapsed_ns);
+
+// Forecast functions
+int forecast_init(Forecast *forecast, Manager *manager, int interval_ms, int horizon_ms);
+void forecast_clean(Forecast *forecast);
+int forecast_start(Forecast *forecast);
+void forecast_stop(Forecast *forecast);
+void forecast_read(Forecast *forecast, ForecastResult *result);
+void forecast_display(Forecast *forecast);
+void forecast_print(Forecast *forecast);
+
+// Clock functions
+long long clock_now_ns(void);
 
 // Thread functions
 void *system_thread(void *arg);
 void *manager_thread(void *arg);
+void *manager_shard_thread(void *arg);
@@ -4,6 +4,12 @@
 #include "defs.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+// Helper functions just used by this C file
+
+static void event_queue_lock(EventQueue *queue);
+static void event_queue_unlock(EventQueue *queue);
 
 /* Event functions */
 
@@ -25,6 +31,7 @@ void event_init(Event *event, System *system, Resource *resource, int status, in
     event->status = status;
     event->priority = priority;
     event->amount = amount;
+    event->created_ns = clock_now_ns();
 }
 
 /* EventQueue functions */
@@ -43,6 +50,9 @@ void event_queue_init(EventQueue *queue) {
     queue->size = 0;
     // initialize the semaphore for thread safe access to the queue
     sem_init(&queue->mutex, 0, 1);
+    // not profiled unless the lock profiler is enabled
+    queue->profiled = 0;
+    memset(&queue->lock_stats, 0, sizeof(LockStats));
 }
 
 /**
@@ -92,14 +102,14 @@ void event_queue_push(EventQueue *queue, const Event *event) {
     }
 
     // wait for semaphore to ensure thread-safety
-    sem_wait(&queue->mutex);
+    event_queue_lock(queue);
     
     // initialize a new node for the event
     EventNode *new_node = (EventNode*)malloc(sizeof(EventNode));
     
     // if malloc fails, release the semaphore and return
     if (new_node == NULL) {
-        sem_post(&queue->mutex);
+        event_queue_unlock(queue);
         return;
     }
     // assign the event passed in the parameter to the new node's event
@@ -108,7 +118,8 @@ void event_queue_push(EventQueue *queue, const Event *event) {
     // Case 1: queue is empty or event belongs at the head
     if (queue->head == NULL || event->priority > queue->head->event.priority) {
         new_node->next = queue->head;
-        queue->head = new_node;
+        // the manager checks the head without the lock, see `event_queue_drain`
+        __atomic_store_n(&queue->head, new_node, __ATOMIC_RELEASE);
     }
     // Case 2: queue is not empty, need to find correct position
     else {
@@ -131,7 +142,7 @@ void event_queue_push(EventQueue *queue, const Event *event) {
     queue->size++;
 
     // release the semaphore after modifying the queue
-    sem_post(&queue->mutex);
+    event_queue_unlock(queue);
 }
 
 /**
@@ -145,11 +156,11 @@ void event_queue_push(EventQueue *queue, const Event *event) {
  */
 int event_queue_pop(EventQueue *queue, Event *event) {
     // wait for semaphore to ensure thread safety
-    sem_wait(&queue->mutex);
+    event_queue_lock(queue);
 
     // if no events in the queue, release the semaphore and return 0
     if (queue->head == NULL) {
-        sem_post(&queue->mutex);
+        event_queue_unlock(queue);
         return 0;
     }
     
@@ -165,8 +176,99 @@ int event_queue_pop(EventQueue *queue, Event *event) {
     queue->size--;
 
     // release the semaphore after modifying the queue
-    sem_post(&queue->mutex);
+    event_queue_unlock(queue);
     
     // event successfully popped
     return 1;
 }
+
+/**
+ * Detaches pending events from the `EventQueue` as a batch, in a single critical section.
+ *
+ * Takes the whole queue, or its `max_events` highest priority events, leaving the rest. The batch
+ * keeps the queue's priority order and is handled without the lock, then freed with `event_batch_free`.
+ * An empty queue is noticed without taking the lock at all.
+ *
+ * @param[in,out] queue       Pointer to the `EventQueue`.
+ * @param[out]    batch       Set to the first event of the batch, or NULL if there were none.
+ * @param[in]     max_events  Most events to take, zero or less for all of them.
+ * @return                    Number of events in the batch.
+ */
+int event_queue_drain(EventQueue *queue, EventNode **batch, int max_events) {
+    EventNode *last;
+    int count = 1;
+
+    *batch = NULL;
+
+    // Pushes store the head atomically, so an empty queue can be seen without waiting on them
+    if (__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == NULL) {
+        return 0;
+    }
+
+    event_queue_lock(queue);
+
+    if (queue->head == NULL) {
+        event_queue_unlock(queue);
+        return 0;
+    }
+
+    *batch = queue->head;
+
+    // Taking everything needs no walk, otherwise cut the list after `max_events` nodes
+    if (max_events <= 0 || queue->size <= max_events) {
+        count = queue->size;
+        queue->head = NULL;
+    }
+    else {
+        for (last = queue->head; count < max_events; count++) {
+            last = last->next;
+        }
+        queue->head = last->next;
+        last->next = NULL;
+    }
+    queue->size -= count;
+
+    event_queue_unlock(queue);
+    return count;
+}
+
+/**
+ * Frees a batch of events taken with `event_queue_drain`.
+ *
+ * @param[in,out] batch  First event of the batch, may be NULL.
+ */
+void event_batch_free(EventNode *batch) {
+    EventNode *next;
+
+    while (batch != NULL) {
+        next = batch->next;
+        free(batch);
+        batch = next;
+    }
+}
+
+/**
+ * Locks the `EventQueue`, recording the acquisition if its lock is being profiled.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue` to lock.
+ */
+static void event_queue_lock(EventQueue *queue) {
+    if (queue->profiled) {
+        lockprof_acquire(&queue->mutex, &queue->lock_stats);
+    } else {
+        sem_wait(&queue->mutex);
+    }
+}
+
+/**
+ * Unlocks the `EventQueue`.
+ *
+ * @param[in,out] queue  Pointer to the `EventQueue` to unlock.
+ */
+static void event_queue_unlock(EventQueue *queue) {
+    if (queue->profiled) {
+        lockprof_release(&queue->mutex, &queue->lock_stats);
+    } else {
+        sem_post(&queue->mutex);
+    }
+}
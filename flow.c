@@ -0,0 +1,302 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// Helper functions just used by this C file
+
+static double flow_system_rate(const System *system, int status);
+static void flow_analysis_compute(FlowAnalysis *analysis, Manager *manager);
+
+/**
+ * Initializes a `FlowAnalysis` for the manager's current systems and resources.
+ *
+ * Allocates one `ResourceFlow` per resource id and computes the steady-state rates
+ * using each system's current status.
+ *
+ * @param[out] analysis  Pointer to the `FlowAnalysis` to initialize.
+ * @param[in]  manager   Pointer to the `Manager` holding the systems and resources.
+ */
+void flow_analysis_init(FlowAnalysis *analysis, Manager *manager) {
+    analysis->size = manager->resource_array.size;
+    analysis->mission_horizon = -1;
+    analysis->flows = (ResourceFlow *)calloc(analysis->size > 0 ? analysis->size : 1, sizeof(ResourceFlow));
+
+    // return if memory allocation fails, leaving an empty analysis
+    if (analysis->flows == NULL) {
+        analysis->size = 0;
+        return;
+    }
+
+    flow_analysis_compute(analysis, manager);
+}
+
+/**
+ * Cleans up a `FlowAnalysis`.
+ *
+ * @param[in,out] analysis  Pointer to the `FlowAnalysis` to clean.
+ */
+void flow_analysis_clean(FlowAnalysis *analysis) {
+    free(analysis->flows);
+    analysis->flows = NULL;
+    analysis->size = 0;
+}
+
+/**
+ * Chooses initial statuses for every producing system and recomputes the flows.
+ *
+ * For each resource that is both produced and consumed, its producers are given the slowest
+ * status that keeps the resource from running dry before the mission horizon (the time until the
+ * first sink resource such as Distance fills). Producers of sink resources are left alone since
+ * filling them is the goal of the mission. Because slowing a producer also lowers the demand on
+ * its own input, the choice is repeated until the statuses settle.
+ *
+ * Resources that would still run dry with every producer at FAST are flagged as bottlenecks.
+ *
+ * @param[in,out] analysis  Pointer to an initialized `FlowAnalysis`.
+ * @param[in,out] manager   Pointer to the `Manager` whose systems will have their status set.
+ */
+void flow_analysis_apply(FlowAnalysis *analysis, Manager *manager) {
+    static const int candidates[] = { SLOW, STANDARD, FAST };
+    int pass, i, c, changed = 1;
+    double net, time_to_empty;
+    double *supply;
+    int *chosen;
+    System *system;
+    ResourceFlow *flow;
+
+    // return if the analysis has no flows, since its memory could not be allocated
+    if (analysis->flows == NULL) {
+        return;
+    }
+
+    // supply[c * size + id] is the production rate of resource `id` with all of its producers at candidates[c]
+    supply = (double *)malloc(sizeof(double) * 3 * (analysis->size > 0 ? analysis->size : 1));
+    chosen = (int *)malloc(sizeof(int) * (analysis->size > 0 ? analysis->size : 1));
+    if (supply == NULL || chosen == NULL) {
+        free(supply);
+        free(chosen);
+        return;
+    }
+
+    for (i = 0; i < 3 * analysis->size; i++) {
+        supply[i] = 0;
+    }
+    for (i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        if (system->produced.resource != NULL) {
+            for (c = 0; c < 3; c++) {
+                supply[c * analysis->size + system->produced.resource->id] += system->produced.amount * flow_system_rate(system, candidates[c]);
+            }
+        }
+    }
+
+    // A chain of N resources needs at most N passes to settle, cycles are cut off at the limit
+    for (pass = 0; changed && pass <= analysis->size; pass++) {
+        changed = 0;
+
+        for (i = 0; i < analysis->size; i++) {
+            flow = &analysis->flows[i];
+            chosen[i] = -1;
+            if (flow->producer_count == 0 || flow->consumer_count == 0) {
+                continue;
+            }
+
+            // Pick the slowest status that keeps the resource from running dry before the horizon
+            chosen[i] = FAST;
+            for (c = 0; c < 3; c++) {
+                net = supply[c * analysis->size + i] - flow->consumption_rate;
+                time_to_empty = (net < 0) ? flow->resource->amount / -net : -1;
+                if (net >= 0 || (analysis->mission_horizon >= 0 && time_to_empty >= analysis->mission_horizon)) {
+                    chosen[i] = candidates[c];
+                    break;
+                }
+            }
+        }
+
+        for (i = 0; i < manager->system_array.size; i++) {
+            system = manager->system_array.systems[i];
+            if (system->produced.resource == NULL || chosen[system->produced.resource->id] < 0) {
+                continue;
+            }
+
+            // Never bring back a system that has been disabled or terminated
+            if (system->status != chosen[system->produced.resource->id] &&
+                (system->status == SLOW || system->status == STANDARD || system->status == FAST)) {
+                system->status = chosen[system->produced.resource->id];
+                changed = 1;
+            }
+        }
+
+        if (changed) {
+            flow_analysis_compute(analysis, manager);
+        }
+    }
+
+    free(supply);
+    free(chosen);
+}
+
+/**
+ * Prints the flow analysis as a table, followed by the predicted bottlenecks.
+ *
+ * @param[in] analysis  Pointer to the `FlowAnalysis` to print.
+ * @param[in] manager   Pointer to the `Manager` the analysis was computed from.
+ */
+void flow_analysis_print(const FlowAnalysis *analysis, const Manager *manager) {
+    int i;
+    const ResourceFlow *flow;
+    System *system;
+
+    // return if the analysis has no flows, since its memory could not be allocated
+    if (analysis->flows == NULL) {
+        return;
+    }
+
+    printf("Flow Analysis:\n");
+    printf("-------------------------\n");
+    printf("%-12s %10s %10s %10s %12s %12s\n", "Resource", "Produce/s", "Consume/s", "Net/s", "Empty in(s)", "Full in(s)");
+
+    for (i = 0; i < analysis->size; i++) {
+        flow = &analysis->flows[i];
+        printf("%-12s %10.1f %10.1f %10.1f ", flow->resource->name,
+               flow->production_rate * 1000, flow->consumption_rate * 1000, flow->net_rate * 1000);
+
+        if (flow->time_to_empty >= 0) {
+            printf("%12.2f ", flow->time_to_empty / 1000);
+        } else {
+            printf("%12s ", "never");
+        }
+
+        if (flow->time_to_full >= 0) {
+            printf("%12.2f\n", flow->time_to_full / 1000);
+        } else {
+            printf("%12s\n", "never");
+        }
+    }
+
+    printf("\n");
+    if (analysis->mission_horizon >= 0) {
+        printf("Mission horizon: %.2fs\n", analysis->mission_horizon / 1000);
+    } else {
+        printf("Mission horizon: none (no sink resource fills)\n");
+    }
+
+    // Systems bottleneck when the resource they consume is expected to starve
+    for (i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        if (system->consumed.resource != NULL && analysis->flows[system->consumed.resource->id].bottleneck) {
+            printf("Bottleneck: [%s] starved of [%s]\n", system->name, system->consumed.resource->name);
+        }
+    }
+
+    printf("\nInitial System Statuses:\n");
+    printf("---------------\n");
+    for (i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        printf("%-20s: %-10s\n", system->name, system_status_name(system->status));
+    }
+    printf("\n");
+}
+
+/**
+ * Computes how many conversions per millisecond a system completes at a given status.
+ *
+ * Mirrors the adjustment made by `system_simulate_process_time` (status and rate multiplier), ignoring time spent waiting on
+ * resources. Systems that are terminated or disabled do not run at all.
+ *
+ * @param[in] system  Pointer to the `System`.
+ * @param[in] status  Status to evaluate the system at.
+ * @return            Conversions per millisecond.
+ */
+static double flow_system_rate(const System *system, int status) {
+    int adjusted_processing_time;
+
+    switch (status) {
+        case SLOW:
+            adjusted_processing_time = system->processing_time * 2;
+            break;
+        case FAST:
+            adjusted_processing_time = system->processing_time / 2;
+            break;
+        case STANDARD:
+            adjusted_processing_time = system->processing_time;
+            break;
+        default:
+            return 0;
+    }
+
+    // A processing time below a millisecond is still bounded by the scheduler
+    if (adjusted_processing_time < 1) {
+        adjusted_processing_time = 1;
+    }
+
+    return system->rate_multiplier / adjusted_processing_time;
+}
+
+/**
+ * Recomputes every `ResourceFlow` and the mission horizon from the systems' current statuses.
+ *
+ * @param[in,out] analysis  Pointer to the `FlowAnalysis` to update.
+ * @param[in]     manager   Pointer to the `Manager` holding the systems.
+ */
+static void flow_analysis_compute(FlowAnalysis *analysis, Manager *manager) {
+    int i;
+    double rate;
+    System *system;
+    ResourceFlow *flow;
+
+    for (i = 0; i < analysis->size; i++) {
+        flow = &analysis->flows[i];
+        flow->resource = manager->resource_array.resources[i];
+        flow->production_rate = 0;
+        flow->consumption_rate = 0;
+        flow->producer_count = 0;
+        flow->consumer_count = 0;
+    }
+
+    for (i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        rate = flow_system_rate(system, system->status);
+
+        if (system->consumed.resource != NULL) {
+            flow = &analysis->flows[system->consumed.resource->id];
+            flow->consumption_rate += system->consumed.amount * rate;
+            flow->consumer_count++;
+        }
+
+        if (system->produced.resource != NULL) {
+            flow = &analysis->flows[system->produced.resource->id];
+            flow->production_rate += system->produced.amount * rate;
+            flow->producer_count++;
+        }
+    }
+
+    analysis->mission_horizon = -1;
+    for (i = 0; i < analysis->size; i++) {
+        flow = &analysis->flows[i];
+        flow->net_rate = flow->production_rate - flow->consumption_rate;
+        flow->time_to_empty = -1;
+        flow->time_to_full = -1;
+
+        if (flow->net_rate < 0) {
+            flow->time_to_empty = flow->resource->amount / -flow->net_rate;
+        } else if (flow->net_rate > 0) {
+            flow->time_to_full = (flow->resource->max_capacity - flow->resource->amount) / flow->net_rate;
+        }
+
+        // The mission ends when the first sink resource (produced, never consumed) fills
+        if (flow->consumer_count == 0 && flow->time_to_full >= 0 &&
+            (analysis->mission_horizon < 0 || flow->time_to_full < analysis->mission_horizon)) {
+            analysis->mission_horizon = flow->time_to_full;
+        }
+    }
+
+    for (i = 0; i < analysis->size; i++) {
+        flow = &analysis->flows[i];
+        flow->bottleneck = (flow->consumer_count > 0 && flow->time_to_empty >= 0 &&
+                            (analysis->mission_horizon < 0 || flow->time_to_empty < analysis->mission_horizon));
+    }
+}
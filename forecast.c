@@ -0,0 +1,395 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// The forecast answers whether the oxygen will last until the destination. Every `interval_ms` a
+// background thread captures the amount of every resource and the status, rate and `amount_stored`
+// of every system, then runs the rest of the mission ahead in a `TickEngine`, as fast as the engine
+// goes rather than in real time. The manager's reactions are replayed along the way: a consumer that
+// finds its input short speeds up the input's producers, and a producer that finds its output full
+// slows them down. The forecast ends when the destination fills or the oxygen runs out, whichever
+// comes first, or at the horizon.
+//
+// The capture takes no lock, so live systems never wait on it. Reading each value atomically means
+// the values are not all from the same instant, which costs the forecast at most the conversions
+// that completed during the capture, a few microseconds' worth.
+
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Helper functions just used by this C file
+
+static void *forecast_thread(void *arg);
+static int forecast_run(Forecast *forecast);
+static int forecast_find(Resource **resources, int resource_count, const char *name);
+static int forecast_producers(const TickEngine *engine, int **start, int **producers);
+static void forecast_react(TickEngine *engine, const int *start, const int *producers);
+static void forecast_describe(const ForecastResult *result, double elapsed_ms, char *line, int length);
+
+/**
+ * Initializes a `Forecast` with no result yet.
+ *
+ * @param[out]    forecast     Pointer to the `Forecast` to initialize.
+ * @param[in,out] manager      Pointer to the `Manager` whose systems and resources are captured.
+ * @param[in]     interval_ms  Milliseconds between the starts of two forecasts.
+ * @param[in]     horizon_ms   Virtual milliseconds each forecast runs ahead at most.
+ * @return                     0 on success, -1 if the arguments are out of range.
+ */
+int forecast_init(Forecast *forecast, Manager *manager, int interval_ms, int horizon_ms) {
+    memset(forecast, 0, sizeof(Forecast));
+
+    if (interval_ms <= 0 || horizon_ms <= 0) {
+        return -1;
+    }
+
+    forecast->interval_ms = interval_ms;
+    forecast->horizon_ms = horizon_ms;
+    forecast->manager = manager;
+    sem_init(&forecast->mutex, 0, 1);
+    return 0;
+}
+
+/**
+ * Frees the engine used by the forecasts.
+ *
+ * @param[in,out] forecast  Pointer to the `Forecast` to clean.
+ */
+void forecast_clean(Forecast *forecast) {
+    tick_engine_clean(&forecast->engine);
+    sem_destroy(&forecast->mutex);
+}
+
+/**
+ * Starts forecasting on a separate thread, with the first forecast run straight away.
+ *
+ * @param[in,out] forecast  Pointer to the `Forecast`.
+ * @return                  0 on success, -1 if the thread could not be created.
+ */
+int forecast_start(Forecast *forecast) {
+    forecast->start_ns = clock_now_ns();
+    forecast->running = 1;
+
+    if (pthread_create(&forecast->thread, NULL, forecast_thread, forecast) != 0) {
+        forecast->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Stops the forecast thread, abandoning a forecast in progress.
+ *
+ * Called once the mission has ended, so its end time can be compared with the forecasts.
+ *
+ * @param[in,out] forecast  Pointer to the `Forecast`.
+ */
+void forecast_stop(Forecast *forecast) {
+    forecast->stop_ns = clock_now_ns();
+    if (!forecast->running) {
+        return;
+    }
+
+    __atomic_store_n(&forecast->running, 0, __ATOMIC_RELEASE);
+    pthread_join(forecast->thread, NULL);
+}
+
+/**
+ * Copies the latest result.
+ *
+ * @param[in]  forecast  Pointer to the `Forecast`.
+ * @param[out] result    Receives the result, with `runs` of 0 if no forecast has finished yet.
+ */
+void forecast_read(Forecast *forecast, ForecastResult *result) {
+    sem_wait(&forecast->mutex);
+    *result = forecast->result;
+    sem_post(&forecast->mutex);
+}
+
+/**
+ * Prints one line with the latest forecast, counted from now rather than from its capture.
+ *
+ * @param[in] forecast  Pointer to the `Forecast`.
+ */
+void forecast_display(Forecast *forecast) {
+    ForecastResult result;
+    char line[160];
+
+    forecast_read(forecast, &result);
+    if (result.runs == 0) {
+        printf(ANSI_LN_CLR "Forecast: not ready yet\n");
+        return;
+    }
+
+    forecast_describe(&result, (clock_now_ns() - result.taken_ns) / 1e6, line, sizeof(line));
+    printf(ANSI_LN_CLR "Forecast: %s\n", line);
+}
+
+/**
+ * Prints how the forecasts ran and how the first one compares with how the mission ended.
+ *
+ * @param[in] forecast  Pointer to the `Forecast`, stopped.
+ */
+void forecast_print(Forecast *forecast) {
+    ForecastResult result;
+    char line[160];
+    double predicted_ms, ended_ms;
+
+    forecast_read(forecast, &result);
+
+    printf("\nForecast:\n");
+    printf("-------------------------\n");
+    if (result.runs == 0) {
+        printf("No forecast finished before the mission ended\n");
+        return;
+    }
+
+    printf("%lld forecasts every %d ms, up to %d ms ahead\n", result.runs, forecast->interval_ms, forecast->horizon_ms);
+    printf("Capturing the live state: %.1f us on average, %.1f us at most, no system waited\n",
+           forecast->capture_total_ns / 1e3 / result.runs, forecast->capture_max_ns / 1e3);
+    printf("Running ahead: %.2f ms on average\n", forecast->simulate_total_ns / 1e6 / result.runs);
+
+    forecast_describe(&result, 0, line, sizeof(line));
+    printf("Latest, as of %.0f ms into the mission: %s\n", (result.taken_ns - forecast->start_ns) / 1e6, line);
+
+    // The mission ends at whichever outcome comes first, the forecast only knows that one
+    predicted_ms = (forecast->first.destination_ms >= 0) ? forecast->first.destination_ms : forecast->first.oxygen_ms;
+    ended_ms = (forecast->stop_ns - forecast->first.taken_ns) / 1e6;
+    if (predicted_ms >= 0) {
+        printf("The first forecast expected the mission to end %.0f ms after it, it ended after %.0f ms\n", predicted_ms, ended_ms);
+    }
+}
+
+/**
+ * Runs forecasts until stopped or until the mission ends.
+ *
+ * @param[in] arg  Pointer to the `Forecast` object.
+ * @return    NULL once stopped.
+ */
+static void *forecast_thread(void *arg) {
+    Forecast *forecast = (Forecast *)arg;
+    Manager *manager = forecast->manager;
+    struct timespec ts;
+    long long next_ns = forecast->start_ns, wake_ns;
+
+    while (__atomic_load_n(&forecast->running, __ATOMIC_ACQUIRE) &&
+           __atomic_load_n(&manager->simulation_running, __ATOMIC_ACQUIRE)) {
+        if (forecast_run(forecast) != 0) {
+            break;
+        }
+
+        // Keep to the interval however long the forecast took, skipping any start already missed
+        next_ns += forecast->interval_ms * 1000000LL;
+        wake_ns = next_ns - clock_now_ns();
+        if (wake_ns < 0) {
+            next_ns = clock_now_ns();
+            continue;
+        }
+        ts.tv_sec = wake_ns / 1000000000LL;
+        ts.tv_nsec = wake_ns % 1000000000LL;
+        nanosleep(&ts, NULL);
+    }
+
+    return NULL;
+}
+
+/**
+ * Captures the live state, runs it ahead to the end of the mission and publishes the result.
+ *
+ * @param[in,out] forecast  Pointer to the `Forecast`.
+ * @return                  0 on success or if stopped part way, -1 if memory ran out.
+ */
+static int forecast_run(Forecast *forecast) {
+    Manager *manager = forecast->manager;
+    TickEngine *engine = &forecast->engine;
+    ForecastResult result;
+    System **systems;
+    Resource **resources;
+    int *start = NULL, *producers = NULL;
+    int system_count, resource_count, destination, oxygen;
+    long long ticks, t, started_ns;
+
+    // Capture
+    result.taken_ns = clock_now_ns();
+    resource_count = resource_array_snapshot(&manager->resource_array, &resources);
+    system_count = system_array_snapshot(&manager->system_array, &systems);
+    if (tick_engine_capture(engine, systems, system_count, resources, resource_count) != 0) {
+        return -1;
+    }
+    started_ns = clock_now_ns();
+    result.capture_ns = started_ns - result.taken_ns;
+
+    destination = forecast_find(resources, resource_count, FORECAST_DESTINATION);
+    oxygen = forecast_find(resources, resource_count, FORECAST_OXYGEN);
+
+    // In PID mode the controller steers the rates, which the forecast holds where they were captured
+    if (manager->control_mode != CONTROL_PID && forecast_producers(engine, &start, &producers) != 0) {
+        return -1;
+    }
+
+    // Run ahead until either outcome, checking for a stop every so often
+    ticks = (long long)(forecast->horizon_ms / TICK_ENGINE_DT_MS);
+    for (t = 0; t < ticks; t++) {
+        if ((destination >= 0 && engine->first_full_time[destination] >= 0) ||
+            (oxygen >= 0 && engine->first_empty_time[oxygen] >= 0)) {
+            break;
+        }
+        if ((t & 1023) == 1023 && !__atomic_load_n(&forecast->running, __ATOMIC_ACQUIRE)) {
+            free(start);
+            free(producers);
+            return 0;
+        }
+
+        tick_engine_step(engine);
+        if (producers != NULL) {
+            forecast_react(engine, start, producers);
+        }
+    }
+
+    free(start);
+    free(producers);
+
+    result.simulate_ns = clock_now_ns() - started_ns;
+    result.simulated_ms = engine->tick * TICK_ENGINE_DT_MS;
+    result.destination_ms = (destination >= 0) ? engine->first_full_time[destination] : -1;
+    result.oxygen_ms = (oxygen >= 0) ? engine->first_empty_time[oxygen] : -1;
+
+    // Publish
+    forecast->capture_total_ns += result.capture_ns;
+    forecast->simulate_total_ns += result.simulate_ns;
+    if (result.capture_ns > forecast->capture_max_ns) {
+        forecast->capture_max_ns = result.capture_ns;
+    }
+
+    sem_wait(&forecast->mutex);
+    result.runs = forecast->result.runs + 1;
+    forecast->result = result;
+    if (result.runs == 1) {
+        forecast->first = result;
+    }
+    sem_post(&forecast->mutex);
+
+    return 0;
+}
+
+/**
+ * Finds a resource by name.
+ *
+ * @param[in] resources       Resources to search.
+ * @param[in] resource_count  Number of resources.
+ * @param[in] name            Name of the resource.
+ * @return                    Position of the resource, or -1 if there is none.
+ */
+static int forecast_find(Resource **resources, int resource_count, const char *name) {
+    for (int i = 0; i < resource_count; i++) {
+        if (strcmp(resources[i]->name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Lists the producers of each resource in the engine.
+ *
+ * The producers of resource `r` are `producers[start[r]]` to `producers[start[r + 1] - 1]`.
+ *
+ * @param[in]  engine     Pointer to the captured `TickEngine`.
+ * @param[out] start      Receives `resource_count + 1` offsets into `producers`, to be freed.
+ * @param[out] producers  Receives the system indices grouped by resource, to be freed.
+ * @return                0 on success, -1 if memory ran out.
+ */
+static int forecast_producers(const TickEngine *engine, int **start, int **producers) {
+    int *fill;
+    int i, r;
+
+    *start = (int *)calloc(engine->resource_count + 1, sizeof(int));
+    *producers = (int *)malloc(sizeof(int) * (engine->system_count > 0 ? engine->system_count : 1));
+    fill = (int *)malloc(sizeof(int) * (engine->resource_count > 0 ? engine->resource_count : 1));
+    if (*start == NULL || *producers == NULL || fill == NULL) {
+        free(*start);
+        free(*producers);
+        free(fill);
+        *start = NULL;
+        *producers = NULL;
+        return -1;
+    }
+
+    for (i = 0; i < engine->system_count; i++) {
+        if (engine->produced_index[i] >= 0) {
+            (*start)[engine->produced_index[i] + 1]++;
+        }
+    }
+    for (r = 0; r < engine->resource_count; r++) {
+        (*start)[r + 1] += (*start)[r];
+        fill[r] = (*start)[r];
+    }
+    for (i = 0; i < engine->system_count; i++) {
+        if (engine->produced_index[i] >= 0) {
+            (*producers)[fill[engine->produced_index[i]]++] = i;
+        }
+    }
+
+    free(fill);
+    return 0;
+}
+
+/**
+ * Does what the manager does with the events of the systems that acted in the last tick.
+ *
+ * A short input speeds up the input's producers and a full output slows down its producers.
+ *
+ * @param[in,out] engine     Pointer to the `TickEngine`.
+ * @param[in]     start      Offsets into `producers` by resource.
+ * @param[in]     producers  Producers grouped by resource.
+ */
+static void forecast_react(TickEngine *engine, const int *start, const int *producers) {
+    int k, i, p, r, status;
+
+    for (k = 0; k < engine->ready_count; k++) {
+        i = engine->ready[k];
+
+        if (engine->last_result[i] == STATUS_EMPTY || engine->last_result[i] == STATUS_INSUFFICIENT) {
+            r = engine->consumed_index[i];
+            status = FAST;
+        } else if (engine->last_result[i] == STATUS_CAPACITY) {
+            r = engine->produced_index[i];
+            status = SLOW;
+        } else {
+            continue;
+        }
+        // The resource was added after the capture, so it has no producers here
+        if (r < 0) {
+            continue;
+        }
+
+        for (p = start[r]; p < start[r + 1]; p++) {
+            tick_engine_set_status(engine, producers[p], status);
+        }
+    }
+}
+
+/**
+ * Describes the outcome of a forecast in words.
+ *
+ * @param[in]  result      The forecast.
+ * @param[in]  elapsed_ms  Milliseconds since the capture, taken off the predicted times.
+ * @param[out] line        Receives the description.
+ * @param[in]  length      Size of `line`.
+ */
+static void forecast_describe(const ForecastResult *result, double elapsed_ms, char *line, int length) {
+    double destination_ms = result->destination_ms - elapsed_ms;
+    double oxygen_ms = result->oxygen_ms - elapsed_ms;
+
+    if (result->destination_ms >= 0) {
+        snprintf(line, length, "%s fills in %.0f ms, %s lasts until then",
+                 FORECAST_DESTINATION, destination_ms > 0 ? destination_ms : 0, FORECAST_OXYGEN);
+    } else if (result->oxygen_ms >= 0) {
+        snprintf(line, length, "%s runs out in %.0f ms, before %s fills",
+                 FORECAST_OXYGEN, oxygen_ms > 0 ? oxygen_ms : 0, FORECAST_DESTINATION);
+    } else {
+        snprintf(line, length, "neither %s fills nor %s runs out within %.0f ms",
+                 FORECAST_DESTINATION, FORECAST_OXYGEN, result->simulated_ms);
+    }
+}
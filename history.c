@@ -0,0 +1,692 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// The history keeps one series per resource (its amount) and per system (its status), sampled every
+// `resolution_ms`. Each series owns a fixed ring of chunks, so its memory never grows: once every
+// chunk is full the oldest is overwritten.
+//
+// Inside a chunk the first value is stored as is and each later sample as a varint token. A changed
+// value costs its zigzagged delta from the previous sample (one byte for changes up to +-31). A
+// repeated value extends a run token in place, so a resource holding steady or a system keeping its
+// status costs next to nothing. Each chunk also keeps the min, max and sum of its samples, so window
+// summaries only decode the chunks at the edges of the window.
+
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Helper functions just used by this C file
+
+static void *history_thread(void *arg);
+static void history_sample(History *history);
+static int history_add_series(History *history, int kind, const char *name);
+static void history_append(History *history, HistorySeries *series, int value, long long sample);
+static void history_chunk_start(HistoryChunk *chunk, int value, long long sample);
+static int history_chunk_append(HistoryChunk *chunk, int value);
+static int history_put_varint(unsigned char *out, int available, unsigned long long value);
+static int history_get_varint(const unsigned char *in, int available, unsigned long long *value);
+static const HistoryChunk *history_chunk_at(const History *history, const HistorySeries *series, int age);
+static void history_cursor_init(HistoryCursor *cursor, const History *history, const HistorySeries *series, long long from);
+static int history_cursor_next(HistoryCursor *cursor, const History *history, int *value, long long *sample);
+static long long history_encoded_bytes(const History *history, long long *stored);
+
+/**
+ * Initializes an empty `History`.
+ *
+ * Series are created as resources and systems are first sampled.
+ *
+ * @param[out]    history            Pointer to the `History` to initialize.
+ * @param[in,out] manager            Pointer to the `Manager` whose resources and systems are sampled.
+ * @param[in]     resolution_ms      Milliseconds between samples.
+ * @param[in]     chunks_per_series  Chunks in each series' ring, fixing how much each series can hold.
+ * @return                           0 on success, -1 if the arguments are out of range.
+ */
+int history_init(History *history, Manager *manager, int resolution_ms, int chunks_per_series) {
+    memset(history, 0, sizeof(History));
+
+    if (resolution_ms <= 0 || chunks_per_series <= 0) {
+        return -1;
+    }
+
+    history->resolution_ms = resolution_ms;
+    history->chunks_per_series = chunks_per_series;
+    history->manager = manager;
+    sem_init(&history->mutex, 0, 1);
+    return 0;
+}
+
+/**
+ * Frees every series in the `History`.
+ *
+ * @param[in,out] history  Pointer to the `History` to clean.
+ */
+void history_clean(History *history) {
+    for (int i = 0; i < history->size; i++) {
+        free(history->series[i].chunks);
+    }
+    free(history->series);
+    sem_destroy(&history->mutex);
+    history->series = NULL;
+    history->size = 0;
+    history->capacity = 0;
+}
+
+/**
+ * Starts sampling on a separate thread, with the first sample taken straight away.
+ *
+ * @param[in,out] history  Pointer to the `History`.
+ * @return                 0 on success, -1 if the thread could not be created.
+ */
+int history_start(History *history) {
+    history->start_ns = clock_now_ns();
+    history->running = 1;
+
+    if (pthread_create(&history->thread, NULL, history_thread, history) != 0) {
+        history->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Takes a final sample and stops the sampling thread.
+ *
+ * @param[in,out] history  Pointer to the `History`.
+ */
+void history_stop(History *history) {
+    if (!history->running) {
+        return;
+    }
+
+    __atomic_store_n(&history->running, 0, __ATOMIC_RELEASE);
+    pthread_join(history->thread, NULL);
+    history_sample(history);
+}
+
+/**
+ * Finds the series recording a resource or system.
+ *
+ * @param[in] history  Pointer to the `History`.
+ * @param[in] kind     HISTORY_KIND_RESOURCE or HISTORY_KIND_SYSTEM.
+ * @param[in] name     Name of the resource or system.
+ * @return             Index of the series, or -1 if there is none.
+ */
+int history_find(History *history, int kind, const char *name) {
+    int found = -1;
+
+    sem_wait(&history->mutex);
+    for (int i = 0; i < history->size && found < 0; i++) {
+        if (history->series[i].kind == kind && strncmp(history->series[i].name, name, TELEMETRY_NAME_LENGTH - 1) == 0) {
+            found = i;
+        }
+    }
+    sem_post(&history->mutex);
+
+    return found;
+}
+
+/**
+ * Copies the samples of a series between two times.
+ *
+ * Times are milliseconds since sampling started and both ends are included. Samples from before the
+ * oldest one still held are skipped, and `first_ms` says when the first returned sample was taken.
+ *
+ * @param[in]  history     Pointer to the `History`.
+ * @param[in]  series      Index of the series.
+ * @param[in]  from_ms     Start of the range.
+ * @param[in]  to_ms       End of the range.
+ * @param[out] values      Array receiving one value per `resolution_ms`.
+ * @param[in]  max_values  Size of `values`.
+ * @param[out] first_ms    Time of `values[0]`, may be NULL.
+ * @return                 Number of values copied, or -1 if there is no such series.
+ */
+int history_range(History *history, int series, long long from_ms, long long to_ms, int *values, int max_values, long long *first_ms) {
+    HistoryCursor cursor;
+    long long from = (from_ms + history->resolution_ms - 1) / history->resolution_ms;
+    long long to = to_ms / history->resolution_ms;
+    long long sample;
+    int value, count = 0;
+
+    if (series < 0 || series >= history->size) {
+        return -1;
+    }
+
+    sem_wait(&history->mutex);
+    history_cursor_init(&cursor, history, &history->series[series], from);
+    while (count < max_values && history_cursor_next(&cursor, history, &value, &sample) && sample <= to) {
+        if (count == 0 && first_ms != NULL) {
+            *first_ms = sample * history->resolution_ms;
+        }
+        values[count++] = value;
+    }
+    sem_post(&history->mutex);
+
+    return count;
+}
+
+/**
+ * Summarizes a series between two times.
+ *
+ * Chunks lying entirely inside the window are summarized from their stored min, max and sum
+ * without being decoded.
+ *
+ * @param[in]  history  Pointer to the `History`.
+ * @param[in]  series   Index of the series.
+ * @param[in]  from_ms  Start of the window, in milliseconds since sampling started.
+ * @param[in]  to_ms    End of the window, included.
+ * @param[out] stats    Count, min, max and average of the samples in the window.
+ * @return              0 on success, -1 if there is no such series or no sample in the window.
+ */
+int history_window(History *history, int series, long long from_ms, long long to_ms, HistoryStats *stats) {
+    const HistorySeries *target;
+    const HistoryChunk *chunk;
+    HistoryCursor cursor;
+    long long from = (from_ms + history->resolution_ms - 1) / history->resolution_ms;
+    long long to = to_ms / history->resolution_ms;
+    long long sum = 0, sample, end;
+    int value, age;
+
+    if (series < 0 || series >= history->size) {
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(HistoryStats));
+    sem_wait(&history->mutex);
+    target = &history->series[series];
+
+    for (age = 0; age < target->used_chunks; age++) {
+        chunk = history_chunk_at(history, target, age);
+        end = chunk->first_sample + chunk->count - 1;
+        if (end < from || chunk->first_sample > to) {
+            continue;
+        }
+
+        if (chunk->first_sample >= from && end <= to) {
+            // Whole chunk inside the window
+            stats->min = (stats->count == 0 || chunk->min < stats->min) ? chunk->min : stats->min;
+            stats->max = (stats->count == 0 || chunk->max > stats->max) ? chunk->max : stats->max;
+            stats->count += chunk->count;
+            sum += chunk->sum;
+            continue;
+        }
+
+        // Chunk at an edge of the window, decode it
+        history_cursor_init(&cursor, history, target, chunk->first_sample);
+        while (history_cursor_next(&cursor, history, &value, &sample) && sample <= end) {
+            if (sample < from || sample > to) {
+                continue;
+            }
+            stats->min = (stats->count == 0 || value < stats->min) ? value : stats->min;
+            stats->max = (stats->count == 0 || value > stats->max) ? value : stats->max;
+            stats->count++;
+            sum += value;
+        }
+    }
+    sem_post(&history->mutex);
+
+    if (stats->count == 0) {
+        return -1;
+    }
+    stats->average = (double)sum / stats->count;
+    return 0;
+}
+
+/**
+ * Writes every series to a CSV file, one row per sampling round and one column per series.
+ *
+ * Cells are left empty where a series holds no sample, before its resource or system existed, after
+ * it was removed, or where its oldest chunks have been overwritten.
+ *
+ * @param[in] history  Pointer to the `History`.
+ * @param[in] path     File to write.
+ * @return             0 on success, -1 if the file could not be written.
+ */
+int history_export_csv(History *history, const char *path) {
+    FILE *file = fopen(path, "w");
+    HistoryCursor *cursors;
+    long long *next_sample, round;
+    int *next_value, i, result = 0;
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    sem_wait(&history->mutex);
+    cursors = (HistoryCursor *)malloc(sizeof(HistoryCursor) * (history->size > 0 ? history->size : 1));
+    next_sample = (long long *)malloc(sizeof(long long) * (history->size > 0 ? history->size : 1));
+    next_value = (int *)malloc(sizeof(int) * (history->size > 0 ? history->size : 1));
+
+    if (cursors == NULL || next_sample == NULL || next_value == NULL) {
+        result = -1;
+    } else {
+        fprintf(file, "time_ms");
+        for (i = 0; i < history->size; i++) {
+            fprintf(file, ",%s %s", history->series[i].name, history->series[i].kind == HISTORY_KIND_RESOURCE ? "amount" : "status");
+            history_cursor_init(&cursors[i], history, &history->series[i], 0);
+            if (!history_cursor_next(&cursors[i], history, &next_value[i], &next_sample[i])) {
+                next_sample[i] = -1;
+            }
+        }
+        fprintf(file, "\n");
+
+        for (round = 0; round < history->samples; round++) {
+            fprintf(file, "%lld", round * history->resolution_ms);
+            for (i = 0; i < history->size; i++) {
+                if (next_sample[i] != round) {
+                    fputc(',', file);
+                    continue;
+                }
+                fprintf(file, ",%d", next_value[i]);
+                if (!history_cursor_next(&cursors[i], history, &next_value[i], &next_sample[i])) {
+                    next_sample[i] = -1;
+                }
+            }
+            fputc('\n', file);
+        }
+    }
+    sem_post(&history->mutex);
+
+    free(cursors);
+    free(next_sample);
+    free(next_value);
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+/**
+ * Prints how much the history holds and what it costs, and a summary of each resource.
+ *
+ * @param[in] history  Pointer to the `History`.
+ */
+void history_print(History *history) {
+    HistoryStats stats;
+    long long stored, bytes;
+    long long end_ms = (history->samples > 0 ? history->samples - 1 : 0) * history->resolution_ms;
+
+    sem_wait(&history->mutex);
+    bytes = history_encoded_bytes(history, &stored);
+    sem_post(&history->mutex);
+
+    printf("History: %d series, %lld samples every %d ms, %lld held in %lld encoded bytes (%.2f bytes/sample), %zu bytes reserved\n",
+           history->size, history->samples, history->resolution_ms, stored, bytes,
+           stored > 0 ? (double)bytes / stored : 0.0, (size_t)history->size * history->chunks_per_series * sizeof(HistoryChunk));
+
+    for (int i = 0; i < history->size; i++) {
+        if (history->series[i].kind == HISTORY_KIND_RESOURCE && history_window(history, i, 0, end_ms, &stats) == 0) {
+            printf("  %-20s min %6d  max %6d  avg %9.1f\n", history->series[i].name, stats.min, stats.max, stats.average);
+        }
+    }
+}
+
+/**
+ * Takes a sample every `resolution_ms` until the history is stopped.
+ *
+ * @param[in] arg  Pointer to the `History` object.
+ * @return    NULL once the history is stopped.
+ */
+static void *history_thread(void *arg) {
+    History *history = (History *)arg;
+    struct timespec ts;
+    long long wake_ns;
+
+    while (__atomic_load_n(&history->running, __ATOMIC_ACQUIRE)) {
+        history_sample(history);
+
+        // Sleep until the next round is due, so the resolution does not drift
+        wake_ns = history->start_ns + history->samples * history->resolution_ms * 1000000LL - clock_now_ns();
+        if (wake_ns > 0) {
+            ts.tv_sec = wake_ns / 1000000000LL;
+            ts.tv_nsec = wake_ns % 1000000000LL;
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Takes one sampling round: the amount of every resource and the status of every system.
+ *
+ * @param[in,out] history  Pointer to the `History`.
+ */
+static void history_sample(History *history) {
+    Manager *manager = history->manager;
+    Resource **resources;
+    System **systems;
+    int resource_count, system_count, i;
+
+    resource_count = resource_array_snapshot(&manager->resource_array, &resources);
+    system_count = system_array_snapshot(&manager->system_array, &systems);
+
+    sem_wait(&history->mutex);
+
+    for (i = 0; i < resource_count; i++) {
+        if (resources[i]->history_index == -1) {
+            resources[i]->history_index = history_add_series(history, HISTORY_KIND_RESOURCE, resources[i]->name);
+        }
+        if (resources[i]->history_index >= 0) {
+            history_append(history, &history->series[resources[i]->history_index], resource_read_amount(resources[i]), history->samples);
+        }
+    }
+
+    for (i = 0; i < system_count; i++) {
+        if (systems[i]->history_index == -1) {
+            systems[i]->history_index = history_add_series(history, HISTORY_KIND_SYSTEM, systems[i]->name);
+        }
+        if (systems[i]->history_index >= 0) {
+            history_append(history, &history->series[systems[i]->history_index],
+                           __atomic_load_n(&systems[i]->status, __ATOMIC_RELAXED), history->samples);
+        }
+    }
+
+    history->samples++;
+    sem_post(&history->mutex);
+}
+
+/**
+ * Adds an empty series, resizing the series array if necessary (doubling the size).
+ *
+ * Use of realloc is NOT permitted.
+ *
+ * @param[in,out] history  Pointer to the `History`, with its mutex held.
+ * @param[in]     kind     HISTORY_KIND_RESOURCE or HISTORY_KIND_SYSTEM.
+ * @param[in]     name     Name of the resource or system.
+ * @return                 Index of the new series, or -2 if memory ran out (the object is then never recorded).
+ */
+static int history_add_series(History *history, int kind, const char *name) {
+    HistorySeries *temp_series, *series;
+
+    if (history->size == history->capacity) {
+        temp_series = (HistorySeries *)malloc(sizeof(HistorySeries) * (history->capacity > 0 ? history->capacity * 2 : 8));
+        if (temp_series == NULL) {
+            return -2;
+        }
+        for (int i = 0; i < history->size; i++) {
+            temp_series[i] = history->series[i];
+        }
+        free(history->series);
+        history->series = temp_series;
+        history->capacity = (history->capacity > 0) ? history->capacity * 2 : 8;
+    }
+
+    series = &history->series[history->size];
+    series->chunks = (HistoryChunk *)malloc(sizeof(HistoryChunk) * history->chunks_per_series);
+    if (series->chunks == NULL) {
+        return -2;
+    }
+
+    strncpy(series->name, name, TELEMETRY_NAME_LENGTH - 1);
+    series->name[TELEMETRY_NAME_LENGTH - 1] = '\0';
+    series->kind = kind;
+    series->head = 0;
+    series->used_chunks = 0;
+    return history->size++;
+}
+
+/**
+ * Appends a sample to a series, moving on to the next chunk when the current one is full.
+ *
+ * @param[in]     history  Pointer to the `History`.
+ * @param[in,out] series   Pointer to the `HistorySeries`.
+ * @param[in]     value    The sampled value.
+ * @param[in]     sample   Number of the sampling round.
+ */
+static void history_append(History *history, HistorySeries *series, int value, long long sample) {
+    if (series->used_chunks > 0 && history_chunk_append(&series->chunks[series->head], value) == 0) {
+        return;
+    }
+
+    // Start the next chunk, overwriting the oldest once the ring is full
+    if (series->used_chunks > 0) {
+        series->head = (series->head + 1) % history->chunks_per_series;
+    }
+    if (series->used_chunks < history->chunks_per_series) {
+        series->used_chunks++;
+    }
+    history_chunk_start(&series->chunks[series->head], value, sample);
+}
+
+/**
+ * Starts a chunk with its first sample.
+ *
+ * @param[out] chunk   Pointer to the `HistoryChunk`.
+ * @param[in]  value   The first value.
+ * @param[in]  sample  Number of the sampling round.
+ */
+static void history_chunk_start(HistoryChunk *chunk, int value, long long sample) {
+    chunk->first_sample = sample;
+    chunk->first_value = value;
+    chunk->last_value = value;
+    chunk->count = 1;
+    chunk->min = value;
+    chunk->max = value;
+    chunk->sum = value;
+    chunk->used = 0;
+    chunk->last_token = -1;
+    chunk->last_run = 0;
+}
+
+/**
+ * Appends the next sample to a chunk.
+ *
+ * @param[in,out] chunk  Pointer to the `HistoryChunk`.
+ * @param[in]     value  The sampled value.
+ * @return               0 on success, -1 if the chunk is full.
+ */
+static int history_chunk_append(HistoryChunk *chunk, int value) {
+    long long delta = (long long)value - chunk->last_value;
+    unsigned long long token;
+    int length;
+
+    if (delta == 0 && chunk->last_run > 0) {
+        // Extend the run in place, it is the last token so it may grow into the free space
+        length = history_put_varint(chunk->data + chunk->last_token, HISTORY_CHUNK_BYTES - chunk->last_token,
+                                    ((unsigned long long)(chunk->last_run + 1) << 1) | 1);
+        if (length < 0) {
+            return -1;
+        }
+        chunk->used = chunk->last_token + length;
+        chunk->last_run++;
+    } else {
+        token = (delta == 0) ? ((1ULL << 1) | 1) : ((((unsigned long long)delta << 1) ^ (unsigned long long)(delta >> 63)) << 1);
+        length = history_put_varint(chunk->data + chunk->used, HISTORY_CHUNK_BYTES - chunk->used, token);
+        if (length < 0) {
+            return -1;
+        }
+        chunk->last_token = chunk->used;
+        chunk->last_run = (delta == 0) ? 1 : 0;
+        chunk->used += length;
+    }
+
+    chunk->last_value = value;
+    chunk->count++;
+    chunk->min = (value < chunk->min) ? value : chunk->min;
+    chunk->max = (value > chunk->max) ? value : chunk->max;
+    chunk->sum += value;
+    return 0;
+}
+
+/**
+ * Writes a varint, seven bits per byte with the high bit set on every byte but the last.
+ *
+ * @param[out] out        Where to write.
+ * @param[in]  available  Bytes available at `out`.
+ * @param[in]  value      Value to write.
+ * @return                Bytes written, or -1 if they would not fit.
+ */
+static int history_put_varint(unsigned char *out, int available, unsigned long long value) {
+    int length = 0;
+
+    do {
+        if (length == available) {
+            return -1;
+        }
+        out[length++] = (unsigned char)((value & 0x7f) | (value > 0x7f ? 0x80 : 0));
+        value >>= 7;
+    } while (value != 0);
+
+    return length;
+}
+
+/**
+ * Reads a varint written by `history_put_varint`.
+ *
+ * @param[in]  in         Where to read.
+ * @param[in]  available  Bytes available at `in`.
+ * @param[out] value      Value read.
+ * @return                Bytes read, or -1 if the varint is cut short.
+ */
+static int history_get_varint(const unsigned char *in, int available, unsigned long long *value) {
+    int length = 0, shift = 0;
+
+    *value = 0;
+    do {
+        if (length == available) {
+            return -1;
+        }
+        *value |= (unsigned long long)(in[length] & 0x7f) << shift;
+        shift += 7;
+    } while (in[length++] & 0x80);
+
+    return length;
+}
+
+/**
+ * Finds a chunk of a series by age.
+ *
+ * @param[in] history  Pointer to the `History`.
+ * @param[in] series   Pointer to the `HistorySeries`.
+ * @param[in] age      0 for the oldest chunk, up to `used_chunks - 1` for the newest.
+ * @return             Pointer to the chunk.
+ */
+static const HistoryChunk *history_chunk_at(const History *history, const HistorySeries *series, int age) {
+    int capacity = history->chunks_per_series;
+    return &series->chunks[(series->head - series->used_chunks + 1 + age + capacity) % capacity];
+}
+
+/**
+ * Positions a cursor on the first sample of a series numbered `from` or later.
+ *
+ * Whole chunks before `from` are skipped without being decoded.
+ *
+ * @param[out] cursor   Pointer to the `HistoryCursor`.
+ * @param[in]  history  Pointer to the `History`.
+ * @param[in]  series   Pointer to the `HistorySeries` to decode.
+ * @param[in]  from     Number of the first sampling round wanted.
+ */
+static void history_cursor_init(HistoryCursor *cursor, const History *history, const HistorySeries *series, long long from) {
+    const HistoryChunk *chunk;
+    int value;
+    long long sample;
+
+    cursor->series = series;
+    cursor->chunk = NULL;
+
+    for (cursor->age = 0; cursor->age < series->used_chunks; cursor->age++) {
+        chunk = history_chunk_at(history, series, cursor->age);
+        if (chunk->first_sample + chunk->count > from) {
+            cursor->chunk = chunk;
+            break;
+        }
+    }
+
+    if (cursor->chunk == NULL) {
+        return;
+    }
+
+    cursor->sample = cursor->chunk->first_sample;
+    cursor->offset = 0;
+    cursor->value = cursor->chunk->first_value;
+    cursor->run_left = 0;
+    cursor->emitted = 0;
+
+    // Decode up to the sample before `from`
+    while (cursor->sample < from && history_cursor_next(cursor, history, &value, &sample)) {
+    }
+}
+
+/**
+ * Decodes the next sample of a series.
+ *
+ * @param[in,out] cursor   Pointer to the `HistoryCursor`.
+ * @param[in]     history  Pointer to the `History`.
+ * @param[out]    value    The sampled value.
+ * @param[out]    sample   Number of the sampling round it was taken in.
+ * @return                 1 if a sample was decoded, 0 once past the newest sample.
+ */
+static int history_cursor_next(HistoryCursor *cursor, const History *history, int *value, long long *sample) {
+    const HistoryChunk *chunk = cursor->chunk;
+    unsigned long long token;
+    int length;
+
+    if (chunk == NULL) {
+        return 0;
+    }
+
+    if (cursor->emitted == chunk->count) {
+        // Move on to the next chunk
+        if (cursor->age + 1 >= cursor->series->used_chunks) {
+            cursor->chunk = NULL;
+            return 0;
+        }
+        cursor->age++;
+        chunk = cursor->chunk = history_chunk_at(history, cursor->series, cursor->age);
+        cursor->sample = chunk->first_sample;
+        cursor->offset = 0;
+        cursor->value = chunk->first_value;
+        cursor->run_left = 0;
+        cursor->emitted = 0;
+    }
+
+    if (cursor->emitted > 0) {
+        if (cursor->run_left > 0) {
+            cursor->run_left--;
+        } else {
+            length = history_get_varint(chunk->data + cursor->offset, chunk->used - cursor->offset, &token);
+            if (length < 0) {
+                cursor->chunk = NULL;
+                return 0;
+            }
+            cursor->offset += length;
+
+            if (token & 1) {
+                cursor->run_left = (int)(token >> 1) - 1;
+            } else {
+                token >>= 1;
+                cursor->value += (int)((long long)(token >> 1) ^ -(long long)(token & 1));
+            }
+        }
+    }
+
+    cursor->emitted++;
+    *value = cursor->value;
+    *sample = cursor->sample++;
+    return 1;
+}
+
+/**
+ * Adds up the encoded size of every series.
+ *
+ * @param[in]  history  Pointer to the `History`, with its mutex held.
+ * @param[out] stored   Number of samples still held.
+ * @return              Bytes of encoded data plus the fixed header of each chunk in use.
+ */
+static long long history_encoded_bytes(const History *history, long long *stored) {
+    const HistoryChunk *chunk;
+    long long bytes = 0;
+
+    *stored = 0;
+    for (int i = 0; i < history->size; i++) {
+        for (int age = 0; age < history->series[i].used_chunks; age++) {
+            chunk = history_chunk_at(history, &history->series[i], age);
+            bytes += (long long)(sizeof(HistoryChunk) - HISTORY_CHUNK_BYTES) + chunk->used;
+            *stored += chunk->count;
+        }
+    }
+
+    return bytes;
+}
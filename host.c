@@ -0,0 +1,387 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// The host runs many independent missions in one process. Each mission has its own manager,
+// event queue, systems and resources, exactly as a single simulation does, but no threads of its
+// own: its systems are woken by its own timing wheel, and a small shared pool of workers takes
+// turns on the missions in order. A turn handles the mission's pending events, then steps every
+// system whose timer has expired, so a mission costs its memory and nothing else while it waits.
+//
+// Only one worker runs a mission at a time, so a mission never competes with itself for its own
+// locks, and missions share nothing, so a mission ending or being stopped affects no other. The
+// workers account the turns, steps and time they spend on each mission.
+
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Helper functions just used by this C file
+
+static void *host_worker(void *arg);
+static int host_turn(Host *host, Mission *mission);
+static void host_end_mission(Host *host, Mission *mission);
+static int host_outcome(Mission *mission);
+
+/**
+ * Initializes a `Host` and loads its missions, none of which are started.
+ *
+ * Each mission's statuses are chosen by the same flow analysis a single simulation runs at load.
+ *
+ * @param[out] host           Pointer to the `Host` to initialize.
+ * @param[in]  mission_count  Number of missions to load.
+ * @param[in]  worker_count   Number of worker threads shared by every mission.
+ * @param[in]  load           Adds one mission's resources and systems to its manager.
+ * @return                    0 on success, -1 if the counts are invalid or memory ran out.
+ */
+int host_init(Host *host, int mission_count, int worker_count, void (*load)(Manager *manager)) {
+    FlowAnalysis analysis;
+    Mission *mission;
+
+    host->missions = NULL;
+    host->mission_count = 0;
+    host->live = 0;
+    host->running = 0;
+    host->next = 0;
+    host->worker_count = worker_count;
+    host->workers = NULL;
+
+    if (mission_count <= 0 || worker_count <= 0) {
+        return -1;
+    }
+
+    host->missions = (Mission **)malloc(sizeof(Mission *) * mission_count);
+    host->workers = (pthread_t *)malloc(sizeof(pthread_t) * worker_count);
+    if (host->missions == NULL || host->workers == NULL) {
+        host_clean(host);
+        return -1;
+    }
+
+    for (int i = 0; i < mission_count; i++) {
+        mission = (Mission *)malloc(sizeof(Mission));
+        if (mission == NULL) {
+            host_clean(host);
+            return -1;
+        }
+
+        mission->id = i;
+        mission->state = MISSION_LOADED;
+        mission->claimed = 0;
+        mission->outcome = MISSION_OUTCOME_NONE;
+        mission->started_ns = 0;
+        mission->ended_ns = 0;
+        mission->turns = 0;
+        mission->steps = 0;
+        mission->busy_ns = 0;
+
+        // Nothing prints from a mission, the host reports how each one ended
+        manager_init(&mission->manager);
+        mission->manager.quiet = 1;
+        mission->manager.log.level = LOG_LEVEL_NONE;
+        load(&mission->manager);
+
+        flow_analysis_init(&analysis, &mission->manager);
+        flow_analysis_apply(&analysis, &mission->manager);
+        flow_analysis_clean(&analysis);
+
+        host->missions[host->mission_count++] = mission;
+    }
+
+    return 0;
+}
+
+/**
+ * Cleans up the `Host` and every mission, once its workers have stopped.
+ *
+ * @param[in,out] host  Pointer to the `Host` to clean.
+ */
+void host_clean(Host *host) {
+    Mission *mission;
+
+    for (int i = 0; i < host->mission_count; i++) {
+        mission = host->missions[i];
+        if (mission->started_ns != 0) {
+            scheduler_clean(&mission->scheduler);
+        }
+        manager_clean(&mission->manager);
+        free(mission);
+    }
+
+    free(host->missions);
+    free(host->workers);
+    host->missions = NULL;
+    host->workers = NULL;
+    host->mission_count = 0;
+}
+
+/**
+ * Starts the worker threads, which take turns on the missions as they are started.
+ *
+ * @param[in,out] host  Pointer to the `Host`.
+ * @return              0 on success, -1 if no worker could be created.
+ */
+int host_start(Host *host) {
+    int created = 0;
+
+    __atomic_store_n(&host->running, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < host->worker_count; i++) {
+        if (pthread_create(&host->workers[created], NULL, host_worker, host) == 0) {
+            created++;
+        }
+    }
+    host->worker_count = created;
+
+    if (created == 0) {
+        host->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Stops the worker threads once they finish their current turns.
+ *
+ * Missions still running are left as they are, stop them first for them to end.
+ *
+ * @param[in,out] host  Pointer to the `Host`.
+ */
+void host_stop(Host *host) {
+    if (!host->running) {
+        return;
+    }
+
+    __atomic_store_n(&host->running, 0, __ATOMIC_RELEASE);
+    for (int i = 0; i < host->worker_count; i++) {
+        pthread_join(host->workers[i], NULL);
+    }
+}
+
+/**
+ * Starts a loaded mission, its systems take their first steps on the next turn.
+ *
+ * Missions are started and stopped from one thread, while the workers run the others.
+ *
+ * @param[in,out] host   Pointer to the `Host`.
+ * @param[in]     index  Index of the mission.
+ * @return               0 on success, -1 if there is no such mission or it was already started.
+ */
+int host_start_mission(Host *host, int index) {
+    Mission *mission;
+
+    if (index < 0 || index >= host->mission_count) {
+        return -1;
+    }
+    mission = host->missions[index];
+    if (__atomic_load_n(&mission->state, __ATOMIC_ACQUIRE) != MISSION_LOADED) {
+        return -1;
+    }
+
+    // No worker touches the mission until it is marked running, which publishes the scheduler
+    scheduler_init(&mission->scheduler, &mission->manager);
+    mission->started_ns = clock_now_ns();
+    __atomic_add_fetch(&host->live, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&mission->state, MISSION_RUNNING, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/**
+ * Stops a mission, the same way running out of oxygen does.
+ *
+ * Every system is terminated, and the mission ends on its next turn. A mission that was never
+ * started ends straight away.
+ *
+ * @param[in,out] host   Pointer to the `Host`.
+ * @param[in]     index  Index of the mission.
+ * @return               0 on success, -1 if there is no such mission or it has already ended.
+ */
+int host_stop_mission(Host *host, int index) {
+    Mission *mission;
+    System **systems;
+    int state = MISSION_LOADED, count;
+
+    if (index < 0 || index >= host->mission_count) {
+        return -1;
+    }
+    mission = host->missions[index];
+
+    if (__atomic_compare_exchange_n(&mission->state, &state, MISSION_ENDED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        mission->outcome = MISSION_OUTCOME_STOPPED;
+        return 0;
+    }
+    if (state != MISSION_RUNNING || !__atomic_load_n(&mission->manager.simulation_running, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+
+    __atomic_store_n(&mission->manager.simulation_running, 0, __ATOMIC_SEQ_CST);
+    count = system_array_snapshot(&mission->manager.system_array, &systems);
+    for (int i = 0; i < count; i++) {
+        manager_set_system_status(&mission->manager, systems[i], TERMINATE);
+    }
+
+    return 0;
+}
+
+/**
+ * Counts the missions started and not yet ended.
+ *
+ * @param[in] host  Pointer to the `Host`.
+ * @return          Number of live missions.
+ */
+int host_live(Host *host) {
+    return __atomic_load_n(&host->live, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Takes turns on the missions in order until the host is stopped.
+ *
+ * Every worker takes the next position round the missions, so each running mission gets one
+ * turn per round whichever worker takes it. A mission another worker is running is skipped for
+ * this round. After a whole round without work the worker sleeps until the next tick.
+ *
+ * @param[in] arg  Pointer to the `Host` object.
+ * @return    NULL when the host is stopped.
+ */
+static void *host_worker(void *arg) {
+    Host *host = (Host *)arg;
+    Mission *mission;
+    struct timespec pause = { 0, WHEEL_TICK_MS * 1000000L };
+    long long start_ns;
+    int expected, work, idle = 0;
+
+    while (__atomic_load_n(&host->running, __ATOMIC_ACQUIRE)) {
+        mission = host->missions[__atomic_fetch_add(&host->next, 1, __ATOMIC_RELAXED) % host->mission_count];
+        work = 0;
+
+        expected = 0;
+        if (__atomic_load_n(&mission->state, __ATOMIC_ACQUIRE) == MISSION_RUNNING &&
+            __atomic_compare_exchange_n(&mission->claimed, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            start_ns = clock_now_ns();
+            work = host_turn(host, mission);
+            mission->busy_ns += clock_now_ns() - start_ns;
+            mission->turns++;
+            __atomic_store_n(&mission->claimed, 0, __ATOMIC_RELEASE);
+        }
+
+        idle = (work > 0) ? 0 : idle + 1;
+        if (idle >= host->mission_count) {
+            nanosleep(&pause, NULL);
+            idle = 0;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Takes one turn on a mission: handles its pending events, then steps its expired systems.
+ *
+ * @param[in,out] host     Pointer to the `Host`.
+ * @param[in,out] mission  Pointer to the `Mission`, claimed by the calling worker.
+ * @return                 Number of events handled and systems stepped.
+ */
+static int host_turn(Host *host, Mission *mission) {
+    unsigned long long events = mission->manager.events_handled;
+    int stepped;
+
+    manager_run(&mission->manager);
+    events = mission->manager.events_handled - events;
+
+    stepped = scheduler_poll(&mission->scheduler);
+    if (stepped < 0) {
+        host_end_mission(host, mission);
+        return (int)events + 1;
+    }
+
+    mission->steps += stepped;
+    return (int)events + stepped;
+}
+
+/**
+ * Marks a mission whose systems have all terminated as ended and records how it ended.
+ *
+ * @param[in,out] host     Pointer to the `Host`.
+ * @param[in,out] mission  Pointer to the `Mission`.
+ */
+static void host_end_mission(Host *host, Mission *mission) {
+    mission->ended_ns = clock_now_ns();
+    mission->outcome = host_outcome(mission);
+    __atomic_store_n(&mission->state, MISSION_ENDED, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&host->live, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Works out how a mission ended from its resources.
+ *
+ * @param[in] mission  Pointer to the `Mission`, whose systems have all terminated.
+ * @return             MISSION_OUTCOME_ of how it ended.
+ */
+static int host_outcome(Mission *mission) {
+    Resource *resource;
+
+    for (int i = 0; i < mission->manager.resource_array.size; i++) {
+        resource = mission->manager.resource_array.resources[i];
+        if (strcmp(resource->name, FORECAST_DESTINATION) == 0 && resource_read_amount(resource) >= resource->max_capacity) {
+            return MISSION_OUTCOME_DESTINATION;
+        }
+        if (strcmp(resource->name, FORECAST_OXYGEN) == 0 && resource_read_amount(resource) <= 0) {
+            return MISSION_OUTCOME_NO_OXYGEN;
+        }
+    }
+    return MISSION_OUTCOME_STOPPED;
+}
+
+/**
+ * Prints how the missions ended and how the workers' time was shared between them.
+ *
+ * Each mission is listed when there are only a few, otherwise only the totals are.
+ *
+ * @param[in] host        Pointer to the `Host`, once its workers have stopped.
+ * @param[in] elapsed_ns  Wall time the host ran for.
+ */
+void host_print(Host *host, long long elapsed_ns) {
+    Mission *mission;
+    const char *outcomes[] = { "running", "destination", "no oxygen", "stopped" };
+    int counts[4] = { 0, 0, 0, 0 };
+    long long busy_total = 0, busy_min = -1, busy_max = 0, duration_total = 0;
+    unsigned long long steps = 0, events = 0;
+    int ended = 0;
+
+    printf("\nHosted Missions:\n");
+    printf("-------------------------\n");
+
+    for (int i = 0; i < host->mission_count; i++) {
+        mission = host->missions[i];
+        counts[mission->outcome]++;
+        steps += mission->steps;
+        events += mission->manager.events_handled;
+        busy_total += mission->busy_ns;
+        if (busy_min < 0 || mission->busy_ns < busy_min) {
+            busy_min = mission->busy_ns;
+        }
+        if (mission->busy_ns > busy_max) {
+            busy_max = mission->busy_ns;
+        }
+        if (mission->ended_ns > 0) {
+            duration_total += mission->ended_ns - mission->started_ns;
+            ended++;
+        }
+
+        if (host->mission_count <= 16) {
+            printf("Mission %-4d: %-11s after %7.1f ms, %6llu turns, %7llu steps, %6llu events, %8.1f ms of worker time\n",
+                   mission->id, outcomes[mission->outcome],
+                   mission->ended_ns > 0 ? (mission->ended_ns - mission->started_ns) / 1e6 : 0.0,
+                   mission->turns, mission->steps, mission->manager.events_handled, mission->busy_ns / 1e6);
+        }
+    }
+
+    printf("%d missions on %d workers: %d reached their destination, %d ran out of oxygen, %d stopped, %d still running\n",
+           host->mission_count, host->worker_count, counts[MISSION_OUTCOME_DESTINATION], counts[MISSION_OUTCOME_NO_OXYGEN],
+           counts[MISSION_OUTCOME_STOPPED], counts[MISSION_OUTCOME_NONE]);
+    printf("Average mission: %.1f ms, %.0f steps, %.0f events, worker time %.2f ms (least %.2f ms, most %.2f ms)\n",
+           ended > 0 ? duration_total / 1e6 / ended : 0.0, (double)steps / host->mission_count,
+           (double)events / host->mission_count, busy_total / 1e6 / host->mission_count, busy_min / 1e6, busy_max / 1e6);
+    printf("Workers were busy %.1f%% of %.2f s\n",
+           elapsed_ns > 0 ? 100.0 * busy_total / ((double)elapsed_ns * host->worker_count) : 0.0, elapsed_ns / 1e9);
+}
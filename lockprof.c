@@ -0,0 +1,325 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// The lock profiler records how each `Resource` and `EventQueue` lock is used: how often it is
+// taken, how often it was already held, how long callers waited and how long it was held. Each wait
+// is also charged to the `System` the calling thread is running (or to the manager and other
+// threads when it runs none), so the report shows both the hottest locks and who waits on them.
+//
+// A lock's own counters are only written while it is held, so they need no extra synchronization
+// beyond being atomic for a report taken mid-run. Waits by threads running no system share one
+// set of counters and are added atomically.
+
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+
+#define LOCKPROF_REPORT_ROWS 10   // Locks and waiters listed in each part of the report
+#define LOCKPROF_NAME_LENGTH 24   // Longest name made up for a shard queue, including the terminator
+
+// Helper functions just used by this C file
+
+static void lockprof_signal(int signal_number);
+static void lockprof_add(unsigned long long *counter, unsigned long long value);
+static void lockprof_max(unsigned long long *counter, unsigned long long value);
+static void lockprof_record(LockStats *stats, long long start, int contended);
+static int lockprof_compare(const void *a, const void *b);
+static void lockprof_print_rows(LockprofRow *rows, int count, int show_hold);
+
+// The system the calling thread is running, NULL for the manager and other threads
+static __thread System *lockprof_current = NULL;
+
+// Waits by threads that are not running a system
+static LockStats lockprof_other;
+
+// Set by SIGUSR1, cleared once the manager prints the report
+static volatile sig_atomic_t lockprof_requested = 0;
+
+/**
+ * Turns on profiling for every resource lock and event queue lock, including the queues and
+ * inboxes of any manager shards.
+ *
+ * Must be called before any thread takes those locks. Resources added later are profiled
+ * as they are added. Sending SIGUSR1 asks the manager to print a report.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+void lockprof_enable(Manager *manager) {
+    struct sigaction action;
+
+    manager->lockprof = 1;
+    manager->event_queue.profiled = 1;
+    for (int i = 0; i < manager->shard_count; i++) {
+        manager->shards[i].own_queue.profiled = 1;
+        manager->shards[i].inbox.profiled = 1;
+    }
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        manager->resource_array.resources[i]->profiled = 1;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = lockprof_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+/**
+ * Acquires a lock, recording whether it was contended and how long the wait took.
+ *
+ * @param[in,out] mutex  Semaphore to acquire.
+ * @param[in,out] stats  Counters of the lock.
+ */
+void lockprof_acquire(sem_t *mutex, LockStats *stats) {
+    long long start = clock_now_ns();
+    int contended = 0;
+
+    if (sem_trywait(mutex) != 0) {
+        contended = 1;
+        sem_wait(mutex);
+    }
+    lockprof_record(stats, start, contended);
+}
+
+/**
+ * Tries to acquire a lock without waiting, recording the acquisition if it succeeds.
+ *
+ * A try that finds the lock held is not recorded, since the lock's counters are only written while it is held.
+ *
+ * @param[in,out] mutex  Semaphore to acquire.
+ * @param[in,out] stats  Counters of the lock.
+ * @return               0 if the lock was acquired, -1 if it is held.
+ */
+int lockprof_try_acquire(sem_t *mutex, LockStats *stats) {
+    long long start = clock_now_ns();
+
+    if (sem_trywait(mutex) != 0) {
+        return -1;
+    }
+    lockprof_record(stats, start, 0);
+    return 0;
+}
+
+/**
+ * Releases a lock acquired with `lockprof_acquire`, recording how long it was held.
+ *
+ * @param[in,out] mutex  Semaphore to release.
+ * @param[in,out] stats  Counters of the lock.
+ */
+void lockprof_release(sem_t *mutex, LockStats *stats) {
+    unsigned long long hold = (unsigned long long)(clock_now_ns() - stats->acquired_ns);
+
+    __atomic_store_n(&stats->hold_ns, stats->hold_ns + hold, __ATOMIC_RELAXED);
+    if (hold > stats->max_hold_ns) {
+        __atomic_store_n(&stats->max_hold_ns, hold, __ATOMIC_RELAXED);
+    }
+    sem_post(mutex);
+}
+
+/**
+ * Sets which system the calling thread is running, so its waits are charged to that system.
+ *
+ * @param[in] system  Pointer to the `System`, or NULL when the thread stops running one.
+ */
+void lockprof_set_current(System *system) {
+    lockprof_current = system;
+}
+
+/**
+ * Checks whether a report was asked for with SIGUSR1, clearing the request.
+ *
+ * @return  non-zero if a report should be printed.
+ */
+int lockprof_report_requested(void) {
+    if (!lockprof_requested) {
+        return 0;
+    }
+    lockprof_requested = 0;
+    return 1;
+}
+
+/**
+ * Prints the hottest locks and the systems that waited the longest, ranked by total wait.
+ *
+ * @param[in] manager  Pointer to the `Manager`.
+ */
+void lockprof_print(Manager *manager) {
+    ResourceArray *resource_arrays[2] = { &manager->resource_array, &manager->removed_resources };
+    SystemArray *system_arrays[2] = { &manager->system_array, &manager->removed_systems };
+    Resource **resources;
+    System **systems;
+    LockprofRow *rows;
+    char (*names)[LOCKPROF_NAME_LENGTH] = NULL;
+    int count = 0, capacity = 2 + 2 * manager->shard_count, size, a, i;
+
+    for (a = 0; a < 2; a++) {
+        capacity += resource_arrays[a]->size + system_arrays[a]->size;
+    }
+    rows = (LockprofRow *)malloc(sizeof(LockprofRow) * capacity);
+    if (manager->shard_count > 0) {
+        names = (char (*)[LOCKPROF_NAME_LENGTH])malloc(sizeof(*names) * 2 * manager->shard_count);
+    }
+    if (rows == NULL || (manager->shard_count > 0 && names == NULL)) {
+        free(rows);
+        free(names);
+        return;
+    }
+
+    // Locks, shard 0 handles the manager's own event queue
+    rows[count].name = "Event queue";
+    rows[count++].stats = &manager->event_queue.lock_stats;
+    for (i = 0; i < manager->shard_count; i++) {
+        if (i > 0) {
+            snprintf(names[2 * i], LOCKPROF_NAME_LENGTH, "Shard %d queue", i);
+            rows[count].name = names[2 * i];
+            rows[count++].stats = &manager->shards[i].own_queue.lock_stats;
+        }
+        snprintf(names[2 * i + 1], LOCKPROF_NAME_LENGTH, "Shard %d inbox", i);
+        rows[count].name = names[2 * i + 1];
+        rows[count++].stats = &manager->shards[i].inbox.lock_stats;
+    }
+    for (a = 0; a < 2; a++) {
+        size = resource_array_snapshot(resource_arrays[a], &resources);
+        for (i = 0; i < size && count < capacity; i++) {
+            rows[count].name = resources[i]->name;
+            rows[count++].stats = &resources[i]->lock_stats;
+        }
+    }
+
+    printf("Lock contention (hottest first):\n");
+    printf("%-20s %12s %10s %12s %12s %12s %12s\n", "Lock", "Acquired", "Contended", "Wait ms", "Max wait us", "Avg hold us", "Max hold us");
+    lockprof_print_rows(rows, count, 1);
+
+    // Waiters
+    count = 0;
+    rows[count].name = "(manager/other)";
+    rows[count++].stats = &lockprof_other;
+    for (a = 0; a < 2; a++) {
+        size = system_array_snapshot(system_arrays[a], &systems);
+        for (i = 0; i < size && count < capacity; i++) {
+            rows[count].name = systems[i]->name;
+            rows[count++].stats = &systems[i]->lock_waits;
+        }
+    }
+
+    printf("\nLock waits by caller (longest first):\n");
+    printf("%-20s %12s %10s %12s %12s\n", "Waiter", "Acquired", "Contended", "Wait ms", "Max wait us");
+    lockprof_print_rows(rows, count, 0);
+    printf("\n");
+
+    free(rows);
+    free(names);
+}
+
+/**
+ * Records that a report was asked for. Only sets a flag, which is all a signal handler may safely do.
+ *
+ * @param[in] signal_number  The signal received.
+ */
+static void lockprof_signal(int signal_number) {
+    (void)signal_number;
+    lockprof_requested = 1;
+}
+
+/**
+ * Atomically adds to a counter shared by several threads.
+ *
+ * @param[in,out] counter  Counter to add to.
+ * @param[in]     value    Amount to add.
+ */
+static void lockprof_add(unsigned long long *counter, unsigned long long value) {
+    if (value != 0) {
+        __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Atomically raises a maximum shared by several threads.
+ *
+ * @param[in,out] counter  Maximum to raise.
+ * @param[in]     value    Candidate value.
+ */
+static void lockprof_max(unsigned long long *counter, unsigned long long value) {
+    unsigned long long current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+    while (value > current && !__atomic_compare_exchange_n(counter, &current, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * Records an acquisition of a lock that is now held, in its counters and in those of the waiter.
+ *
+ * @param[in,out] stats      Counters of the lock.
+ * @param[in]     start      Time the caller started to acquire it.
+ * @param[in]     contended  Whether it was already held.
+ */
+static void lockprof_record(LockStats *stats, long long start, int contended) {
+    LockStats *waiter = (lockprof_current != NULL) ? &lockprof_current->lock_waits : &lockprof_other;
+    long long acquired = clock_now_ns();
+    unsigned long long wait = (unsigned long long)(acquired - start);
+
+    // The lock is held now, so its own counters have a single writer
+    __atomic_store_n(&stats->acquisitions, stats->acquisitions + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->contended, stats->contended + contended, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats->wait_ns, stats->wait_ns + wait, __ATOMIC_RELAXED);
+    if (wait > stats->max_wait_ns) {
+        __atomic_store_n(&stats->max_wait_ns, wait, __ATOMIC_RELAXED);
+    }
+    stats->acquired_ns = acquired;
+
+    lockprof_add(&waiter->acquisitions, 1);
+    lockprof_add(&waiter->contended, contended);
+    lockprof_add(&waiter->wait_ns, wait);
+    lockprof_max(&waiter->max_wait_ns, wait);
+}
+
+/**
+ * Orders report rows by total wait, longest first, then by acquisitions.
+ *
+ * @param[in] a  Pointer to a `LockprofRow`.
+ * @param[in] b  Pointer to a `LockprofRow`.
+ * @return       Negative if `a` ranks first, positive if `b` does.
+ */
+static int lockprof_compare(const void *a, const void *b) {
+    const LockStats *first = ((const LockprofRow *)a)->stats;
+    const LockStats *second = ((const LockprofRow *)b)->stats;
+    unsigned long long first_wait = __atomic_load_n(&first->wait_ns, __ATOMIC_RELAXED);
+    unsigned long long second_wait = __atomic_load_n(&second->wait_ns, __ATOMIC_RELAXED);
+
+    if (first_wait != second_wait) {
+        return (first_wait > second_wait) ? -1 : 1;
+    }
+    return (first->acquisitions > second->acquisitions) ? -1 : (first->acquisitions < second->acquisitions);
+}
+
+/**
+ * Sorts report rows and prints the top `LOCKPROF_REPORT_ROWS` of them.
+ *
+ * @param[in,out] rows       Rows to rank.
+ * @param[in]     count      Number of rows.
+ * @param[in]     show_hold  non-zero to include hold times, which are only kept for locks.
+ */
+static void lockprof_print_rows(LockprofRow *rows, int count, int show_hold) {
+    unsigned long long acquisitions, contended;
+
+    qsort(rows, count, sizeof(LockprofRow), lockprof_compare);
+
+    for (int i = 0; i < count && i < LOCKPROF_REPORT_ROWS; i++) {
+        acquisitions = __atomic_load_n(&rows[i].stats->acquisitions, __ATOMIC_RELAXED);
+        contended = __atomic_load_n(&rows[i].stats->contended, __ATOMIC_RELAXED);
+        if (acquisitions == 0) {
+            continue;
+        }
+
+        printf("%-20s %12llu %9.1f%% %12.3f %12.1f", rows[i].name, acquisitions, 100.0 * contended / acquisitions,
+               __atomic_load_n(&rows[i].stats->wait_ns, __ATOMIC_RELAXED) / 1e6,
+               __atomic_load_n(&rows[i].stats->max_wait_ns, __ATOMIC_RELAXED) / 1e3);
+        if (show_hold) {
+            printf(" %12.2f %12.1f", __atomic_load_n(&rows[i].stats->hold_ns, __ATOMIC_RELAXED) / 1e3 / acquisitions,
+                   __atomic_load_n(&rows[i].stats->max_hold_ns, __ATOMIC_RELAXED) / 1e3);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,284 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// The log takes printing off the manager's event loop. Records are fixed-size entries written into
+// a bounded lock-free ring, which any thread may write to: a writer claims a slot by advancing the
+// tail with a compare-and-swap and marks it ready through the slot's sequence number. A single writer
+// thread formats ready records and writes them out in batches with `writev`, so a slow terminal or
+// a full pipe only ever holds up that thread. When the ring is full a record is dropped rather than
+// waited for, and the number dropped is reported in the output.
+//
+// Until the writer is started, or once it is stopped, records are printed straight away.
+
+#include "defs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+// Helper functions just used by this C file
+
+static void *log_thread(void *arg);
+static int log_drain(Log *log);
+static int log_format(const LogRecord *record, char *line);
+static void log_writev(Log *log, struct iovec *vectors, int count);
+
+/**
+ * Initializes a `Log` that prints records straight away until it is started.
+ *
+ * @param[out] log    Pointer to the `Log` to initialize.
+ * @param[in]  level  Highest LOG_LEVEL_ to record.
+ */
+void log_init(Log *log, int level) {
+    log->head = 0;
+    log->tail = 0;
+    log->dropped = 0;
+    log->reported = 0;
+    log->level = level;
+    log->fd = STDOUT_FILENO;
+    log->running = 0;
+    log->records = NULL;
+}
+
+/**
+ * Starts the writer thread, after which records go through the ring.
+ *
+ * @param[in,out] log  Pointer to the `Log`.
+ * @param[in]     fd   File descriptor to write to.
+ * @return             0 on success, -1 if the ring or thread could not be created (records keep being printed directly).
+ */
+int log_start(Log *log, int fd) {
+    log->records = (LogRecord *)malloc(sizeof(LogRecord) * LOG_RING_SIZE);
+    if (log->records == NULL) {
+        return -1;
+    }
+
+    // A slot is free for position p while its sequence is p, and ready to read once it is p + 1
+    for (unsigned long long i = 0; i < LOG_RING_SIZE; i++) {
+        log->records[i].sequence = i;
+    }
+    log->head = 0;
+    log->tail = 0;
+    log->fd = fd;
+
+    // Anything printed with stdio so far goes out before the first batch
+    fflush(stdout);
+
+    __atomic_store_n(&log->running, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&log->thread, NULL, log_thread, log) != 0) {
+        log->running = 0;
+        free(log->records);
+        log->records = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Stops the writer thread once it has written every record already in the ring.
+ *
+ * Must be called before the systems and resources named by the records are freed.
+ *
+ * @param[in,out] log  Pointer to the `Log`.
+ */
+void log_stop(Log *log) {
+    if (log->records == NULL) {
+        return;
+    }
+
+    __atomic_store_n(&log->running, 0, __ATOMIC_RELEASE);
+    pthread_join(log->thread, NULL);
+
+    free(log->records);
+    log->records = NULL;
+}
+
+/**
+ * Records a log entry without waiting, dropping it if the ring is full.
+ *
+ * @param[in,out] log       Pointer to the `Log`.
+ * @param[in]     level     LOG_LEVEL_ of the entry, skipped if above the log's level.
+ * @param[in]     kind      LOG_KIND_ of the entry.
+ * @param[in]     system    System the entry is about, or NULL.
+ * @param[in]     resource  Resource the entry is about, or NULL.
+ * @param[in]     amount    Amount of the resource.
+ * @param[in]     status    Status reported.
+ */
+void log_write(Log *log, int level, int kind, System *system, Resource *resource, int amount, int status) {
+    LogRecord local, *record;
+    char line[LOG_LINE_LENGTH];
+    unsigned long long position, sequence;
+
+    if (level > log->level) {
+        return;
+    }
+
+    // Not started, print it here as before
+    if (!__atomic_load_n(&log->running, __ATOMIC_ACQUIRE)) {
+        local.kind = kind;
+        local.system = system;
+        local.resource = resource;
+        local.amount = amount;
+        local.status = status;
+        log_format(&local, line);
+        fputs(line, stdout);
+        return;
+    }
+
+    // Claim the slot at the tail, unless the writer has not freed it yet
+    position = __atomic_load_n(&log->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        record = &log->records[position & (LOG_RING_SIZE - 1)];
+        sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+
+        if (sequence == position) {
+            if (__atomic_compare_exchange_n(&log->tail, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+        else if (sequence < position) {
+            __atomic_fetch_add(&log->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else {
+            position = __atomic_load_n(&log->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    record->kind = kind;
+    record->system = system;
+    record->resource = resource;
+    record->amount = amount;
+    record->status = status;
+    __atomic_store_n(&record->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Writes out records until the log is stopped and the ring is empty.
+ *
+ * @param[in] arg  Pointer to the `Log` object.
+ * @return    NULL once stopped.
+ */
+static void *log_thread(void *arg) {
+    Log *log = (Log *)arg;
+    struct timespec pause = { 0, LOG_POLL_TIME * 1000000L };
+
+    while (__atomic_load_n(&log->running, __ATOMIC_ACQUIRE)) {
+        if (log_drain(log) == 0) {
+            nanosleep(&pause, NULL);
+        }
+    }
+
+    // A writer may have claimed a slot just before the stop, its record is still written out
+    while (log_drain(log) > 0) {
+    }
+
+    return NULL;
+}
+
+/**
+ * Formats up to `LOG_BATCH` ready records and writes them with a single `writev`, along with a
+ * line for any records dropped since the last report.
+ *
+ * @param[in,out] log  Pointer to the `Log`.
+ * @return             Number of records written out.
+ */
+static int log_drain(Log *log) {
+    char lines[LOG_BATCH + 1][LOG_LINE_LENGTH];
+    struct iovec vectors[LOG_BATCH + 1];
+    LogRecord *record;
+    unsigned long long dropped;
+    int count = 0, vector_count = 0;
+
+    while (count < LOG_BATCH) {
+        record = &log->records[log->head & (LOG_RING_SIZE - 1)];
+        if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != log->head + 1) {
+            break;
+        }
+
+        vectors[vector_count].iov_base = lines[vector_count];
+        vectors[vector_count].iov_len = log_format(record, lines[vector_count]);
+        vector_count++;
+        count++;
+
+        // Hand the slot back for the position one lap later
+        __atomic_store_n(&record->sequence, log->head + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        log->head++;
+    }
+
+    dropped = __atomic_load_n(&log->dropped, __ATOMIC_RELAXED);
+    if (dropped != log->reported) {
+        vectors[vector_count].iov_base = lines[vector_count];
+        vectors[vector_count].iov_len = snprintf(lines[vector_count], LOG_LINE_LENGTH,
+                                                 "Log: %llu records dropped so far, the ring was full\n", dropped);
+        vector_count++;
+        log->reported = dropped;
+    }
+
+    if (vector_count > 0) {
+        log_writev(log, vectors, vector_count);
+    }
+
+    return count;
+}
+
+/**
+ * Formats a record as a line of text, the same text the manager used to print directly.
+ *
+ * @param[in]  record  The record.
+ * @param[out] line    Buffer of `LOG_LINE_LENGTH` characters.
+ * @return             Length of the line.
+ */
+static int log_format(const LogRecord *record, char *line) {
+    int length;
+
+    if (record->kind == LOG_KIND_NO_OXYGEN) {
+        length = snprintf(line, LOG_LINE_LENGTH, "Oxygen depleted. Terminating all systems.\n");
+    }
+    else if (record->kind == LOG_KIND_DESTINATION) {
+        length = snprintf(line, LOG_LINE_LENGTH, "Destination reached. Terminating all systems.\n");
+    }
+    else {
+        length = snprintf(line, LOG_LINE_LENGTH, "Event: [%s] Reported Resource [%s : %d] Status [%d]\n",
+                          record->system->name, record->resource->name, record->amount, record->status);
+    }
+
+    // A truncated line still ends the way it would have
+    if (length >= LOG_LINE_LENGTH) {
+        length = LOG_LINE_LENGTH - 1;
+        line[length - 1] = '\n';
+    }
+    return length;
+}
+
+/**
+ * Writes every vector out, continuing after a partial write. Gives up if the output fails.
+ *
+ * @param[in]     log      Pointer to the `Log`.
+ * @param[in,out] vectors  Lines to write, adjusted as they are written.
+ * @param[in]     count    Number of vectors.
+ */
+static void log_writev(Log *log, struct iovec *vectors, int count) {
+    ssize_t written;
+
+    while (count > 0) {
+        written = writev(log->fd, vectors, count);
+        if (written < 0) {
+            return;
+        }
+
+        // Skip the vectors written in full, and the written part of the next one
+        while (count > 0 && (size_t)written >= vectors->iov_len) {
+            written -= vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if (count > 0) {
+            vectors->iov_base = (char *)vectors->iov_base + written;
+            vectors->iov_len -= written;
+        }
+    }
+}
@@ -6,30 +6,383 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
 
 void load_data(Manager *manager);
+static int run_tick_engine(Manager *manager, int duration_ms, int replicas);
+static int run_monitor(const char *telemetry_name);
+static int run_host(int mission_count, int worker_count, int seconds);
+static void finish_history(History *history, int history_ms, const char *history_csv);
+static int parse_sizes(const char *text, int *sizes, int max_sizes);
+static int parse_distribution(const char *text);
 
-int main(void) {
+int main(int argc, char *argv[]) {
     Manager manager;
+    FlowAnalysis analysis;
+    int analyze_only = 0;
+    int control_mode = CONTROL_STATUS;
+    int use_wheel = 0;
+    int tick_ms = 0, tick_replicas = 1;
+    int monitor_only = 0;
+    int partitions = 0;
+    int reserve_output = 0;
+    int lock_profile = 0;
+    const char *control_path = NULL;
+    int history_ms = 0, history_chunks = HISTORY_DEFAULT_CHUNKS;
+    const char *history_csv = NULL;
+    const char *telemetry_name = NULL;
+    ScenarioConfig scenario;
+    int bench_sizes[BENCH_MAX_SIZES];
+    int bench_count = 0, bench_seconds = BENCH_DEFAULT_SECONDS;
+    int use_affinity = 0, affinity_nodes = 0;
+    int log_level = LOG_LEVEL_EVENTS;
+    int forecast_ms = 0;
+    int shards = 1;
+    int shard_hot = 0;
+    int host_missions = 0, host_workers = 0, host_seconds = HOST_DEFAULT_SECONDS;
+    Affinity affinity;
+    Scheduler scheduler;
+    Cluster cluster;
+    Control control;
+    History history;
+    Forecast forecast;
+
+    scenario_config_init(&scenario);
+
+    // parse the command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--analyze") == 0) {
+            analyze_only = 1;
+        } else if (strcmp(argv[i], "--pid") == 0) {
+            control_mode = CONTROL_PID;
+        } else if (strcmp(argv[i], "--wheel") == 0) {
+            use_wheel = 1;
+        } else if (strcmp(argv[i], "--tick") == 0 && i + 1 < argc) {
+            tick_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tick-replicas") == 0 && i + 1 < argc) {
+            tick_replicas = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+            telemetry_name = argv[++i];
+        } else if (strcmp(argv[i], "--monitor") == 0) {
+            monitor_only = 1;
+        } else if (strcmp(argv[i], "--partitions") == 0 && i + 1 < argc) {
+            partitions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--lockprof") == 0) {
+            lock_profile = 1;
+        } else if (strcmp(argv[i], "--reserve") == 0) {
+            reserve_output = 1;
+        } else if (strcmp(argv[i], "--control") == 0 && i + 1 < argc) {
+            control_path = argv[++i];
+        } else if (strcmp(argv[i], "--history-ms") == 0 && i + 1 < argc) {
+            history_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--history-chunks") == 0 && i + 1 < argc) {
+            history_chunks = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--history-csv") == 0 && i + 1 < argc) {
+            history_csv = argv[++i];
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            log_level = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            shards = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shard-hot") == 0 && i + 1 < argc) {
+            shard_hot = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
+            host_missions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--host-workers") == 0 && i + 1 < argc) {
+            host_workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--host-seconds") == 0 && i + 1 < argc) {
+            host_seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--forecast-ms") == 0 && i + 1 < argc) {
+            forecast_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--affinity") == 0) {
+            use_affinity = 1;
+        } else if (strcmp(argv[i], "--affinity-nodes") == 0 && i + 1 < argc) {
+            use_affinity = 1;
+            affinity_nodes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench_count = parse_sizes(argv[++i], bench_sizes, BENCH_MAX_SIZES);
+            if (bench_count == 0) {
+                fprintf(stderr, "Invalid benchmark sizes %s, expected SIZE[,SIZE...] of positive numbers\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bench-seconds") == 0 && i + 1 < argc) {
+            bench_seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            scenario.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--fan-in") == 0 && i + 1 < argc) {
+            scenario.fan_in = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fan-out") == 0 && i + 1 < argc) {
+            scenario.fan_out = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            scenario.depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hot") == 0 && i + 1 < argc) {
+            scenario.hot = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hot-share") == 0 && i + 1 < argc) {
+            scenario.hot_share = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pt-mean") == 0 && i + 1 < argc) {
+            scenario.pt_mean = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pt-dist") == 0 && i + 1 < argc) {
+            scenario.pt_distribution = parse_distribution(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--analyze] [--pid] [--wheel] [--tick MS [--tick-replicas N]] [--telemetry NAME] [--monitor] [--partitions N] [--reserve] [--lockprof] [--control PATH] [--history-ms MS] [--history-chunks N] [--history-csv PATH] [--affinity] [--affinity-nodes N] [--log-level 0-2] [--forecast-ms MS] [--shards N] [--shard-hot USERS]\n", argv[0]);
+            fprintf(stderr, "       %s --bench SIZE[,SIZE...] [--bench-seconds S] [--wheel] [--shards N] [--seed N] [--fan-in N] [--fan-out N] [--depth N] [--hot N] [--hot-share PERCENT] [--pt-mean MS] [--pt-dist uniform|exponential|bimodal]\n", argv[0]);
+            fprintf(stderr, "       %s --host MISSIONS [--host-workers N] [--host-seconds S]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // watch a simulation running in another process instead of running one
+    if (monitor_only) {
+        return run_monitor(telemetry_name != NULL ? telemetry_name : TELEMETRY_DEFAULT_NAME);
+    }
+
+    // run generated scenarios of each size instead of the sample data
+    if (bench_count > 0) {
+        if (scenario.pt_distribution < 0 || bench_seconds <= 0) {
+            fprintf(stderr, "Invalid benchmark settings\n");
+            return 1;
+        }
+        return bench_run(&scenario, bench_sizes, bench_count, bench_seconds, use_wheel, shards);
+    }
+
+    // run many copies of the sample data side by side on a shared pool of workers
+    if (host_missions > 0) {
+        if (host_workers <= 0) {
+            host_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        }
+        return run_host(host_missions, host_workers, host_seconds);
+    }
+
     manager_init(&manager);
+    manager.control_mode = control_mode;
+    manager.reserve_output = reserve_output;
+    manager.log.level = log_level;
     load_data(&manager);
+    for (int i = 0; i < manager.system_array.size; i++) {
+        system_set_reserve_output(manager.system_array.systems[i], reserve_output);
+    }
+
+    // analyze the resource flow graph to choose initial statuses before anything runs
+    flow_analysis_init(&analysis, &manager);
+    flow_analysis_apply(&analysis, &manager);
+    if (analyze_only) {
+        flow_analysis_print(&analysis, &manager);
+        flow_analysis_clean(&analysis);
+        if (use_affinity && affinity_init(&affinity, &manager, affinity_nodes) == 0) {
+            affinity_print(&affinity);
+            affinity_clean(&affinity);
+        }
+        if (partitions > 0 && cluster_init(&cluster, &manager, partitions) == 0) {
+            cluster_print(&cluster);
+            cluster_clean(&cluster);
+        }
+        manager_clean(&manager);
+        return 0;
+    }
+    flow_analysis_clean(&analysis);
+
+    // hand the chosen rates over to the controller, which adjusts them from here on
+    if (manager.control_mode == CONTROL_PID) {
+        controller_init(&manager.controller, &manager);
+    }
+
+    // run the scenario in the lockstep engine instead of live
+    if (tick_ms > 0) {
+        int result = run_tick_engine(&manager, tick_ms, tick_replicas);
+        manager_clean(&manager);
+        return result;
+    }
+
+    // place systems on cores and resources on NUMA nodes, before anything takes pointers to the resources
+    if (use_affinity && partitions == 0) {
+        if (affinity_init(&affinity, &manager, affinity_nodes) != 0) {
+            fprintf(stderr, "Could not read the CPU topology, threads will float\n");
+            use_affinity = 0;
+        } else if (affinity_apply(&affinity, &manager) != 0) {
+            fprintf(stderr, "Some resources could not be moved to their node\n");
+        }
+    }
+
+    // split event handling across manager shards, each owning some resources and their producers
+    if (shards > 1 && (partitions > 0 || manager_shard(&manager, shards) != 0)) {
+        fprintf(stderr, "Could not split the manager into %d shards, using one\n", shards);
+    }
+
+    // split resources shared by many systems into local pools, which only meet when one runs dry or fills
+    if (shard_hot > 0 && partitions > 0) {
+        fprintf(stderr, "Resources cannot be pooled with partitions\n");
+        shard_hot = 0;
+    } else if (shard_hot > 0) {
+        int pooled = manager_pool_resources(&manager, shard_hot);
+        if (pooled == -1) {
+            fprintf(stderr, "Resources cannot be pooled with --reserve\n");
+            shard_hot = 0;
+        } else if (pooled == -2) {
+            fprintf(stderr, "Not enough memory to pool every resource used by %d systems\n", shard_hot);
+        } else if (pooled == 0) {
+            fprintf(stderr, "No resource is used by %d systems, nothing was pooled\n", shard_hot);
+            shard_hot = 0;
+        }
+    }
+
+    // publish amounts and statuses for the display, and for external monitors when given a name
+    int telemetry_result = telemetry_init(&manager.telemetry, telemetry_name, &manager);
+    if (telemetry_result == -2) {
+        fprintf(stderr, "Telemetry name %s is already in use, not publishing under it\n", telemetry_name);
+        telemetry_result = telemetry_init(&manager.telemetry, NULL, &manager);
+    }
+    if (telemetry_result != 0) {
+        fprintf(stderr, "Telemetry unavailable, displaying live values\n");
+    }
+
+    // record contention on the resource and event queue locks, reported at exit or on SIGUSR1
+    if (lock_profile) {
+        lockprof_enable(&manager);
+    }
 
-    // create the manager thread
     pthread_t manager_t;
+
+    // record the levels and statuses over time, the CSV export implies recording
+    if (history_csv != NULL && history_ms <= 0) {
+        history_ms = HISTORY_DEFAULT_RESOLUTION;
+    }
+    history.running = 0;
+    if (history_ms > 0 && history_init(&history, &manager, history_ms, history_chunks) != 0) {
+        fprintf(stderr, "Invalid history settings\n");
+        history_ms = 0;
+    }
+
+    // forecasts read the systems and resources in this process, which partitions take elsewhere
+    forecast.running = 0;
+    if (forecast_ms > 0 && partitions > 0) {
+        fprintf(stderr, "Forecasts are unavailable with partitions\n");
+        forecast_ms = 0;
+    } else if (forecast_ms > 0 && forecast_init(&forecast, &manager, forecast_ms, FORECAST_HORIZON_MS) != 0) {
+        fprintf(stderr, "Invalid forecast interval %d ms\n", forecast_ms);
+        forecast_ms = 0;
+    }
+
+    if (partitions > 0) {
+        // split the systems across partition processes, which must be forked before any thread starts
+        if (cluster_init(&cluster, &manager, partitions) != 0) {
+            fprintf(stderr, "Could not start %d partitions\n", partitions);
+            manager_clean(&manager);
+            return 1;
+        }
+        if (cluster_start(&cluster) != 0) {
+            fprintf(stderr, "Could not start %d partitions\n", partitions);
+            cluster_clean(&cluster);
+            manager_clean(&manager);
+            return 1;
+        }
+
+        // print events from a writer thread so the manager never waits on the terminal, now the partitions are forked
+        if (log_start(&manager.log, STDOUT_FILENO) != 0) {
+            fprintf(stderr, "Could not start the log writer, printing events directly\n");
+        }
+
+        // the manager stays here and steers the partitions through the cluster
+        if (history_ms > 0) {
+            history_start(&history);
+        }
+        pthread_create(&manager_t, NULL, manager_thread, &manager);
+        pthread_join(manager_t, NULL);
+        log_stop(&manager.log);
+
+        cluster_stop(&cluster);
+        finish_history(&history, history_ms, history_csv);
+        if (lock_profile) {
+            lockprof_print(&manager);
+        }
+        cluster_clean(&cluster);
+        manager_clean(&manager);
+        return 0;
+    }
+
+    // print events from a writer thread so the manager never waits on the terminal
+    if (log_start(&manager.log, STDOUT_FILENO) != 0) {
+        fprintf(stderr, "Could not start the log writer, printing events directly\n");
+    }
+
+    if (history_ms > 0) {
+        history_start(&history);
+    }
+
+    // the scheduler and forecast must be in place before the manager can reach them
+    if (use_wheel) {
+        scheduler_init(&scheduler, &manager);
+    }
+    if (forecast_ms > 0) {
+        manager.forecast = &forecast;
+    }
+
+    // create the manager thread, and one for each further shard
     pthread_create(&manager_t, NULL, manager_thread, &manager);
+    manager_start_shards(&manager);
 
-    // create one thread for each system in the system array
-    pthread_t system_t[manager.system_array.size];
-    for (int i = 0; i < manager.system_array.size; i++) {
-        pthread_create(&system_t[i], NULL, system_thread, manager.system_array.systems[i]);
+    if (use_wheel) {
+        // drive every system from a single scheduler thread instead of one thread each
+        pthread_create(&scheduler.thread, NULL, scheduler_thread, &scheduler);
+        if (use_affinity) {
+            affinity_pin_thread(scheduler.thread, affinity.nodes[affinity.busiest_node].cpus,
+                                affinity.nodes[affinity.busiest_node].cpu_count);
+        }
+    } else {
+        // create one thread for each system in the system array, each system keeps its own thread
+        for (int i = 0; i < manager.system_array.size; i++) {
+            manager_spawn_system(&manager, manager.system_array.systems[i]);
+        }
+    }
+
+    // run the rest of the mission ahead in the background and show when it will end
+    if (forecast_ms > 0) {
+        if (forecast_start(&forecast) != 0) {
+            fprintf(stderr, "Could not start forecasting\n");
+        }
     }
 
-    // wait for the manager thread to finish
+    // accept commands that add and remove systems and resources while running
+    control.running = 0;
+    if (control_path != NULL && control_start(&control, &manager, control_path) != 0) {
+        fprintf(stderr, "Could not listen for commands on %s\n", control_path);
+    }
+
+    // wait for the manager thread to finish, then stop taking commands so no more systems appear
     pthread_join(manager_t, NULL);
+    manager_join_shards(&manager);
+    log_stop(&manager.log);
+    control_stop(&control);
+    if (forecast_ms > 0) {
+        forecast_stop(&forecast);
+    }
 
-    // wait for each system thread to finish
-    for (int i = 0; i < manager.system_array.size; i++) {
-        pthread_join(system_t[i], NULL);
+    if (use_wheel) {
+        // wait for the scheduler to see every system terminate
+        pthread_join(scheduler.thread, NULL);
+        scheduler_clean(&scheduler);
+    } else {
+        // wait for each system thread to finish, including systems removed along the way
+        manager_join_systems(&manager);
+    }
+
+    finish_history(&history, history_ms, history_csv);
+
+    if (lock_profile) {
+        lockprof_print(&manager);
+    }
+
+    if (use_affinity) {
+        affinity_print(&affinity);
+        affinity_clean(&affinity);
+    }
+
+    if (shard_hot > 0) {
+        manager_print_pools(&manager);
+    }
+
+    if (forecast_ms > 0) {
+        forecast_print(&forecast);
+        manager.forecast = NULL;
+        forecast_clean(&forecast);
     }
 
     manager_clean(&manager);
@@ -83,3 +436,189 @@ void load_data(Manager *manager) {
     system_array_add(&manager->system_array, crew_capsule_system);
     system_array_add(&manager->system_array, generator_system);
 }
+
+/**
+ * Runs the loaded scenario in the lockstep `TickEngine` for a span of virtual time and prints the outcome.
+ *
+ * @param[in] manager      Pointer to the `Manager` holding the scenario.
+ * @param[in] duration_ms  Virtual milliseconds to simulate.
+ * @param[in] replicas     Number of copies of the scenario to run side by side.
+ * @return                 0 on success, 1 if the engine could not be allocated.
+ */
+static int run_tick_engine(Manager *manager, int duration_ms, int replicas) {
+    TickEngine engine;
+    long long start_ns, elapsed_ns, ticks;
+
+    if (tick_engine_init(&engine, manager, replicas) != 0) {
+        fprintf(stderr, "Not enough memory for %d replicas\n", replicas);
+        return 1;
+    }
+
+    ticks = (long long)(duration_ms / TICK_ENGINE_DT_MS);
+    start_ns = clock_now_ns();
+    for (long long t = 0; t < ticks; t++) {
+        tick_engine_step(&engine);
+    }
+    elapsed_ns = clock_now_ns() - start_ns;
+
+    tick_engine_print(&engine, manager);
+    printf("Wall time: %.3f s, %.0f system updates/s\n", elapsed_ns / 1e9,
+           elapsed_ns > 0 ? (double)engine.system_count * ticks / (elapsed_ns / 1e9) : 0.0);
+
+    tick_engine_clean(&engine);
+    return 0;
+}
+
+/**
+ * Hosts many copies of the sample data in this process and prints how they went.
+ *
+ * Every mission is started at once, and any mission still running after `seconds` is stopped.
+ *
+ * @param[in] mission_count  Number of missions.
+ * @param[in] worker_count   Number of worker threads shared by the missions.
+ * @param[in] seconds        Wall time after which the remaining missions are stopped.
+ * @return                   0 on success, 1 if the missions could not be loaded or run.
+ */
+static int run_host(int mission_count, int worker_count, int seconds) {
+    Host host;
+    long rss_before_kb, rss_loaded_kb;
+    long long start_ns, deadline_ns;
+    int threads = 0;
+    struct timespec pause = { 0, 10 * 1000000L };
+
+    rss_before_kb = bench_rss_kb();
+    if (host_init(&host, mission_count, worker_count, load_data) != 0) {
+        fprintf(stderr, "Could not load %d missions\n", mission_count);
+        return 1;
+    }
+    rss_loaded_kb = bench_rss_kb();
+
+    if (host_start(&host) != 0) {
+        fprintf(stderr, "Could not start the host's workers\n");
+        host_clean(&host);
+        return 1;
+    }
+
+    start_ns = clock_now_ns();
+    deadline_ns = start_ns + seconds * 1000000000LL;
+    for (int i = 0; i < mission_count; i++) {
+        host_start_mission(&host, i);
+    }
+
+    // wait for the missions to end by themselves, stopping the stragglers at the deadline
+    while (host_live(&host) > 0) {
+        if (threads == 0) {
+            threads = bench_thread_count();
+        }
+        if (clock_now_ns() >= deadline_ns) {
+            for (int i = 0; i < mission_count; i++) {
+                host_stop_mission(&host, i);
+            }
+            deadline_ns = start_ns + 1000000000000000LL;
+        }
+        nanosleep(&pause, NULL);
+    }
+    host_stop(&host);
+
+    host_print(&host, clock_now_ns() - start_ns);
+    printf("Process: %d threads while running, %.1f KB of memory per mission (%zu bytes of mission state)\n",
+           threads, mission_count > 0 ? (double)(rss_loaded_kb - rss_before_kb) / mission_count : 0.0, sizeof(Mission));
+
+    host_clean(&host);
+    return 0;
+}
+
+/**
+ * Displays the telemetry published by a simulation running in another process.
+ *
+ * Refreshes once a second until the simulation reports that it has stopped.
+ *
+ * @param[in] telemetry_name  Shared memory name the simulation publishes under.
+ * @return                    0 once the simulation has stopped, 1 if there is nothing to attach to.
+ */
+static int run_monitor(const char *telemetry_name) {
+    Telemetry telemetry;
+
+    if (telemetry_attach(&telemetry, telemetry_name) != 0) {
+        fprintf(stderr, "No simulation is publishing telemetry under %s\n", telemetry_name);
+        return 1;
+    }
+
+    while (__atomic_load_n(&telemetry.segment->simulation_running, __ATOMIC_ACQUIRE)) {
+        telemetry_print(telemetry.segment);
+        fflush(stdout);
+        sleep(1);
+    }
+
+    // show the final state once more
+    telemetry_print(telemetry.segment);
+    fflush(stdout);
+
+    telemetry_clean(&telemetry);
+    return 0;
+}
+
+/**
+ * Stops recording the history, prints its summary and exports it if asked to.
+ *
+ * @param[in,out] history      Pointer to the `History`.
+ * @param[in]     history_ms   Sampling resolution, zero if no history was recorded.
+ * @param[in]     history_csv  File to export to, or NULL.
+ */
+static void finish_history(History *history, int history_ms, const char *history_csv) {
+    if (history_ms <= 0) {
+        return;
+    }
+
+    history_stop(history);
+    history_print(history);
+
+    if (history_csv != NULL && history_export_csv(history, history_csv) != 0) {
+        fprintf(stderr, "Could not write history to %s\n", history_csv);
+    }
+
+    history_clean(history);
+}
+
+/**
+ * Parses a comma separated list of scenario sizes.
+ *
+ * @param[in]  text       The list, such as "100,1000,10000".
+ * @param[out] sizes      Set to each size.
+ * @param[in]  max_sizes  Size of `sizes`.
+ * @return                Number of sizes, or 0 if the list is empty or holds anything but positive numbers.
+ */
+static int parse_sizes(const char *text, int *sizes, int max_sizes) {
+    char *end;
+    int count = 0;
+
+    while (*text != '\0' && count < max_sizes) {
+        sizes[count] = (int)strtol(text, &end, 10);
+        if (end == text || sizes[count] <= 0 || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        count++;
+        text = (*end == ',') ? end + 1 : end;
+    }
+
+    return count;
+}
+
+/**
+ * Parses the name of a processing time distribution.
+ *
+ * @param[in] text  "uniform", "exponential" or "bimodal".
+ * @return          The matching SCENARIO_PT_ value, or -1 if there is none.
+ */
+static int parse_distribution(const char *text) {
+    if (strcmp(text, "uniform") == 0) {
+        return SCENARIO_PT_UNIFORM;
+    }
+    if (strcmp(text, "exponential") == 0) {
+        return SCENARIO_PT_EXPONENTIAL;
+    }
+    if (strcmp(text, "bimodal") == 0) {
+        return SCENARIO_PT_BIMODAL;
+    }
+    return -1;
+}
@@ -7,10 +7,13 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <sched.h>
 
 // This function is only used by this file, so declared here and set to static to avoid having it linked by any other file
 
 static void display_simulation_state(Manager *manager);
+static int manager_handle_events(Manager *manager, ManagerShard *shard);
+static int manager_system_shard(const System *system);
 
 /**
  * Initializes the `Manager`.
@@ -22,9 +25,29 @@ static void display_simulation_state(Manager *manager);
  */
 void manager_init(Manager *manager) {
     manager->simulation_running = 1; // Any non-zero value to state the sim is running
+    manager->control_mode = CONTROL_STATUS;
+    manager->reserve_output = 0;
+    manager->lockprof = 0;
+    manager->quiet = 0;
+    manager->events_handled = 0;
+    manager->event_lag_ns = 0;
+    manager->event_lag_max_ns = 0;
+    manager->events_forwarded = 0;
+    manager->shards = NULL;
+    manager->shard_count = 0;
+    manager->controller.states = NULL;
+    manager->controller.size = 0;
+    manager->scheduler = NULL;
+    manager->cluster = NULL;
+    manager->forecast = NULL;
+    manager->telemetry.segment = NULL;
+    manager->telemetry.owner = 0;
     system_array_init(&manager->system_array);
     resource_array_init(&manager->resource_array);
+    system_array_init(&manager->removed_systems);
+    resource_array_init(&manager->removed_resources);
     event_queue_init(&manager->event_queue);
+    log_init(&manager->log, LOG_LEVEL_EVENTS);
 }
 
 /**
@@ -35,10 +58,25 @@ void manager_init(Manager *manager) {
  * @param[in,out] manager  Pointer to the `Manager` to clean.
  */
 void manager_clean(Manager *manager) {
+    // the log writer may still be printing names of the systems and resources freed below
+    log_stop(&manager->log);
     // clean system array, resource array, and event queue
     system_array_clean(&manager->system_array);
     resource_array_clean(&manager->resource_array);
+    system_array_clean(&manager->removed_systems);
+    resource_array_clean(&manager->removed_resources);
     event_queue_clean(&manager->event_queue);
+    for (int i = 0; i < manager->shard_count; i++) {
+        // The systems belong to the manager's array, only the shard's list of them is freed
+        event_queue_clean(&manager->shards[i].own_queue);
+        event_queue_clean(&manager->shards[i].inbox);
+        free(manager->shards[i].systems.systems);
+        free(manager->shards[i].systems.view);
+        retired_list_clean(&manager->shards[i].systems.retired);
+    }
+    free(manager->shards);
+    controller_clean(&manager->controller);
+    telemetry_clean(&manager->telemetry);
 }
 
 /**
@@ -47,68 +85,612 @@ void manager_clean(Manager *manager) {
  * Handles event processing, updates system statuses, and displays the simulation state.
  * Continues until the simulation is no longer running. (In a multi-threaded implementation)
  *
+ * When the manager is sharded this handles the events of shard 0, the other shards run on
+ * their own threads.
+ *
  * @param[in,out] manager  Pointer to the `Manager`.
  */
 void manager_run(Manager *manager) {
+    // Update the display of the current state of things
+    if (!manager->quiet) {
+        display_simulation_state(manager);
+    }
+
+    // Print the lock profile when asked for with SIGUSR1
+    if (manager->lockprof && lockprof_report_requested()) {
+        lockprof_print(manager);
+    }
+
+    // In PID mode the controller steers production rates continuously
+    if (manager->control_mode == CONTROL_PID) {
+        controller_update(&manager->controller, manager);
+    }
+
+    manager_handle_events(manager, (manager->shard_count > 0) ? &manager->shards[0] : NULL);
+}
+
+/**
+ * Handles one batch of events, for the whole manager or for one shard.
+ *
+ * Pending events are taken off the queue as one batch, and each resource's producers are given
+ * only the last status decided for it within the batch. A shard also takes the events other
+ * shards forwarded to it, and forwards any event asking for a change to another shard's
+ * resource to that shard rather than handling it. Ending the simulation is decided by whichever
+ * shard sees the event, and terminates every system.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in,out] shard    Pointer to the `ManagerShard` whose events are handled, NULL if unsharded.
+ * @return                 Number of events taken off the queues.
+ */
+static int manager_handle_events(Manager *manager, ManagerShard *shard) {
     Event event;
-    int i, status;
-    int event_found_flag = 0, no_oxygen_flag = 0, distance_reached_flag = 0, need_more_flag = 0, need_less_flag = 0;
+    EventNode *batches[2] = { NULL, NULL }, *node;
+    Resource *touched[2 * EVENT_DRAIN_MAX];
+    System **systems;
+    EventQueue *queue = (shard != NULL) ? shard->queue : &manager->event_queue;
+    SystemArray *owned = (shard != NULL) ? &shard->systems : &manager->system_array;
+    unsigned long long *events_handled = (shard != NULL) ? &shard->events_handled : &manager->events_handled;
+    long long *event_lag_ns = (shard != NULL) ? &shard->event_lag_ns : &manager->event_lag_ns;
+    long long *event_lag_max_ns = (shard != NULL) ? &shard->event_lag_max_ns : &manager->event_lag_max_ns;
+    long long lag_ns;
+    int b, i, status, system_count, drained, touched_count = 0, terminate = 0;
+    int no_oxygen_flag = 0, distance_reached_flag = 0, need_more_flag = 0, need_less_flag = 0;
     
     System *sys = NULL;
 
-    // Update the display of the current state of things
-    display_simulation_state(manager);
+    // Take every pending event at once, then handle them without holding the queue's lock
+    drained = event_queue_drain(queue, &batches[0], EVENT_DRAIN_MAX);
+    if (shard != NULL) {
+        drained += event_queue_drain(&shard->inbox, &batches[1], EVENT_DRAIN_MAX);
+    }
+    if (drained == 0) {
+        return 0;
+    }
 
-    // Process events if one is popped
-    
-    event_found_flag = event_queue_pop(&manager->event_queue, &event);
+    for (b = 0; b < 2; b++) {
+        for (node = batches[b]; node != NULL; node = node->next) {
+            event = node->event;
+
+            // Set some flags based on the event that we can react to below
+            no_oxygen_flag        = (event.status == STATUS_EMPTY && strcmp(event.resource->name, "Oxygen") == 0);
+            distance_reached_flag = (event.status == STATUS_CAPACITY && strcmp(event.resource->name, "Distance") == 0);
+            need_more_flag        = (event.status == STATUS_LOW || event.status == STATUS_EMPTY || event.status == STATUS_INSUFFICIENT);
+            need_less_flag        = (event.status == STATUS_CAPACITY);
+
+            // The controller owns the production rates of the resources it controls in PID mode,
+            // the producers of any other resource, such as one added while running, still speed up and slow down here
+            if (manager->control_mode == CONTROL_PID && controller_controls(&manager->controller, event.resource)) {
+                need_more_flag = 0;
+                need_less_flag = 0;
+            }
+
+            // Only the shard owning the resource decides for its producers, it handles the event
+            if (shard != NULL && !no_oxygen_flag && !distance_reached_flag && (need_more_flag || need_less_flag) &&
+                event.resource->shard != shard->index) {
+                event_queue_push(&manager->shards[event.resource->shard].inbox, &event);
+                shard->events_forwarded++;
+                continue;
+            }
+
+            // Measure how long the event waited to be handled
+            lag_ns = clock_now_ns() - event.created_ns;
+            (*events_handled)++;
+            *event_lag_ns += lag_ns;
+            if (lag_ns > *event_lag_max_ns) {
+                *event_lag_max_ns = lag_ns;
+            }
+
+            // Handle the event, the log writer thread prints it
+            log_write(&manager->log, LOG_LEVEL_EVENTS, LOG_KIND_EVENT, event.system, event.resource, event.amount, event.status);
+
+            if (no_oxygen_flag) {
+                log_write(&manager->log, LOG_LEVEL_NOTICE, LOG_KIND_NO_OXYGEN, event.system, event.resource, event.amount, event.status);
+            }
+
+            if (distance_reached_flag) {
+                log_write(&manager->log, LOG_LEVEL_NOTICE, LOG_KIND_DESTINATION, event.system, event.resource, event.amount, event.status);
+            }
+
+            if (no_oxygen_flag || distance_reached_flag) {
+                terminate = 1;
+                // Pairs with `manager_add_system`, so a system added now either sees this or is terminated below
+                __atomic_store_n(&manager->simulation_running, 0, __ATOMIC_SEQ_CST);
+            }
+            else if (need_more_flag || need_less_flag) {
+                // Only the last decision per resource counts, as if the events had been handled one by one
+                if (event.resource->pending_status < 0) {
+                    touched[touched_count++] = event.resource;
+                }
+                event.resource->pending_status = need_more_flag ? FAST : SLOW;
+            }
+        }
+    }
+
+    event_batch_free(batches[0]);
+    event_batch_free(batches[1]);
+
+    // Update the systems once for the whole batch, all of them to terminate, or the ones this
+    // shard owns to speed up or slow down production
+    if (terminate || touched_count > 0) {
+        system_count = system_array_snapshot(terminate ? &manager->system_array : owned, &systems);
+        for (i = 0; i < system_count; i++) {
+            sys = systems[i];
+            status = terminate ? TERMINATE : (sys->produced.resource != NULL ? sys->produced.resource->pending_status : -1);
+            if (status >= 0) {
+                manager_set_system_status(manager, sys, status);
+            }
+        }
+    }
+
+    for (i = 0; i < touched_count; i++) {
+        touched[i]->pending_status = -1;
+    }
+
+    return drained;
+}
+
+/**
+ * Changes the status of a `System`.
+ *
+ * When systems are driven by a `Scheduler`, the system is also rescheduled so the new status
+ * takes effect mid-processing rather than on its next conversion. When systems run in partition
+ * processes, the change is sent to the partition that runs it.
+ *
+ * Both the manager and the control server change statuses, so once a system is terminated its
+ * status is never changed again.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in,out] system   Pointer to the `System` whose status changes.
+ * @param[in]     status   The new status.
+ */
+void manager_set_system_status(Manager *manager, System *system, int status) {
+    int current = __atomic_load_n(&system->status, __ATOMIC_RELAXED);
+
+    // A terminated system never runs again, so it must not be brought back by a late status change
+    do {
+        if (current == status || current == TERMINATE) {
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&system->status, &current, status, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    system_publish(system);
+
+    if (manager->scheduler != NULL) {
+        scheduler_reschedule(manager->scheduler, system);
+    }
+
+    if (manager->cluster != NULL) {
+        cluster_send_system(manager->cluster, system);
+    }
+}
+
+/**
+ * Changes the rate multiplier of a `System`.
+ *
+ * Rescheduled and forwarded to its partition the same way as a status change.
+ *
+ * @param[in,out] manager          Pointer to the `Manager`.
+ * @param[in,out] system           Pointer to the `System` whose rate changes.
+ * @param[in]     rate_multiplier  The new rate multiplier.
+ */
+void manager_set_system_rate(Manager *manager, System *system, double rate_multiplier) {
+    if (system->rate_multiplier == rate_multiplier) {
+        return;
+    }
+
+    system->rate_multiplier = rate_multiplier;
+    system_publish(system);
+
+    if (manager->scheduler != NULL) {
+        scheduler_reschedule(manager->scheduler, system);
+    }
+
+    if (manager->cluster != NULL) {
+        cluster_send_system(manager->cluster, system);
+    }
+}
+
+/**
+ * Adds a `Resource` to the running simulation.
+ *
+ * Must only be called by one thread at a time, the single writer of the resource array.
+ *
+ * @param[in,out] manager   Pointer to the `Manager`.
+ * @param[in,out] resource  Pointer to the `Resource` to add, owned by the manager on success.
+ * @return                  0 on success, -1 if it could not be added.
+ */
+int manager_add_resource(Manager *manager, Resource *resource) {
+    int size = manager->resource_array.size;
+
+    if (manager->cluster != NULL) {
+        return -1;
+    }
+
+    resource->profiled = manager->lockprof;
+
+    // Give it a telemetry slot first, so it is published by the time readers can find it
+    telemetry_add_resource(&manager->telemetry, resource);
+    resource_array_add(&manager->resource_array, resource);
+
+    // Nothing produces it yet, so any shard can own it
+    if (manager->shard_count > 0 && resource->id >= 0) {
+        resource->shard = resource->id % manager->shard_count;
+    }
+
+    return (manager->resource_array.size > size) ? 0 : -1;
+}
+
+/**
+ * Adds a `System` to the running simulation and starts it.
+ *
+ * Must only be called by one thread at a time, the single writer of the system array. The
+ * resources the system uses must already have been added.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in,out] system   Pointer to the `System` to add, owned by the manager on success.
+ * @return                 0 on success, -1 if it could not be added or the simulation has ended.
+ */
+int manager_add_system(Manager *manager, System *system) {
+    int size = manager->system_array.size;
+    ManagerShard *shard = NULL;
+
+    if (manager->cluster != NULL || !__atomic_load_n(&manager->simulation_running, __ATOMIC_SEQ_CST)) {
+        return -1;
+    }
+
+    // Its events go to the shard owning the resource it produces, which decides its status
+    if (manager->shard_count > 0) {
+        shard = &manager->shards[manager_system_shard(system)];
+        system->event_queue = shard->queue;
+        system_array_add(&shard->systems, system);
+    }
+
+    system_set_reserve_output(system, manager->reserve_output);
+    telemetry_add_system(&manager->telemetry, system);
+    system_array_add(&manager->system_array, system);
+    if (manager->system_array.size == size) {
+        if (shard != NULL) {
+            system_array_remove(&shard->systems, system);
+        }
+        return -1;
+    }
+
+    // If the manager ended the simulation while this was added, it may not have seen the new system
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&manager->simulation_running, __ATOMIC_SEQ_CST)) {
+        manager_set_system_status(manager, system, TERMINATE);
+    }
+
+    manager_spawn_system(manager, system);
+    return 0;
+}
+
+/**
+ * Removes a `Resource` from the running simulation.
+ *
+ * The resource stays allocated until the manager is cleaned, since other threads may still hold it.
+ *
+ * @param[in,out] manager   Pointer to the `Manager`.
+ * @param[in,out] resource  Pointer to the `Resource` to remove.
+ * @return                  0 on success, -1 if it is not present or a system still uses it.
+ */
+int manager_remove_resource(Manager *manager, Resource *resource) {
+    System *system;
+
+    if (manager->cluster != NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        if (system->consumed.resource == resource || system->produced.resource == resource) {
+            return -1;
+        }
+    }
+
+    if (resource_array_remove(&manager->resource_array, resource) != 0) {
+        return -1;
+    }
+
+    telemetry_remove_resource(&manager->telemetry, resource);
+    resource_array_add(&manager->removed_resources, resource);
+    return 0;
+}
+
+/**
+ * Removes a `System` from the running simulation and terminates it.
+ *
+ * The system stays allocated until the manager is cleaned, since its thread (or the scheduler)
+ * may be in the middle of a step, and queued events may still point at it.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in,out] system   Pointer to the `System` to remove.
+ * @return                 0 on success, -1 if it is not present.
+ */
+int manager_remove_system(Manager *manager, System *system) {
+    if (manager->cluster != NULL || system_array_remove(&manager->system_array, system) != 0) {
+        return -1;
+    }
+
+    if (manager->shard_count > 0) {
+        system_array_remove(&manager->shards[manager_system_shard(system)].systems, system);
+    }
+
+    manager_set_system_status(manager, system, TERMINATE);
+    telemetry_remove_system(&manager->telemetry, system);
+    system_array_add(&manager->removed_systems, system);
+    return 0;
+}
 
-    while (event_found_flag) {
-        // Handle the event
-        printf("Event: [%s] Reported Resource [%s : %d] Status [%d]\n",
-                event.system->name,
-                event.resource->name,
-                event.amount,
-                event.status);
+/**
+ * Starts running a `System`, on the scheduler if there is one or otherwise on its own thread.
+ *
+ * A thread is pinned to the system's CPU when `affinity_apply` chose one.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ * @param[in,out] system   Pointer to the `System` to start.
+ */
+void manager_spawn_system(Manager *manager, System *system) {
+    if (manager->scheduler != NULL) {
+        scheduler_add(manager->scheduler, system);
+    } else if (pthread_create(&system->thread, NULL, system_thread, system) == 0) {
+        system->threaded = 1;
+        if (system->cpu >= 0) {
+            affinity_pin_thread(system->thread, &system->cpu, 1);
+        }
+    }
+}
 
-        // Set some flags based on the event that we can react to below
-        no_oxygen_flag        = (event.status == STATUS_EMPTY && strcmp(event.resource->name, "Oxygen") == 0);
-        distance_reached_flag = (event.status == STATUS_CAPACITY && strcmp(event.resource->name, "Distance") == 0);
-        need_more_flag        = (event.status == STATUS_LOW || event.status == STATUS_EMPTY || event.status == STATUS_INSUFFICIENT);
-        need_less_flag        = (event.status == STATUS_CAPACITY);
+/**
+ * Waits for the thread of every system, including removed ones, to finish.
+ *
+ * Must only be called once nothing can add systems any more.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+void manager_join_systems(Manager *manager) {
+    SystemArray *arrays[2] = { &manager->system_array, &manager->removed_systems };
+    System *system;
+
+    for (int a = 0; a < 2; a++) {
+        for (int i = 0; i < arrays[a]->size; i++) {
+            system = arrays[a]->systems[i];
+            if (system->threaded) {
+                pthread_join(system->thread, NULL);
+                system->threaded = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Splits event handling across several manager shards.
+ *
+ * Resources are cut into contiguous ranges holding about the same number of systems, each system
+ * counted with the resource it produces, or the one it consumes if it produces nothing. A shard
+ * owns a range of resources and decides the statuses of their producers, and those systems send
+ * their events to its queue, so most events are handled where they are raised. An event asking
+ * for a change to another shard's resource is forwarded to that shard's inbox, the only channel
+ * between shards besides the simulation running flag.
+ *
+ * Shard 0 keeps the manager's own queue and is run by `manager_run`, the others are run on their
+ * own threads by `manager_start_shards`. Must be called before any system runs.
+ *
+ * @param[in,out] manager      Pointer to the `Manager`.
+ * @param[in]     shard_count  Number of shards, 1 or less to leave the manager unsharded.
+ * @return                     0 on success, -1 if the manager runs partitions or memory ran out.
+ */
+int manager_shard(Manager *manager, int shard_count) {
+    ManagerShard *shards;
+    Resource *resource, *anchor;
+    System *system;
+    int *weight;
+    int i, total = 0, seen = 0;
+
+    if (shard_count <= 1) {
+        return 0;
+    }
+    if (manager->cluster != NULL || manager->shard_count > 0) {
+        return -1;
+    }
 
-        if (no_oxygen_flag) {
-            printf("Oxygen depleted. Terminating all systems.\n");
+    shards = (ManagerShard *)calloc(shard_count, sizeof(ManagerShard));
+    weight = (int *)calloc(manager->resource_array.next_id + 1, sizeof(int));
+    if (shards == NULL || weight == NULL) {
+        free(shards);
+        free(weight);
+        return -1;
+    }
+
+    for (i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        anchor = (system->produced.resource != NULL) ? system->produced.resource : system->consumed.resource;
+        if (anchor != NULL) {
+            weight[anchor->id]++;
+            total++;
         }
+    }
+
+    // Each resource goes to the shard its middle system falls in
+    for (i = 0; i < manager->resource_array.size; i++) {
+        resource = manager->resource_array.resources[i];
+        resource->shard = (total > 0) ? (int)((2LL * seen + weight[resource->id]) * shard_count / (2LL * total)) : 0;
+        if (resource->shard >= shard_count) {
+            resource->shard = shard_count - 1;
+        }
+        seen += weight[resource->id];
+    }
+    free(weight);
+
+    for (i = 0; i < shard_count; i++) {
+        shards[i].index = i;
+        shards[i].manager = manager;
+        event_queue_init(&shards[i].own_queue);
+        event_queue_init(&shards[i].inbox);
+        shards[i].own_queue.profiled = manager->lockprof;
+        shards[i].inbox.profiled = manager->lockprof;
+        shards[i].queue = (i == 0) ? &manager->event_queue : &shards[i].own_queue;
+        system_array_init(&shards[i].systems);
+    }
+
+    for (i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        system->event_queue = shards[manager_system_shard(system)].queue;
+        system_array_add(&shards[manager_system_shard(system)].systems, system);
+    }
+
+    manager->shards = shards;
+    manager->shard_count = shard_count;
+    return 0;
+}
+
+/**
+ * Starts a thread for every shard but shard 0, which the manager thread runs.
+ *
+ * @param[in,out] manager  Pointer to the sharded `Manager`.
+ */
+void manager_start_shards(Manager *manager) {
+    for (int i = 1; i < manager->shard_count; i++) {
+        manager->shards[i].threaded = (pthread_create(&manager->shards[i].thread, NULL, manager_shard_thread, &manager->shards[i]) == 0);
+    }
+}
+
+/**
+ * Waits for the shard threads to finish once the simulation has stopped, then adds up the
+ * events every shard handled into the manager's totals.
+ *
+ * Must be called after the manager thread has been joined.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`.
+ */
+void manager_join_shards(Manager *manager) {
+    ManagerShard *shard;
+
+    for (int i = 0; i < manager->shard_count; i++) {
+        shard = &manager->shards[i];
+        if (shard->threaded) {
+            pthread_join(shard->thread, NULL);
+            shard->threaded = 0;
+        }
+
+        manager->events_handled += shard->events_handled;
+        manager->event_lag_ns += shard->event_lag_ns;
+        manager->events_forwarded += shard->events_forwarded;
+        if (shard->event_lag_max_ns > manager->event_lag_max_ns) {
+            manager->event_lag_max_ns = shard->event_lag_max_ns;
+        }
+        shard->events_handled = 0;
+        shard->event_lag_ns = 0;
+        shard->event_lag_max_ns = 0;
+        shard->events_forwarded = 0;
+    }
+}
+
+/**
+ * Splits every resource shared by many systems into local pools, one per online CPU.
+ *
+ * There are always at least two pools, which also splits contention between threads that share a
+ * core. Resources are not pooled when systems reserve their output, which needs the amount and
+ * reservations of a resource in one place, or when the systems run in partitions. Must be called
+ * before any system runs.
+ *
+ * @param[in,out] manager    Pointer to the `Manager`.
+ * @param[in]     min_users  Least number of systems using a resource for it to be pooled.
+ * @return                   Number of resources pooled, -1 if resources cannot be pooled with the
+ *                           manager's settings, -2 if memory ran out (some may have been pooled).
+ */
+int manager_pool_resources(Manager *manager, int min_users) {
+    System *system;
+    int *users;
+    int i, pooled = 0, failed = 0;
+    long pool_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (manager->reserve_output || manager->cluster != NULL) {
+        return -1;
+    }
+
+    if (pool_count < 2) {
+        pool_count = 2;
+    }
+    if (pool_count > RESOURCE_MAX_POOLS) {
+        pool_count = RESOURCE_MAX_POOLS;
+    }
 
-        if (distance_reached_flag) {
-            printf("Destination reached. Terminating all systems.\n");
+    users = (int *)calloc(manager->resource_array.next_id + 1, sizeof(int));
+    if (users == NULL) {
+        return -2;
+    }
+
+    for (i = 0; i < manager->system_array.size; i++) {
+        system = manager->system_array.systems[i];
+        if (system->consumed.resource != NULL) {
+            users[system->consumed.resource->id]++;
+        }
+        if (system->produced.resource != NULL && system->produced.resource != system->consumed.resource) {
+            users[system->produced.resource->id]++;
         }
+    }
 
-        if (no_oxygen_flag || distance_reached_flag) {
-            status = TERMINATE;
-            manager->simulation_running = 0;
+    for (i = 0; i < manager->resource_array.size; i++) {
+        if (users[manager->resource_array.resources[i]->id] >= min_users) {
+            if (resource_pool(manager->resource_array.resources[i], (int)pool_count) == 0) {
+                pooled++;
+            } else {
+                failed++;
+            }
         }
-        else if (need_more_flag) {
-            status = FAST;
+    }
+
+    free(users);
+    return (failed > 0) ? -2 : pooled;
+}
+
+/**
+ * Prints how often each pooled resource was served by a single pool.
+ *
+ * @param[in,out] manager  Pointer to the `Manager`, once its systems have stopped.
+ */
+void manager_print_pools(Manager *manager) {
+    Resource *resource;
+    unsigned long long local;
+    int printed = 0;
+
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        resource = manager->resource_array.resources[i];
+        if (resource->pools == NULL) {
+            continue;
         }
-        else if (need_less_flag) {
-            status = SLOW;
+
+        if (!printed) {
+            printf("\nPooled Resources:\n");
+            printf("-------------------------\n");
+            printed = 1;
         }
 
-        if (no_oxygen_flag || distance_reached_flag || need_more_flag || need_less_flag) {
-            // Update all of the systems to speed up or slow down production, or terminate
-            for (i = 0; i < manager->system_array.size; i++) {
-                sys = manager->system_array.systems[i];
-                if (status == TERMINATE || sys->produced.resource == event.resource) {
-                    sys->status = status;
-                }
-            }   
+        local = 0;
+        for (int p = 0; p < resource->pool_count; p++) {
+            local += resource->pools[p].operations;
         }
+        printf("%-12s: %d pools, %d / %d, %llu takes and stores served locally, %llu rebalances (%.1f%% local)\n",
+               resource->name, resource->pool_count, resource_pool_total(resource, 1), resource->max_capacity,
+               local, resource->rebalances, (local + resource->rebalances) > 0 ? 100.0 * local / (local + resource->rebalances) : 0.0);
+    }
+}
 
-        event_found_flag = event_queue_pop(&manager->event_queue, &event);
+/**
+ * Finds the shard that decides a system's status.
+ *
+ * @param[in] system  Pointer to the `System`.
+ * @return            Shard of the resource it produces, or consumes if it produces nothing, 0 if neither.
+ */
+static int manager_system_shard(const System *system) {
+    if (system->produced.resource != NULL) {
+        return system->produced.resource->shard;
     }
-    
+    if (system->consumed.resource != NULL) {
+        return system->consumed.resource->shard;
+    }
+    return 0;
 }
 
 // Don't worry much about these! These are special codes that allow us to do some formatting in the terminal
@@ -123,8 +705,8 @@ void manager_run(Manager *manager) {
 /**
  * Displays the current simulation state.
  *
- * Outputs the statuses of resources and systems to the console.
- * This function is typically called periodically to update the display.
+ * Outputs the statuses of resources and systems to the console, from the telemetry segment
+ * when there is one. This function is typically called periodically to update the display.
  *
  * @param[in] manager  Pointer to the `Manager` containing the simulation state.
  */
@@ -139,6 +721,24 @@ void display_simulation_state(Manager *manager) {
         return;
     }
 
+    // Pooled resources only publish their totals when they rebalance
+    Resource **pooled = NULL;
+    int pooled_count = resource_array_snapshot(&manager->resource_array, &pooled);
+    for (int i = 0; i < pooled_count; i++) {
+        resource_pool_sync(pooled[i]);
+    }
+
+    // Read a consistent snapshot from the telemetry rather than the live structures
+    if (manager->telemetry.segment != NULL) {
+        telemetry_print(manager->telemetry.segment);
+        if (manager->forecast != NULL) {
+            forecast_display(manager->forecast);
+        }
+        last_display_time = current_time;
+        fflush(stdout);
+        return;
+    }
+
     // Otherwise display to the screen by resetting the timer
     printf(ANSI_CLEAR);
 
@@ -150,11 +750,13 @@ void display_simulation_state(Manager *manager) {
     printf(ANSI_LN_CLR "Current Resource Amounts:\n");
     printf(ANSI_LN_CLR "-------------------------\n");
 
+    Resource **resources = NULL;
     Resource *resource = NULL;
     int amount = 0; 
     int max_capacity = 0;
-    for (int i = 0; i < manager->resource_array.size; i++) {
-        resource = manager->resource_array.resources[i];
+    int resource_count = resource_array_snapshot(&manager->resource_array, &resources);
+    for (int i = 0; i < resource_count; i++) {
+        resource = resources[i];
 
         amount = resource->amount;
         max_capacity = resource->max_capacity;
@@ -168,38 +770,28 @@ void display_simulation_state(Manager *manager) {
     printf(ANSI_LN_CLR "System Statuses:\n");
     printf(ANSI_LN_CLR "---------------\n");
 
+    System **systems = NULL;
     System *system = NULL;
-    for (int i = 0; i < manager->system_array.size; i++) {
-        system = manager->system_array.systems[i];
+    int system_count = system_array_snapshot(&manager->system_array, &systems);
+    for (int i = 0; i < system_count; i++) {
+        system = systems[i];
 
         // Map system status code to a human-readable string
-        const char *status_str;
-        switch (system->status) {
-            case TERMINATE:
-                status_str = "TERMINATE";
-                break;
-            case DISABLED:
-                status_str = "DISABLED";
-                break;
-            case SLOW:
-                status_str = "SLOW";
-                break;
-            case STANDARD:
-                status_str = "STANDARD";
-                break;
-            case FAST:
-                status_str = "FAST";
-                break;
-            default:
-                status_str = "UNKNOWN";
-                break;
-        }
-
-        printf(ANSI_LN_CLR  "%-20s: %-10s\n", system->name, status_str);
+        const char *status_str = system_status_name(system->status);
+
+        if (manager->control_mode == CONTROL_PID) {
+            printf(ANSI_LN_CLR  "%-20s: %-10s x%.2f\n", system->name, status_str, system->rate_multiplier);
+        } else {
+            printf(ANSI_LN_CLR  "%-20s: %-10s\n", system->name, status_str);
+        }
     }
 
     printf(ANSI_LN_CLR  "\n");
 
+    if (manager->forecast != NULL) {
+        forecast_display(manager->forecast);
+    }
+
     last_display_time = current_time;
     // Flush the output to ensure it appears immediately
     fflush(stdout);
@@ -221,6 +813,28 @@ void *manager_thread(void *arg) {
     while (manager->simulation_running != 0) {
         manager_run(manager);
     }
+    // let external monitors know the simulation is over
+    telemetry_set_running(&manager->telemetry, 0);
     // return NULL to indicate thread has finished execution
     return NULL;
 }
+
+/**
+ * Runs one manager shard in a separate thread.
+ *
+ * Handles the shard's events until the simulation is stopped, by whichever shard saw it end.
+ *
+ * @param[in]   arg  Pointer to the `ManagerShard` object.
+ * @returns     NULL  when the thread terminates.
+ */
+void *manager_shard_thread(void *arg) {
+    ManagerShard *shard = (ManagerShard *)arg;
+
+    while (__atomic_load_n(&shard->manager->simulation_running, __ATOMIC_ACQUIRE) != 0) {
+        // Give the core to the systems when there is nothing to handle
+        if (manager_handle_events(shard->manager, shard) == 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
@@ -5,6 +5,15 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
+
+// Helper functions just used by this C file
+
+static void resource_pool_lock_all(Resource *resource);
+static void resource_pool_unlock_all(Resource *resource, int total);
+static int resource_pool_spread(Resource *resource);
+static int resource_pool_flow(Resource *resource, ResourcePool *local, int delta, double processing_ms);
+static void resource_array_publish(ResourceArray *array);
 
 /* Resource functions */
 
@@ -40,12 +49,30 @@ void resource_create(Resource **resource, const char *name, int amount, int max_
     // copy the name into the newly allocated memory
     strcpy((*resource)->name, name);
 
-    // initialize other attributes
+    // initialize other attributes, the id is assigned once the resource is added to an array
+    (*resource)->id = -1;
     (*resource)->amount = amount;
     (*resource)->max_capacity = max_capacity;
 
     // initialize the mutex for thread safety
     sem_init(&(*resource)->mutex, 0, 1);
+
+    // not published until it is given a telemetry slot
+    (*resource)->reserved = 0;
+    (*resource)->profiled = 0;
+    memset(&(*resource)->lock_stats, 0, sizeof(LockStats));
+    (*resource)->telemetry = NULL;
+    (*resource)->history_index = -1;
+    (*resource)->node = -1;
+    (*resource)->pending_status = -1;
+    (*resource)->shard = 0;
+    (*resource)->pools = NULL;
+    (*resource)->pool_count = 0;
+    (*resource)->rebalances = 0;
+    (*resource)->flow_rate = 0;
+    (*resource)->flow_time_ns = 0;
+    (*resource)->reaction_ms = 0;
+    (*resource)->low_warned = 0;
 }
 
 /**
@@ -61,8 +88,12 @@ void resource_destroy(Resource *resource) {
         return;
     }
     
-    // destroy the semaphore associated with the resource
+    // destroy the semaphore associated with the resource, and those of its pools
     sem_destroy(&resource->mutex);
+    for (int i = 0; i < resource->pool_count; i++) {
+        sem_destroy(&resource->pools[i].mutex);
+    }
+    free(resource->pools);
 
     // free the dynamically allocated memory for the resource name
     free(resource->name);
@@ -70,6 +101,426 @@ void resource_destroy(Resource *resource) {
     free(resource);
 }
 
+/**
+ * Publishes the current amount of a `Resource` to its telemetry slot.
+ *
+ * Must be called while holding the resource's mutex, which makes the caller the slot's only writer,
+ * so the seqlock write never has to wait. Does nothing if the resource has no slot.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` to publish.
+ */
+void resource_publish(Resource *resource) {
+    TelemetryResource *slot = resource->telemetry;
+    unsigned int sequence;
+
+    if (slot == NULL) {
+        return;
+    }
+
+    // An odd sequence tells readers the slot is being written
+    sequence = slot->sequence;
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->amount, resource->amount, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->max_capacity, resource->max_capacity, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Locks a `Resource`, recording the acquisition if its lock is being profiled.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` to lock.
+ */
+void resource_lock(Resource *resource) {
+    if (resource->profiled) {
+        lockprof_acquire(&resource->mutex, &resource->lock_stats);
+    } else {
+        sem_wait(&resource->mutex);
+    }
+}
+
+/**
+ * Tries to lock a `Resource` without waiting, recording the acquisition if its lock is being profiled.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` to lock.
+ * @return                  0 if it was locked, -1 if it is already locked.
+ */
+int resource_trylock(Resource *resource) {
+    if (resource->profiled) {
+        return lockprof_try_acquire(&resource->mutex, &resource->lock_stats);
+    }
+    return (sem_trywait(&resource->mutex) == 0) ? 0 : -1;
+}
+
+/**
+ * Unlocks a `Resource` locked with `resource_lock` or `resource_trylock`.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` to unlock.
+ */
+void resource_unlock(Resource *resource) {
+    if (resource->profiled) {
+        lockprof_release(&resource->mutex, &resource->lock_stats);
+    } else {
+        sem_post(&resource->mutex);
+    }
+}
+
+/**
+ * Reads the current amount of a `Resource` without taking its lock.
+ *
+ * When partitions run in separate processes the coordinator's copy of a resource owned by a
+ * partition goes stale, but its telemetry slot lives in shared memory and stays current. A pooled
+ * resource is read from its pools.
+ *
+ * @param[in] resource  Pointer to the `Resource`.
+ * @return              The amount last published, or the local amount if the resource has no slot.
+ */
+int resource_read_amount(const Resource *resource) {
+    int total = 0;
+
+    // The pools hold the amount, added up without stopping them, so it may be slightly off
+    if (resource->pools != NULL) {
+        for (int i = 0; i < resource->pool_count; i++) {
+            total += __atomic_load_n(&resource->pools[i].amount, __ATOMIC_RELAXED);
+        }
+        return total;
+    }
+    if (resource->telemetry != NULL) {
+        return __atomic_load_n(&resource->telemetry->amount, __ATOMIC_ACQUIRE);
+    }
+    return __atomic_load_n(&resource->amount, __ATOMIC_RELAXED);
+}
+
+/**
+ * Records a change in the amount of a `Resource`, updating its net flow rate, and decides whether
+ * the resource is about to run out. Must be called with the resource locked. A pooled resource's
+ * amount is read from its pools.
+ *
+ * The flow rate is an exponentially weighted sum of changes over the last `FLOW_TIME_CONSTANT_MS`,
+ * which needs no division by the often tiny time between changes. If the resource is draining fast
+ * enough that the consumer will find too little left within `FLOW_WARNING_HORIZON` reaction times
+ * of its producers, a warning is due. Only one warning is given until the resource climbs back
+ * above `THRESHOLD_RESOURCE_LOW` of its capacity.
+ *
+ * @param[in,out] resource       Pointer to the locked `Resource`.
+ * @param[in]     delta          Change in amount, negative when consumed.
+ * @param[in]     processing_ms  Processing time of the producer storing into it, 0 when consuming.
+ * @return                       `STATUS_LOW` if a warning should be raised now, otherwise `STATUS_OK`.
+ */
+int resource_record_flow(Resource *resource, int delta, double processing_ms) {
+    long long now = clock_now_ns();
+    double elapsed_ms, time_to_empty_ms, horizon_ms;
+    int amount = (resource->pools != NULL) ? resource_read_amount(resource) : resource->amount;
+
+    if (resource->flow_time_ns != 0) {
+        elapsed_ms = (now - resource->flow_time_ns) / 1e6;
+        resource->flow_rate *= exp(-elapsed_ms / FLOW_TIME_CONSTANT_MS);
+    }
+    resource->flow_rate += delta * 1000.0 / FLOW_TIME_CONSTANT_MS;
+    resource->flow_time_ns = now;
+
+    // How soon a producer that is told to speed up can deliver
+    if (processing_ms > 0) {
+        resource->reaction_ms = (resource->reaction_ms == 0) ? processing_ms :
+            (1.0 - FLOW_REACTION_SMOOTHING) * resource->reaction_ms + FLOW_REACTION_SMOOTHING * processing_ms;
+    }
+
+    // Back above the low threshold, a later drain deserves a new warning
+    if (amount >= THRESHOLD_RESOURCE_LOW * resource->max_capacity) {
+        resource->low_warned = 0;
+    }
+
+    // Not draining, or nobody to speed up
+    if (resource->flow_rate >= 0 || resource->reaction_ms == 0) {
+        return STATUS_OK;
+    }
+
+    // Consumers take whole amounts, so it runs out for this one once less than it took is left
+    time_to_empty_ms = (amount + (delta < 0 ? delta : 0)) * 1000.0 / -resource->flow_rate;
+    horizon_ms = FLOW_WARNING_HORIZON * resource->reaction_ms;
+
+    if (time_to_empty_ms < horizon_ms && !resource->low_warned) {
+        resource->low_warned = 1;
+        return STATUS_LOW;
+    }
+
+    return STATUS_OK;
+}
+
+/**
+ * Splits the amount and capacity of a `Resource` into local pools.
+ *
+ * Each system takes from and stores into one pool, under that pool's lock alone, so systems on
+ * different pools never touch the same cache line. Only when a pool runs dry or fills are every
+ * pool locked and the amount and capacity evened out across them. A pool never holds more than its
+ * share of the capacity and the shares add up to `max_capacity`, so the capacity holds for the
+ * resource as a whole. Must be called before any system uses the resource.
+ *
+ * @param[in,out] resource    Pointer to the `Resource`.
+ * @param[in]     pool_count  Number of pools, from 2 to `RESOURCE_MAX_POOLS`.
+ * @return                    0 on success, -1 if the count is out of range, it is already pooled, or memory ran out.
+ */
+int resource_pool(Resource *resource, int pool_count) {
+    if (pool_count < 2 || pool_count > RESOURCE_MAX_POOLS || resource->pools != NULL) {
+        return -1;
+    }
+
+    resource->pools = (ResourcePool *)aligned_alloc(64, sizeof(ResourcePool) * pool_count);
+    if (resource->pools == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < pool_count; i++) {
+        resource->pools[i].amount = 0;
+        resource->pools[i].limit = 0;
+        resource->pools[i].operations = 0;
+        resource->pools[i].flow_pending = 0;
+        sem_init(&resource->pools[i].mutex, 0, 1);
+    }
+    resource->pool_count = pool_count;
+    resource->pools[0].amount = resource->amount;
+    resource->pools[0].limit = resource->max_capacity;
+    resource_pool_spread(resource);
+    return 0;
+}
+
+/**
+ * Takes an amount from a pooled `Resource`, from the given pool if it has enough.
+ *
+ * Otherwise the pools are evened out and topped up from one another, and only if the resource
+ * as a whole has too little is the take refused, so running empty is decided on the exact total.
+ *
+ * @param[in,out] resource     Pointer to the pooled `Resource`.
+ * @param[in]     pool         Pool of the system taking.
+ * @param[in]     amount       Amount to take.
+ * @param[out]    flow_status  Set to `STATUS_LOW` if the resource is about to run out, as by `resource_record_flow`.
+ * @return                     `STATUS_OK` if it was taken, otherwise `STATUS_EMPTY` or `STATUS_INSUFFICIENT`.
+ */
+int resource_pool_take(Resource *resource, int pool, int amount, int *flow_status) {
+    ResourcePool *local = &resource->pools[pool];
+    ResourcePool *other;
+    int total, move, status = STATUS_OK;
+
+    *flow_status = STATUS_OK;
+
+    sem_wait(&local->mutex);
+    if (local->amount >= amount) {
+        __atomic_store_n(&local->amount, local->amount - amount, __ATOMIC_RELAXED);
+        local->operations++;
+        *flow_status = resource_pool_flow(resource, local, -amount, 0);
+        sem_post(&local->mutex);
+        return STATUS_OK;
+    }
+    sem_post(&local->mutex);
+
+    resource_pool_lock_all(resource);
+    total = resource_pool_spread(resource);
+
+    if (total < amount) {
+        status = (total == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+    } else {
+        // Bring what is missing over from the others, along with the capacity it takes up
+        for (int i = 0; i < resource->pool_count && local->amount < amount; i++) {
+            other = &resource->pools[i];
+            move = (other->amount < amount - local->amount) ? other->amount : amount - local->amount;
+            if (other != local && move > 0) {
+                __atomic_store_n(&other->amount, other->amount - move, __ATOMIC_RELAXED);
+                other->limit -= move;
+                __atomic_store_n(&local->amount, local->amount + move, __ATOMIC_RELAXED);
+                local->limit += move;
+            }
+        }
+        __atomic_store_n(&local->amount, local->amount - amount, __ATOMIC_RELAXED);
+        total -= amount;
+        *flow_status = resource_pool_flow(resource, NULL, -amount, 0);
+    }
+
+    resource->rebalances++;
+    resource_pool_unlock_all(resource, total);
+    return status;
+}
+
+/**
+ * Stores an amount into a pooled `Resource`, into the given pool if it has room.
+ *
+ * Otherwise the pools are evened out and capacity the others have spare is moved over, so the
+ * store only falls short once the resource as a whole is full.
+ *
+ * @param[in,out] resource       Pointer to the pooled `Resource`.
+ * @param[in]     pool           Pool of the system storing.
+ * @param[in]     amount         Amount to store.
+ * @param[in]     processing_ms  Processing time of the system storing, see `resource_record_flow`.
+ * @return                       Amount stored, less than `amount` if the resource filled.
+ */
+int resource_pool_put(Resource *resource, int pool, int amount, double processing_ms) {
+    ResourcePool *local = &resource->pools[pool];
+    ResourcePool *other;
+    int total, move, stored;
+
+    sem_wait(&local->mutex);
+    if (local->limit - local->amount >= amount) {
+        __atomic_store_n(&local->amount, local->amount + amount, __ATOMIC_RELAXED);
+        local->operations++;
+        resource_pool_flow(resource, local, amount, processing_ms);
+        sem_post(&local->mutex);
+        return amount;
+    }
+    sem_post(&local->mutex);
+
+    resource_pool_lock_all(resource);
+    total = resource_pool_spread(resource);
+
+    for (int i = 0; i < resource->pool_count && local->limit - local->amount < amount; i++) {
+        other = &resource->pools[i];
+        move = other->limit - other->amount;
+        if (move > amount - (local->limit - local->amount)) {
+            move = amount - (local->limit - local->amount);
+        }
+        if (other != local && move > 0) {
+            other->limit -= move;
+            local->limit += move;
+        }
+    }
+
+    stored = (local->limit - local->amount < amount) ? local->limit - local->amount : amount;
+    __atomic_store_n(&local->amount, local->amount + stored, __ATOMIC_RELAXED);
+    if (stored > 0) {
+        resource_pool_flow(resource, NULL, stored, processing_ms);
+    }
+
+    resource->rebalances++;
+    resource_pool_unlock_all(resource, total + stored);
+    return stored;
+}
+
+/**
+ * Adds up the amount of a pooled `Resource`.
+ *
+ * @param[in,out] resource  Pointer to the pooled `Resource`.
+ * @param[in]     exact     non-zero to stop every pool while adding up, otherwise the pools keep running.
+ * @return                  The amount held across the pools.
+ */
+int resource_pool_total(Resource *resource, int exact) {
+    int total = 0;
+
+    if (!exact) {
+        return resource_read_amount(resource);
+    }
+
+    resource_pool_lock_all(resource);
+    for (int i = 0; i < resource->pool_count; i++) {
+        total += resource->pools[i].amount;
+    }
+    resource_pool_unlock_all(resource, total);
+    return total;
+}
+
+/**
+ * Brings the `amount` of a pooled `Resource`, and its telemetry slot, up to date with its pools.
+ *
+ * Takes only the resource's own lock, so the total is approximate. Called for the display, since
+ * the pools do not publish on every take and store.
+ *
+ * @param[in,out] resource  Pointer to the `Resource`, nothing is done unless it is pooled.
+ */
+void resource_pool_sync(Resource *resource) {
+    if (resource->pools == NULL) {
+        return;
+    }
+
+    resource_lock(resource);
+    __atomic_store_n(&resource->amount, resource_read_amount(resource), __ATOMIC_RELAXED);
+    resource_publish(resource);
+    resource_unlock(resource);
+}
+
+/**
+ * Locks a pooled `Resource` and then every one of its pools, in order.
+ *
+ * A pool's lock is only ever held alone, or after the resource's, so this cannot deadlock.
+ *
+ * @param[in,out] resource  Pointer to the pooled `Resource`.
+ */
+static void resource_pool_lock_all(Resource *resource) {
+    resource_lock(resource);
+    for (int i = 0; i < resource->pool_count; i++) {
+        sem_wait(&resource->pools[i].mutex);
+    }
+}
+
+/**
+ * Publishes the exact total of a pooled `Resource` and unlocks it and its pools.
+ *
+ * @param[in,out] resource  Pointer to the `Resource` locked by `resource_pool_lock_all`.
+ * @param[in]     total     Amount held across the pools.
+ */
+static void resource_pool_unlock_all(Resource *resource, int total) {
+    __atomic_store_n(&resource->amount, total, __ATOMIC_RELAXED);
+    resource_publish(resource);
+
+    for (int i = resource->pool_count - 1; i >= 0; i--) {
+        sem_post(&resource->pools[i].mutex);
+    }
+    resource_unlock(resource);
+}
+
+/**
+ * Records a change to a pooled `Resource` in its flow rate.
+ *
+ * From a single pool the resource's lock is only tried, never waited on, so the pools still never
+ * wait on one another: if it is taken the change is kept in the pool and recorded along with the
+ * next one that finds the lock free. With every pool locked, what all of them kept is recorded.
+ *
+ * @param[in,out] resource       Pointer to the pooled `Resource`.
+ * @param[in,out] local          Pool the change was made in, locked by the caller, or NULL if the caller holds every lock.
+ * @param[in]     delta          Change in the amount.
+ * @param[in]     processing_ms  Processing time of the producer storing into it, 0 when consuming.
+ * @return                       `STATUS_LOW` if a warning should be raised now, otherwise `STATUS_OK`.
+ */
+static int resource_pool_flow(Resource *resource, ResourcePool *local, int delta, double processing_ms) {
+    int status;
+
+    if (local != NULL) {
+        local->flow_pending += delta;
+        if (resource_trylock(resource) != 0) {
+            return STATUS_OK;
+        }
+        status = resource_record_flow(resource, local->flow_pending, processing_ms);
+        local->flow_pending = 0;
+        resource_unlock(resource);
+        return status;
+    }
+
+    for (int i = 0; i < resource->pool_count; i++) {
+        delta += resource->pools[i].flow_pending;
+        resource->pools[i].flow_pending = 0;
+    }
+    return resource_record_flow(resource, delta, processing_ms);
+}
+
+/**
+ * Evens out the amount and the capacity across every pool of a `Resource`.
+ *
+ * Pools get equal shares of each, the first pools taking one more while the totals do not divide
+ * evenly, so no pool ever holds more than its share of the capacity.
+ *
+ * @param[in,out] resource  Pointer to the `Resource`, with every pool locked.
+ * @return                  Amount held across the pools.
+ */
+static int resource_pool_spread(Resource *resource) {
+    int total = 0, pools = resource->pool_count;
+
+    for (int i = 0; i < pools; i++) {
+        total += resource->pools[i].amount;
+    }
+
+    for (int i = 0; i < pools; i++) {
+        __atomic_store_n(&resource->pools[i].amount, total / pools + (i < total % pools), __ATOMIC_RELAXED);
+        resource->pools[i].limit = resource->max_capacity / pools + (i < resource->max_capacity % pools);
+    }
+    return total;
+}
+
 /* ResourceAmount functions */
 
 /**
@@ -94,6 +545,10 @@ void resource_amount_init(ResourceAmount *resource_amount, Resource *resource, i
  * @param[out] array  Pointer to the `ResourceArray` to initialize.
  */
 void resource_array_init(ResourceArray *array) {
+    retired_list_init(&array->retired);
+    array->next_id = 0;
+    array->view = NULL;
+
     // allocate memory for array of pointers
     array->resources = (Resource **)malloc(sizeof(Resource *) * 1);
 
@@ -105,6 +560,7 @@ void resource_array_init(ResourceArray *array) {
     // initalize other attributes
     array->size = 0;
     array->capacity = 1;
+    resource_array_publish(array);
 }
 
 /**
@@ -120,8 +576,10 @@ void resource_array_clean(ResourceArray *array) {
     for (int i = 0; i < array->size; i++) {
         resource_destroy(array->resources[i]);
     }
-    // free the array memory
+    // free the array memory, and any arrays it replaced
     free(array->resources);
+    free(array->view);
+    retired_list_clean(&array->retired);
 }
 
 /**
@@ -129,17 +587,26 @@ void resource_array_clean(ResourceArray *array) {
  *
  * Resizes the array when the capacity is reached and adds the new `Resource`.
  * Use of realloc is NOT permitted.
+ *
+ * Published the same way as `system_array_add`, so readers may iterate at the same time as
+ * a single writer.
  * 
  * @param[in,out] array     Pointer to the `ResourceArray`.
  * @param[in]     resource  Pointer to the `Resource` to add.
  */
 void resource_array_add(ResourceArray *array, Resource *resource) {
+    // a resource keeps the id it was given when first added, even if it moves to another array
+    if (resource->id < 0) {
+        resource->id = array->next_id++;
+    }
+
     // Case 1: sufficient capacity
     if (array->size < array->capacity) {
         // add the resource to the array
         array->resources[array->size] = resource;
-        // increase the size of the array
-        array->size++;
+        // increase the size of the array, after the resource is in place
+        __atomic_store_n(&array->size, array->size + 1, __ATOMIC_RELEASE);
+        resource_array_publish(array);
     }
     // Case 2: insufficient capacity
     else {
@@ -155,16 +622,96 @@ void resource_array_add(ResourceArray *array, Resource *resource) {
             temp_resources[i] = array->resources[i];
         }
 
-        // free the old array memory
-        free(array->resources);
-        // update the resources array to point to the new one
-        array->resources = temp_resources;
+        // add the new resource
+        temp_resources[array->size] = resource;
+
+        // publish the new array, keeping the old one until clean since readers may still hold it
+        retired_list_add(&array->retired, array->resources);
+        __atomic_store_n(&array->resources, temp_resources, __ATOMIC_RELEASE);
         // update the capacity to the new size
         array->capacity *= 2;
-
-        // add the new resource
-        array->resources[array->size] = resource;
         // increase the size of the array
-        array->size++;
+        __atomic_store_n(&array->size, array->size + 1, __ATOMIC_RELEASE);
+        resource_array_publish(array);
+    }
+}
+
+/**
+ * Removes a `Resource` from the `ResourceArray`, keeping the order of the others.
+ *
+ * The resource is not destroyed. Published the same way as `system_array_remove`.
+ *
+ * @param[in,out] array     Pointer to the `ResourceArray`.
+ * @param[in]     resource  Pointer to the `Resource` to remove.
+ * @return                  0 on success, -1 if the resource is not in the array or memory ran out.
+ */
+int resource_array_remove(ResourceArray *array, Resource *resource) {
+    Resource **temp_resources;
+    int i, j = 0, found = 0;
+
+    for (i = 0; i < array->size; i++) {
+        found |= (array->resources[i] == resource);
+    }
+    if (!found) {
+        return -1;
+    }
+
+    temp_resources = (Resource **)malloc(sizeof(Resource *) * array->capacity);
+    if (temp_resources == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < array->size; i++) {
+        if (array->resources[i] != resource) {
+            temp_resources[j++] = array->resources[i];
+        }
+    }
+
+    retired_list_add(&array->retired, array->resources);
+    __atomic_store_n(&array->resources, temp_resources, __ATOMIC_RELEASE);
+    __atomic_store_n(&array->size, j, __ATOMIC_RELEASE);
+    resource_array_publish(array);
+    return 0;
+}
+
+/**
+ * Takes a consistent view of the `ResourceArray` for iterating without a lock.
+ *
+ * The size and the array are read from one published view, see `system_array_snapshot`.
+ *
+ * @param[in]  array      Pointer to the `ResourceArray`.
+ * @param[out] resources  Set to the array of resources to iterate.
+ * @return                Number of resources that may be read from `*resources`.
+ */
+int resource_array_snapshot(const ResourceArray *array, Resource ***resources) {
+    ResourceArrayView *view = __atomic_load_n(&array->view, __ATOMIC_ACQUIRE);
+
+    if (view == NULL) {
+        *resources = NULL;
+        return 0;
+    }
+    *resources = view->resources;
+    return view->size;
+}
+
+/**
+ * Publishes the array's current size and backing array to readers as one view.
+ *
+ * Works the same way as the `SystemArray`'s, the replaced view is retired.
+ *
+ * @param[in,out] array  Pointer to the `ResourceArray`, after a resource was added or removed.
+ */
+static void resource_array_publish(ResourceArray *array) {
+    ResourceArrayView *view = (ResourceArrayView *)malloc(sizeof(ResourceArrayView));
+
+    if (view == NULL) {
+        return;
+    }
+    view->resources = array->resources;
+    view->size = array->size;
+
+    if (array->view != NULL) {
+        retired_list_add(&array->retired, array->view);
     }
+    __atomic_store_n(&array->view, view, __ATOMIC_RELEASE);
 }
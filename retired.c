@@ -0,0 +1,61 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+#include "defs.h"
+#include <stdlib.h>
+
+/**
+ * Initializes an empty `RetiredList`.
+ *
+ * @param[out] list  Pointer to the `RetiredList` to initialize.
+ */
+void retired_list_init(RetiredList *list) {
+    list->items = NULL;
+    list->size = 0;
+    list->capacity = 0;
+}
+
+/**
+ * Frees everything in the `RetiredList`, then the list itself.
+ *
+ * Only safe once no other thread can still be reading any of the items.
+ *
+ * @param[in,out] list  Pointer to the `RetiredList` to clean.
+ */
+void retired_list_clean(RetiredList *list) {
+    for (int i = 0; i < list->size; i++) {
+        free(list->items[i]);
+    }
+    free(list->items);
+    retired_list_init(list);
+}
+
+/**
+ * Adds an allocation to the `RetiredList`, resizing if necessary (doubling the size).
+ *
+ * Use of realloc is NOT permitted. If the list cannot grow the item is leaked rather than
+ * freed, since a reader may still hold it.
+ *
+ * @param[in,out] list  Pointer to the `RetiredList`.
+ * @param[in]     item  Allocation to free when the list is cleaned.
+ */
+void retired_list_add(RetiredList *list, void *item) {
+    void **temp_items;
+
+    if (list->size == list->capacity) {
+        temp_items = (void **)malloc(sizeof(void *) * (list->capacity > 0 ? list->capacity * 2 : 4));
+        if (temp_items == NULL) {
+            return;
+        }
+
+        for (int i = 0; i < list->size; i++) {
+            temp_items[i] = list->items[i];
+        }
+
+        free(list->items);
+        list->items = temp_items;
+        list->capacity = (list->capacity > 0) ? list->capacity * 2 : 4;
+    }
+
+    list->items[list->size++] = item;
+}
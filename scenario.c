@@ -0,0 +1,266 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// The scenario generator builds large, random but reproducible workloads in place of `load_data`.
+// Resources are arranged in layers: sources produce the first layer, the producers of each later
+// layer consume one resource of the layer before it, and sinks drain the last layer. Every layered
+// resource has `fan_in` producers, and the layer sizes are chosen so each one has `fan_out` consumers
+// on average. A few hot resources, refilled by their own systems, are shared by many first layer
+// producers so that some locks are contended the way Fuel is in the sample data.
+//
+// The same seed and configuration always give the same scenario, on any machine.
+
+#include "defs.h"
+#include <stdio.h>
+#include <math.h>
+
+// Helper functions just used by this C file
+
+static unsigned long long scenario_random(unsigned long long *state);
+static int scenario_random_below(unsigned long long *state, int limit);
+static int scenario_processing_time(unsigned long long *state, const ScenarioConfig *config);
+static int scenario_add_resource(Manager *manager, const char *name, int amount, int max_capacity);
+static int scenario_add_system(Manager *manager, const char *name, Resource *consumed, int consumed_amount,
+                               Resource *produced, int produced_amount, int processing_time);
+
+/**
+ * Sets a `ScenarioConfig` to the default shape with no systems.
+ *
+ * @param[out] config  Pointer to the `ScenarioConfig` to initialize.
+ */
+void scenario_config_init(ScenarioConfig *config) {
+    config->seed = SCENARIO_DEFAULT_SEED;
+    config->systems = 0;
+    config->fan_in = SCENARIO_DEFAULT_FAN_IN;
+    config->fan_out = SCENARIO_DEFAULT_FAN_OUT;
+    config->depth = SCENARIO_DEFAULT_DEPTH;
+    config->hot = SCENARIO_DEFAULT_HOT;
+    config->hot_share = SCENARIO_DEFAULT_HOT_SHARE;
+    config->pt_mean = SCENARIO_DEFAULT_PT_MEAN;
+    config->pt_distribution = SCENARIO_PT_UNIFORM;
+}
+
+/**
+ * Generates a scenario into an empty `Manager`.
+ *
+ * The number of systems generated is close to, but not always exactly, `config->systems`,
+ * since every layer holds a whole number of resources.
+ *
+ * @param[in,out] manager  Pointer to the `Manager` to populate.
+ * @param[in]     config   Shape of the scenario.
+ * @return                 0 on success, -1 if the configuration is invalid or memory ran out.
+ */
+int scenario_generate(Manager *manager, const ScenarioConfig *config) {
+    unsigned long long state = config->seed;
+    Resource **resources;
+    Resource *consumed;
+    char name[64];
+    double ratio, layer_weight = 0, first_layer, width;
+    int layer, i, k, start, previous_start = 0, previous_count = 0, count, hot_start, layered;
+
+    if (config->systems <= 0 || config->fan_in <= 0 || config->fan_out <= 0 || config->depth <= 0 ||
+        config->hot < 0 || config->hot_share < 0 || config->hot_share > 100 || config->pt_mean <= 0) {
+        return -1;
+    }
+
+    // Each layer is `fan_out / fan_in` times as wide as the one before it, so that its producers
+    // consume every resource of the previous layer `fan_out` times on average
+    ratio = (double)config->fan_out / config->fan_in;
+    for (layer = 0, width = 1; layer < config->depth; layer++, width *= ratio) {
+        layer_weight += width;
+    }
+    width /= ratio;
+    first_layer = (config->systems - config->hot * config->fan_in) / (config->fan_in * layer_weight + config->fan_out * width);
+    if (first_layer < 1) {
+        first_layer = 1;
+    }
+
+    // Hot resources start full and are refilled by their own systems
+    hot_start = manager->resource_array.size;
+    for (i = 0; i < config->hot; i++) {
+        snprintf(name, sizeof(name), "Hot %d", i);
+        if (scenario_add_resource(manager, name, 1000, 1000) != 0) {
+            return -1;
+        }
+        for (k = 0; k < config->fan_in; k++) {
+            snprintf(name, sizeof(name), "Refill %d.%d", i, k);
+            if (scenario_add_system(manager, name, NULL, 0, manager->resource_array.resources[hot_start + i],
+                                    10 + scenario_random_below(&state, 11), scenario_processing_time(&state, config)) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    for (layer = 0, width = first_layer; layer < config->depth; layer++, width *= ratio) {
+        count = (int)(width + 0.5);
+        if (count < 1) {
+            count = 1;
+        }
+
+        start = manager->resource_array.size;
+        for (i = 0; i < count; i++) {
+            snprintf(name, sizeof(name), "R%d.%d", layer, i);
+            if (scenario_add_resource(manager, name, 25, 50 + scenario_random_below(&state, 51)) != 0) {
+                return -1;
+            }
+        }
+
+        // The array may have grown, so the resources are looked up again after adding
+        resources = manager->resource_array.resources;
+        for (i = 0; i < count; i++) {
+            for (k = 0; k < config->fan_in; k++) {
+                consumed = NULL;
+                if (layer > 0) {
+                    consumed = resources[previous_start + scenario_random_below(&state, previous_count)];
+                }
+                else if (config->hot > 0 && scenario_random_below(&state, 100) < config->hot_share) {
+                    consumed = resources[hot_start + scenario_random_below(&state, config->hot)];
+                }
+
+                snprintf(name, sizeof(name), "P%d.%d.%d", layer, i, k);
+                if (scenario_add_system(manager, name, consumed, 1 + scenario_random_below(&state, 3), resources[start + i],
+                                        1 + scenario_random_below(&state, 3), scenario_processing_time(&state, config)) != 0) {
+                    return -1;
+                }
+            }
+        }
+
+        previous_start = start;
+        previous_count = count;
+    }
+
+    // Sinks drain the last layer, `fan_out` per resource
+    resources = manager->resource_array.resources;
+    layered = 0;
+    for (i = 0; i < previous_count; i++) {
+        for (k = 0; k < config->fan_out; k++) {
+            snprintf(name, sizeof(name), "Sink %d", layered++);
+            if (scenario_add_system(manager, name, resources[previous_start + i], 1 + scenario_random_below(&state, 3),
+                                    NULL, 0, scenario_processing_time(&state, config)) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Draws the next number from a xorshift64* generator.
+ *
+ * Small and fully specified, so a seed gives the same scenario everywhere, unlike `rand`.
+ *
+ * @param[in,out] state  Generator state, advanced by one step.
+ * @return               A uniformly distributed 64 bit number.
+ */
+static unsigned long long scenario_random(unsigned long long *state) {
+    // xorshift gets stuck at zero, so a zero seed is moved off it
+    if (*state == 0) {
+        *state = 0x9E3779B97F4A7C15ULL;
+    }
+
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Draws a number in `[0, limit)`.
+ *
+ * @param[in,out] state  Generator state.
+ * @param[in]     limit  Number of possible values, must be positive.
+ * @return               A number from 0 to `limit - 1`.
+ */
+static int scenario_random_below(unsigned long long *state, int limit) {
+    return (int)((scenario_random(state) >> 11) % (unsigned long long)limit);
+}
+
+/**
+ * Draws a processing time from the configured distribution.
+ *
+ * @param[in,out] state   Generator state.
+ * @param[in]     config  Holds the mean and the distribution.
+ * @return                Processing time in milliseconds, at least 1.
+ */
+static int scenario_processing_time(unsigned long long *state, const ScenarioConfig *config) {
+    double uniform = (scenario_random(state) >> 11) * (1.0 / 9007199254740992.0);   // [0, 1)
+    double fast = config->pt_mean / 1.9;
+    double time;
+
+    if (config->pt_distribution == SCENARIO_PT_EXPONENTIAL) {
+        // Capped so a rare draw does not leave a system idle for the whole run
+        time = -config->pt_mean * log(1.0 - uniform);
+        if (time > config->pt_mean * 10.0) {
+            time = config->pt_mean * 10.0;
+        }
+    }
+    else if (config->pt_distribution == SCENARIO_PT_BIMODAL) {
+        // Nine in ten take `fast`, the rest ten times as long, which averages to the mean
+        time = (uniform < 0.9) ? fast : fast * 10.0;
+    }
+    else {
+        time = config->pt_mean * (0.5 + uniform);
+    }
+
+    return (time < 1.0) ? 1 : (int)(time + 0.5);
+}
+
+/**
+ * Creates a resource and adds it to the manager.
+ *
+ * @param[in,out] manager       Pointer to the `Manager`.
+ * @param[in]     name          Name of the resource.
+ * @param[in]     amount        Starting amount.
+ * @param[in]     max_capacity  Capacity of the resource.
+ * @return                      0 on success, -1 if memory ran out.
+ */
+static int scenario_add_resource(Manager *manager, const char *name, int amount, int max_capacity) {
+    Resource *resource;
+    int size = manager->resource_array.size;
+
+    resource_create(&resource, name, amount, max_capacity);
+    if (resource == NULL) {
+        return -1;
+    }
+
+    resource_array_add(&manager->resource_array, resource);
+    if (manager->resource_array.size == size) {
+        resource_destroy(resource);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Creates a system and adds it to the manager.
+ *
+ * @param[in,out] manager          Pointer to the `Manager`.
+ * @param[in]     name             Name of the system.
+ * @param[in]     consumed         Resource consumed, or NULL for none.
+ * @param[in]     consumed_amount  Amount consumed per conversion.
+ * @param[in]     produced         Resource produced, or NULL for none.
+ * @param[in]     produced_amount  Amount produced per conversion.
+ * @param[in]     processing_time  Processing time in milliseconds.
+ * @return                         0 on success, -1 if memory ran out.
+ */
+static int scenario_add_system(Manager *manager, const char *name, Resource *consumed, int consumed_amount,
+                               Resource *produced, int produced_amount, int processing_time) {
+    ResourceAmount consume, produce;
+    System *system;
+    int size = manager->system_array.size;
+
+    resource_amount_init(&consume, consumed, consumed_amount);
+    resource_amount_init(&produce, produced, produced_amount);
+    system_create(&system, name, consume, produce, processing_time, &manager->event_queue);
+    if (system == NULL) {
+        return -1;
+    }
+
+    system_array_add(&manager->system_array, system);
+    if (manager->system_array.size == size) {
+        system_destroy(system);
+        return -1;
+    }
+    return 0;
+}
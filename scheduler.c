@@ -0,0 +1,201 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+#include "defs.h"
+#include <stdlib.h>
+#include <time.h>
+
+// Helper functions just used by this C file
+
+static unsigned long long scheduler_now(const Scheduler *scheduler);
+static unsigned long long scheduler_ticks(double milliseconds);
+
+/**
+ * Initializes the `Scheduler` and schedules every system in the manager to step on the first tick.
+ *
+ * Also registers the scheduler with the manager, so status changes made by the manager reschedule
+ * the affected systems.
+ *
+ * @param[out]    scheduler  Pointer to the `Scheduler` to initialize.
+ * @param[in,out] manager    Pointer to the `Manager` whose systems will be driven.
+ */
+void scheduler_init(Scheduler *scheduler, Manager *manager) {
+    timer_wheel_init(&scheduler->wheel, 0);
+    sem_init(&scheduler->mutex, 0, 1);
+    scheduler->start_ns = clock_now_ns();
+    scheduler->active = 0;
+    scheduler->manager = manager;
+    manager->scheduler = scheduler;
+
+    for (int i = 0; i < manager->system_array.size; i++) {
+        scheduler_add(scheduler, manager->system_array.systems[i]);
+    }
+}
+
+/**
+ * Cleans up the `Scheduler`.
+ *
+ * @param[in,out] scheduler  Pointer to the `Scheduler` to clean.
+ */
+void scheduler_clean(Scheduler *scheduler) {
+    if (scheduler->manager != NULL && scheduler->manager->scheduler == scheduler) {
+        scheduler->manager->scheduler = NULL;
+    }
+    sem_destroy(&scheduler->mutex);
+}
+
+/**
+ * Adds a `System` to the `Scheduler`, to take its first step on the next tick.
+ *
+ * @param[in,out] scheduler  Pointer to the `Scheduler`.
+ * @param[in,out] system     Pointer to the `System` to drive.
+ */
+void scheduler_add(Scheduler *scheduler, System *system) {
+    if (system->status == TERMINATE) {
+        return;
+    }
+
+    sem_wait(&scheduler->mutex);
+    system->timer.owner = system;
+    system->timer.pending = 0;
+    system->phase = SYSTEM_PHASE_IDLE;
+    system->phase_duration = 0;
+    timer_wheel_insert(&scheduler->wheel, &system->timer, scheduler->wheel.current + 1);
+    scheduler->active++;
+    sem_post(&scheduler->mutex);
+}
+
+/**
+ * Reschedules a `System` after the manager has changed its status.
+ *
+ * A terminated system has its timer cancelled, and any conversion it had reserved for is released. A system in the middle of processing has the
+ * remaining time scaled by how much faster or slower its new status makes it. Systems that are
+ * backing off, or that are being stepped right now, pick up the new status on their next step.
+ *
+ * @param[in,out] scheduler  Pointer to the `Scheduler`.
+ * @param[in,out] system     Pointer to the `System` whose status changed.
+ */
+void scheduler_reschedule(Scheduler *scheduler, System *system) {
+    unsigned long long remaining;
+    double duration;
+
+    sem_wait(&scheduler->mutex);
+
+    if (system->timer.pending) {
+        if (system->status == TERMINATE) {
+            timer_wheel_cancel(&scheduler->wheel, &system->timer);
+            scheduler->active--;
+            // The system will not be stepped again, so hand back what its conversion reserved
+            if (system->phase == SYSTEM_PHASE_PROCESSING) {
+                system_release(system);
+                system->phase = SYSTEM_PHASE_IDLE;
+            }
+        } else if (system->phase == SYSTEM_PHASE_PROCESSING && system->phase_duration > 0) {
+            remaining = system->timer.expires - scheduler->wheel.current;
+            duration = system_adjusted_processing_time(system);
+            timer_wheel_insert(&scheduler->wheel, &system->timer,
+                               scheduler->wheel.current + scheduler_ticks(remaining * WHEEL_TICK_MS * duration / system->phase_duration));
+            system->phase_duration = duration;
+        }
+    }
+
+    sem_post(&scheduler->mutex);
+}
+
+/**
+ * Runs the `Scheduler` until every system has terminated.
+ *
+ * Each tick the wheel is advanced to the current time, then the thread sleeps until the next one.
+ *
+ * @param[in] arg  Pointer to the `Scheduler` object.
+ * @return    NULL when every system has terminated.
+ */
+void *scheduler_thread(void *arg) {
+    Scheduler *scheduler = (Scheduler *)arg;
+    long long wake_ns;
+    struct timespec ts;
+
+    while (scheduler_poll(scheduler) >= 0) {
+        // Sleep until the start of the next tick
+        wake_ns = scheduler->start_ns + (long long)(scheduler->wheel.current + 1) * WHEEL_TICK_MS * 1000000LL - clock_now_ns();
+        if (wake_ns > 0) {
+            ts.tv_sec = wake_ns / 1000000000LL;
+            ts.tv_nsec = wake_ns % 1000000000LL;
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Advances the `Scheduler` to the current time and steps every system whose timer expired.
+ *
+ * Expired systems are stepped outside the scheduler's lock (stepping takes resource and event
+ * queue locks), then put back in the wheel for as long as their step asked to wait. A system
+ * terminated during its step hands back what the step reserved, as in `scheduler_reschedule`.
+ * Only one thread may poll a scheduler at a time.
+ *
+ * @param[in,out] scheduler  Pointer to the `Scheduler`.
+ * @return                   Number of systems stepped, or -1 once every system has terminated.
+ */
+int scheduler_poll(Scheduler *scheduler) {
+    TimerNode *expired, *node, *next;
+    System *system;
+    unsigned long long now = scheduler_now(scheduler);
+    int delay, active, stepped = 0;
+
+    sem_wait(&scheduler->mutex);
+    expired = timer_wheel_advance(&scheduler->wheel, now);
+    active = scheduler->active;
+    sem_post(&scheduler->mutex);
+
+    if (active == 0) {
+        return -1;
+    }
+
+    for (node = expired; node != NULL; node = next) {
+        next = node->next;
+        system = (System *)node->owner;
+        lockprof_set_current(system);
+        delay = system_step(system);
+        lockprof_set_current(NULL);
+        stepped++;
+
+        sem_wait(&scheduler->mutex);
+        if (delay < 0 || system->status == TERMINATE) {
+            scheduler->active--;
+            // Terminated while this step started a conversion, which no later step will finish
+            if (system->phase == SYSTEM_PHASE_PROCESSING) {
+                system_release(system);
+                system->phase = SYSTEM_PHASE_IDLE;
+            }
+        } else {
+            timer_wheel_insert(&scheduler->wheel, node, scheduler->wheel.current + scheduler_ticks(delay));
+        }
+        sem_post(&scheduler->mutex);
+    }
+
+    return stepped;
+}
+
+/**
+ * Computes the current tick of the `Scheduler`.
+ *
+ * @param[in] scheduler  Pointer to the `Scheduler`.
+ * @return               Ticks elapsed since the scheduler was initialized.
+ */
+static unsigned long long scheduler_now(const Scheduler *scheduler) {
+    return (unsigned long long)((clock_now_ns() - scheduler->start_ns) / (WHEEL_TICK_MS * 1000000LL));
+}
+
+/**
+ * Converts a wait in milliseconds to a whole number of ticks, rounding to the nearest tick.
+ *
+ * @param[in] milliseconds  Time to wait.
+ * @return                  Number of ticks, at least one.
+ */
+static unsigned long long scheduler_ticks(double milliseconds) {
+    unsigned long long ticks = (unsigned long long)(milliseconds / WHEEL_TICK_MS + 0.5);
+    return (ticks > 0) ? ticks : 1;
+}
@@ -11,8 +11,23 @@
 // Using static means they can't get linked into other files
 
 static int system_convert(System *);
+static int system_consume_resources(System *);
+static void system_complete_conversion(System *);
 static void system_simulate_process_time(System *);
 static int system_store_resources(System *);
+static int system_reserve_resources(System *);
+static void system_lock_pair(Resource *, Resource *);
+static void system_unlock_pair(Resource *, Resource *);
+static void system_warn_low(System *, Resource *, int);
+static void system_select_run(System *);
+static void system_run_source(System *);
+static void system_run_sink(System *);
+static void system_run_converter(System *);
+static int system_take(System *);
+static int system_put(System *);
+static void system_back_off(System *, Resource *, int, int);
+static int system_pool(const System *, const Resource *);
+static void system_array_publish(SystemArray *);
 
 /**
  * Creates a new `System` object.
@@ -47,13 +62,41 @@ void system_create(System **system, const char *name, ResourceAmount consumed, R
     // copy the name into the allocated space
     strcpy((*system)->name, name);
 
-    // initialize other attributes
+    // initialize other attributes, the id is assigned once the system is added to an array
+    (*system)->id = -1;
     (*system)->consumed = consumed;
     (*system)->produced = produced;
     (*system)->amount_stored = 0;
+    (*system)->reserve_output = 0;
+    (*system)->reserved = 0;
+    memset(&(*system)->lock_waits, 0, sizeof(LockStats));
     (*system)->processing_time = processing_time;
     (*system)->status = STANDARD;
+    (*system)->rate_multiplier = 1.0;
     (*system)->event_queue = event_queue;
+    (*system)->timer.pending = 0;
+    (*system)->timer.owner = *system;
+    (*system)->phase = SYSTEM_PHASE_IDLE;
+    (*system)->phase_duration = 0;
+    (*system)->telemetry = NULL;
+    (*system)->history_index = -1;
+    (*system)->threaded = 0;
+    (*system)->conversions = 0;
+    (*system)->cpu = -1;
+    system_select_run(*system);
+}
+
+/**
+ * Sets whether a `System` reserves its output space before each conversion.
+ *
+ * The loop body is chosen again, since a reserving system locks its input and output together.
+ *
+ * @param[in,out] system          Pointer to the `System`, not yet running.
+ * @param[in]     reserve_output  non-zero to reserve the output space before consuming.
+ */
+void system_set_reserve_output(System *system, int reserve_output) {
+    system->reserve_output = reserve_output;
+    system_select_run(system);
 }
 
 /**
@@ -91,9 +134,14 @@ void system_run(System *system) {
         // Need to convert resources (consume and process)
         result_status = system_convert(system);
 
-        if (result_status != STATUS_OK) {
+        if (result_status == STATUS_CAPACITY) {
+            // Report that there was no space reserved for the output, nothing was consumed
+            event_init(&event, system, system->produced.resource, result_status, PRIORITY_LOW, resource_read_amount(system->produced.resource));
+            event_queue_push(system->event_queue, &event);
+            usleep(SYSTEM_WAIT_TIME * 1000);
+        } else if (result_status != STATUS_OK) {
             // Report that resources were out / insufficient
-            event_init(&event, system, system->consumed.resource, result_status, PRIORITY_HIGH, system->consumed.resource->amount);
+            event_init(&event, system, system->consumed.resource, result_status, PRIORITY_HIGH, resource_read_amount(system->consumed.resource));
             event_queue_push(system->event_queue, &event);    
             // Sleep to prevent looping too frequently and spamming with events
             usleep(SYSTEM_WAIT_TIME * 1000);          
@@ -105,7 +153,7 @@ void system_run(System *system) {
         result_status = system_store_resources(system);
 
         if (result_status != STATUS_OK) {
-            event_init(&event, system, system->produced.resource, result_status, PRIORITY_LOW, system->produced.resource->amount);
+            event_init(&event, system, system->produced.resource, result_status, PRIORITY_LOW, resource_read_amount(system->produced.resource));
             event_queue_push(system->event_queue, &event);
             // Sleep to prevent looping too frequently and spamming with events
             usleep(SYSTEM_WAIT_TIME * 1000);
@@ -113,75 +161,416 @@ void system_run(System *system) {
     }
 }
 
+/**
+ * Chooses the loop body for the shape of a `System`, which never changes once it is created.
+ *
+ * Sources, sinks and converters get a body with only the steps their resources need. Systems that
+ * reserve their output, and systems using no resource, run the general `system_run`.
+ *
+ * @param[in,out] system  Pointer to the `System`.
+ */
+static void system_select_run(System *system) {
+    if (system->reserve_output && system->produced.resource != NULL) {
+        system->shape = SYSTEM_SHAPE_GENERAL;
+    } else if (system->consumed.resource == NULL && system->produced.resource != NULL) {
+        system->shape = SYSTEM_SHAPE_SOURCE;
+    } else if (system->consumed.resource != NULL && system->produced.resource == NULL) {
+        system->shape = SYSTEM_SHAPE_SINK;
+    } else if (system->consumed.resource != NULL) {
+        system->shape = SYSTEM_SHAPE_CONVERTER;
+    } else {
+        system->shape = SYSTEM_SHAPE_GENERAL;
+    }
+
+    switch (system->shape) {
+        case SYSTEM_SHAPE_SOURCE:
+            system->run = system_run_source;
+            break;
+        case SYSTEM_SHAPE_SINK:
+            system->run = system_run_sink;
+            break;
+        case SYSTEM_SHAPE_CONVERTER:
+            system->run = system_run_converter;
+            break;
+        default:
+            system->run = system_run;
+    }
+}
+
+/**
+ * `system_run` for a system that only produces.
+ *
+ * @param[in,out] system  Pointer to the `System` to run.
+ */
+static void system_run_source(System *system) {
+    // Produce unless output from before is still waiting for space
+    if (system->amount_stored == 0) {
+        system_simulate_process_time(system);
+        __atomic_store_n(&system->conversions, system->conversions + 1, __ATOMIC_RELAXED);
+        system->amount_stored = system->produced.amount;
+    }
+
+    if (system_put(system) != STATUS_OK) {
+        system_back_off(system, system->produced.resource, STATUS_CAPACITY, PRIORITY_LOW);
+    }
+}
+
+/**
+ * `system_run` for a system that only consumes.
+ *
+ * @param[in,out] system  Pointer to the `System` to run.
+ */
+static void system_run_sink(System *system) {
+    int result_status = system_take(system);
+
+    if (result_status != STATUS_OK) {
+        system_back_off(system, system->consumed.resource, result_status, PRIORITY_HIGH);
+        return;
+    }
+
+    system_simulate_process_time(system);
+    __atomic_store_n(&system->conversions, system->conversions + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * `system_run` for a system that consumes one resource and produces another without reserving.
+ *
+ * @param[in,out] system  Pointer to the `System` to run.
+ */
+static void system_run_converter(System *system) {
+    int result_status;
+
+    // Convert unless output from before is still waiting for space
+    if (system->amount_stored == 0) {
+        result_status = system_take(system);
+        if (result_status != STATUS_OK) {
+            system_back_off(system, system->consumed.resource, result_status, PRIORITY_HIGH);
+            return;
+        }
+
+        system_simulate_process_time(system);
+        __atomic_store_n(&system->conversions, system->conversions + 1, __ATOMIC_RELAXED);
+        system->amount_stored = system->produced.amount;
+    }
+
+    if (system_put(system) != STATUS_OK) {
+        system_back_off(system, system->produced.resource, STATUS_CAPACITY, PRIORITY_LOW);
+    }
+}
+
+/**
+ * Chooses which pool of a pooled resource a `System` uses, spreading systems evenly over the pools.
+ *
+ * @param[in] system    Pointer to the `System`.
+ * @param[in] resource  Pointer to the pooled `Resource`.
+ * @return              Index of the pool.
+ */
+static int system_pool(const System *system, const Resource *resource) {
+    return (system->id > 0 ? system->id : 0) % resource->pool_count;
+}
+
+/**
+ * Reports a failed step to the manager and waits before the system tries again.
+ *
+ * @param[in,out] system    Pointer to the `System` that failed.
+ * @param[in]     resource  Pointer to the `Resource` that was short or full.
+ * @param[in]     status    Status to report.
+ * @param[in]     priority  Priority of the event.
+ */
+static void system_back_off(System *system, Resource *resource, int status, int priority) {
+    Event event;
+
+    event_init(&event, system, resource, status, priority, resource_read_amount(resource));
+    event_queue_push(system->event_queue, &event);
+    // Sleep to prevent looping too frequently and spamming with events
+    usleep(SYSTEM_WAIT_TIME * 1000);
+}
+
+/**
+ * Takes a single non-blocking step of a `System` driven by a `Scheduler`.
+ *
+ * Performs the same work as `system_run`, but instead of sleeping through the processing time or
+ * the back-off after a failure, it returns how long to wait and remembers where it left off in
+ * `phase`. A step finishes any processing that has just ended, stores the output, then consumes
+ * the inputs for the next conversion.
+ *
+ * @param[in,out] system  Pointer to the `System` to step.
+ * @return                Milliseconds until the next step, or -1 if the system has terminated.
+ */
+int system_step(System *system) {
+    Event event;
+    int result_status;
+
+    if (system->status == TERMINATE) {
+        // Give back whatever a conversion cut short had reserved
+        if (system->phase == SYSTEM_PHASE_PROCESSING) {
+            system_release(system);
+            system->phase = SYSTEM_PHASE_IDLE;
+        }
+        return -1;
+    }
+
+    // Processing has finished, so the output is ready to be stored
+    if (system->phase == SYSTEM_PHASE_PROCESSING) {
+        system_complete_conversion(system);
+        system->phase = SYSTEM_PHASE_IDLE;
+    }
+
+    if (system->amount_stored > 0) {
+        result_status = system_store_resources(system);
+
+        if (result_status != STATUS_OK) {
+            event_init(&event, system, system->produced.resource, result_status, PRIORITY_LOW, resource_read_amount(system->produced.resource));
+            event_queue_push(system->event_queue, &event);
+            // Back off to prevent looping too frequently and spamming with events
+            return SYSTEM_WAIT_TIME;
+        }
+    }
+
+    result_status = system_consume_resources(system);
+
+    if (result_status == STATUS_CAPACITY) {
+        // Report that there was no space reserved for the output, nothing was consumed
+        event_init(&event, system, system->produced.resource, result_status, PRIORITY_LOW, resource_read_amount(system->produced.resource));
+        event_queue_push(system->event_queue, &event);
+        return SYSTEM_WAIT_TIME;
+    }
+
+    if (result_status != STATUS_OK) {
+        // Report that resources were out / insufficient
+        event_init(&event, system, system->consumed.resource, result_status, PRIORITY_HIGH, resource_read_amount(system->consumed.resource));
+        event_queue_push(system->event_queue, &event);
+        // Back off to prevent looping too frequently and spamming with events
+        return SYSTEM_WAIT_TIME;
+    }
+
+    system->phase = SYSTEM_PHASE_PROCESSING;
+    system->phase_duration = system_adjusted_processing_time(system);
+    return (int)(system->phase_duration + 0.5);
+}
+
+/**
+ * Maps a system status code to a human-readable string.
+ *
+ * @param[in] status  One of the system status codes (`TERMINATE`, `DISABLED`, `SLOW`, `STANDARD`, `FAST`).
+ * @return            A static string naming the status, or "UNKNOWN".
+ */
+const char *system_status_name(int status) {
+    switch (status) {
+        case TERMINATE:
+            return "TERMINATE";
+        case DISABLED:
+            return "DISABLED";
+        case SLOW:
+            return "SLOW";
+        case STANDARD:
+            return "STANDARD";
+        case FAST:
+            return "FAST";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+/**
+ * Publishes the status and rate multiplier of a `System` to its telemetry slot.
+ *
+ * The manager and the control server can both publish a system, so the writer claims the slot by
+ * swapping its sequence from even to odd. Does nothing if the system has no slot.
+ *
+ * @param[in,out] system  Pointer to the `System` to publish.
+ */
+void system_publish(System *system) {
+    TelemetrySystem *slot = system->telemetry;
+    unsigned int sequence;
+
+    if (slot == NULL) {
+        return;
+    }
+
+    // An odd sequence tells readers, and any other writer, that the slot is being written
+    do {
+        sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) & ~1u;
+    } while (!__atomic_compare_exchange_n(&slot->sequence, &sequence, sequence + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&slot->status, system->status, __ATOMIC_RELAXED);
+    __atomic_store(&slot->rate_multiplier, &system->rate_multiplier, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
 /**
  * Converts resources in a `System`.
  *
  * Handles the consumption of required resources and simulates processing time.
  * Updates the amount of produced resources based on the system's configuration.
  *
- * @param[in,out] system           Pointer to the `System` performing the conversion.
- * @param[out]    amount_produced  Pointer to the integer tracking the amount of produced resources.
- * @return                         `STATUS_OK` if successful, or an error status code.
+ * @param[in,out] system  Pointer to the `System` performing the conversion.
+ * @return                `STATUS_OK` if successful, or an error status code.
  */
 static int system_convert(System *system) {
-    int status;
-    Resource *consumed_resource = system->consumed.resource;
-    int amount_consumed = system->consumed.amount;
+    int status = system_consume_resources(system);
 
-    // We can always convert without consuming anything
-    if (consumed_resource == NULL) {
-        status = STATUS_OK;
-    } else {
-        sem_wait(&consumed_resource->mutex);
-        // Attempt to consume the required resources
-        if (consumed_resource->amount >= amount_consumed) {
-            consumed_resource->amount -= amount_consumed;
-            status = STATUS_OK;
+    if (status == STATUS_OK) {
+        system_simulate_process_time(system);
+
+        // A system terminated mid-conversion hands back what it reserved instead of producing
+        if (system->status == TERMINATE && system->reserved > 0) {
+            system_release(system);
         } else {
-            status = (consumed_resource->amount == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+            system_complete_conversion(system);
         }
-        sem_post(&consumed_resource->mutex);
     }
 
-    if (status == STATUS_OK) {
-        system_simulate_process_time(system);
+    return status;
+}
 
-        if (system->produced.resource != NULL) {
-            system->amount_stored += system->produced.amount;
-        }
-        else {
-            system->amount_stored = 0;
+/**
+ * Consumes the input resources of a `System` for one conversion.
+ *
+ * When the system reserves its output, the output space is reserved in the same step and nothing
+ * is consumed unless both are available.
+ *
+ * @param[in,out] system  Pointer to the `System` performing the conversion.
+ * @return                `STATUS_OK` if the inputs were consumed, otherwise `STATUS_EMPTY` or `STATUS_INSUFFICIENT`,
+ *                        or `STATUS_CAPACITY` if the output space could not be reserved.
+ */
+static int system_consume_resources(System *system) {
+    if (system->reserve_output && system->produced.resource != NULL) {
+        return system_reserve_resources(system);
+    }
+
+    // We can always convert without consuming anything
+    if (system->consumed.resource == NULL) {
+        return STATUS_OK;
+    }
+
+    return system_take(system);
+}
+
+/**
+ * Takes the input of one conversion from the resource a `System` consumes.
+ *
+ * A pooled resource is taken from the system's own pool, and its flow is recorded whenever the
+ * resource's lock is free (see `resource_pool_take`), so it still warns before running out.
+ *
+ * @param[in,out] system  Pointer to the `System`, which consumes a resource.
+ * @return                `STATUS_OK` if it was taken, otherwise `STATUS_EMPTY` or `STATUS_INSUFFICIENT`.
+ */
+static int system_take(System *system) {
+    int status, flow_status = STATUS_OK, amount_left = 0;
+    Resource *consumed_resource = system->consumed.resource;
+    int amount_consumed = system->consumed.amount;
+
+    if (consumed_resource->pools != NULL) {
+        status = resource_pool_take(consumed_resource, system_pool(system, consumed_resource), amount_consumed, &flow_status);
+        if (flow_status == STATUS_LOW) {
+            system_warn_low(system, consumed_resource, resource_read_amount(consumed_resource));
         }
+        return status;
+    }
+
+    resource_lock(consumed_resource);
+    // Attempt to consume the required resources
+    if (consumed_resource->amount >= amount_consumed) {
+        consumed_resource->amount -= amount_consumed;
+        resource_publish(consumed_resource);
+        flow_status = resource_record_flow(consumed_resource, -amount_consumed, 0);
+        amount_left = consumed_resource->amount;
+        status = STATUS_OK;
+    } else {
+        status = (consumed_resource->amount == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+    }
+    resource_unlock(consumed_resource);
+
+    if (flow_status == STATUS_LOW) {
+        system_warn_low(system, consumed_resource, amount_left);
     }
 
     return status;
 }
 
 /**
- * Simulates the processing time for a `System`.
+ * Adds the output of a finished conversion to the amount the `System` has waiting to be stored.
+ *
+ * @param[in,out] system  Pointer to the `System` whose processing has finished.
+ */
+static void system_complete_conversion(System *system) {
+    Resource *produced_resource = system->produced.resource;
+
+    // Counted atomically so the benchmark can read it while the system runs
+    __atomic_store_n(&system->conversions, system->conversions + 1, __ATOMIC_RELAXED);
+
+    // Commit a reservation, the space is already set aside so the output always fits
+    if (system->reserved > 0) {
+        resource_lock(produced_resource);
+        produced_resource->reserved -= system->reserved;
+        produced_resource->amount += system->reserved;
+        resource_publish(produced_resource);
+        resource_record_flow(produced_resource, system->reserved, system_adjusted_processing_time(system));
+        resource_unlock(produced_resource);
+        system->reserved = 0;
+        return;
+    }
+
+    if (system->produced.resource != NULL) {
+        system->amount_stored += system->produced.amount;
+    }
+    else {
+        system->amount_stored = 0;
+    }
+}
+
+/**
+ * Computes how long a single conversion takes given the system's current status and rate multiplier.
  *
- * Adjusts the processing time based on the system's current status (e.g., SLOW, FAST)
- * and sleeps for the adjusted time to simulate processing.
+ * @param[in] system  Pointer to the `System`.
+ * @return            Processing time in milliseconds.
+ */
+double system_adjusted_processing_time(const System *system) {
+    return system_scaled_processing_time(system->processing_time, system->status, system->rate_multiplier);
+}
+
+/**
+ * Computes how long a single conversion takes for a processing time, status and rate multiplier.
  *
- * @param[in] system  Pointer to the `System` whose processing time is being simulated.
+ * @param[in] processing_time  Standard processing time in milliseconds.
+ * @param[in] status           System status whose modifier applies (e.g., SLOW, FAST).
+ * @param[in] rate_multiplier  Multiplier set by the manager's controller, 1.0 for none.
+ * @return                     Processing time in milliseconds.
  */
-static void system_simulate_process_time(System *system) {
+double system_scaled_processing_time(int processing_time, int status, double rate_multiplier) {
     int adjusted_processing_time;
 
     // Adjust based on the current system status modifier
-    switch (system->status) {
+    switch (status) {
         case SLOW:
-            adjusted_processing_time = system->processing_time * 2;
+            adjusted_processing_time = processing_time * 2;
             break;
         case FAST:
-            adjusted_processing_time = system->processing_time / 2;
+            adjusted_processing_time = processing_time / 2;
             break;
         default:
-            adjusted_processing_time = system->processing_time;
+            adjusted_processing_time = processing_time;
     }
 
+    // Scale by the multiplier set by the manager's controller
+    if (rate_multiplier > 0) {
+        return adjusted_processing_time / rate_multiplier;
+    }
+    return adjusted_processing_time;
+}
+
+/**
+ * Simulates the processing time for a `System`.
+ *
+ * Sleeps for the processing time adjusted by the system's current status (e.g., SLOW, FAST)
+ * and its rate multiplier.
+ *
+ * @param[in] system  Pointer to the `System` whose processing time is being simulated.
+ */
+static void system_simulate_process_time(System *system) {
     // Sleep for the required time
-    usleep(adjusted_processing_time * 1000);
+    usleep((useconds_t)(system_adjusted_processing_time(system) * 1000));
 }
 
 /**
@@ -196,33 +585,53 @@ static void system_simulate_process_time(System *system) {
  * @return                                 `STATUS_OK` if all resources were stored, or `STATUS_CAPACITY` if not all could be stored.
  */
 static int system_store_resources(System *system) {
-    Resource *produced_resource = system->produced.resource;
-    int available_space, amount_to_store;
-
     // We can always proceed if there's nothing to store
-    if (produced_resource == NULL || system->amount_stored == 0) {
+    if (system->produced.resource == NULL || system->amount_stored == 0) {
         system->amount_stored = 0;
         return STATUS_OK;
     }
 
-    amount_to_store = system->amount_stored;
+    return system_put(system);
+}
+
+/**
+ * Stores as much of the waiting output of a `System` as fits in the resource it produces.
+ *
+ * A pooled resource is stored into the system's own pool.
+ *
+ * @param[in,out] system  Pointer to the `System`, which produces a resource and has output waiting.
+ * @return                `STATUS_OK` if all of it was stored, or `STATUS_CAPACITY` if not all of it fit.
+ */
+static int system_put(System *system) {
+    Resource *produced_resource = system->produced.resource;
+    int available_space, amount_to_store = system->amount_stored;
 
-    sem_wait(&produced_resource->mutex);
+    if (produced_resource->pools != NULL) {
+        system->amount_stored -= resource_pool_put(produced_resource, system_pool(system, produced_resource), amount_to_store,
+                                                   system_adjusted_processing_time(system));
+        return (system->amount_stored != 0) ? STATUS_CAPACITY : STATUS_OK;
+    }
 
-    // Calculate available space
-    available_space = produced_resource->max_capacity - produced_resource->amount;
+    resource_lock(produced_resource);
+
+    // Calculate available space, leaving alone what conversions in progress have reserved
+    available_space = produced_resource->max_capacity - produced_resource->amount - produced_resource->reserved;
 
     if (available_space >= amount_to_store) {
         // Store all produced resources
         produced_resource->amount += amount_to_store;
+        resource_publish(produced_resource);
+        resource_record_flow(produced_resource, amount_to_store, system_adjusted_processing_time(system));
         system->amount_stored = 0;
     } else if (available_space > 0) {
         // Store as much as possible
         produced_resource->amount += available_space;
+        resource_publish(produced_resource);
+        resource_record_flow(produced_resource, available_space, system_adjusted_processing_time(system));
         system->amount_stored = amount_to_store - available_space;
     }
 
-    sem_post(&produced_resource->mutex);
+    resource_unlock(produced_resource);
 
     if (system->amount_stored != 0) {
         return STATUS_CAPACITY;
@@ -231,6 +640,136 @@ static int system_store_resources(System *system) {
     return STATUS_OK;
 }
 
+/**
+ * Reserves the output space and consumes the inputs of one conversion, both or neither.
+ *
+ * Both resources are locked together, in address order so two systems locking the same pair from
+ * opposite ends cannot deadlock.
+ *
+ * @param[in,out] system  Pointer to the `System` about to convert, which produces something.
+ * @return                `STATUS_OK` if both were taken, otherwise the status of whichever was short.
+ */
+static int system_reserve_resources(System *system) {
+    Resource *consumed_resource = system->consumed.resource;
+    Resource *produced_resource = system->produced.resource;
+    int amount_consumed = system->consumed.amount;
+    int amount_produced = system->produced.amount;
+    int status = STATUS_OK, flow_status = STATUS_OK;
+    int available_space, amount_left = 0;
+
+    system_lock_pair(consumed_resource, produced_resource);
+
+    available_space = produced_resource->max_capacity - produced_resource->amount - produced_resource->reserved;
+    // A system that consumes what it produces frees that much space by consuming
+    if (consumed_resource == produced_resource) {
+        available_space += amount_consumed;
+    }
+
+    if (consumed_resource != NULL && consumed_resource->amount < amount_consumed) {
+        status = (consumed_resource->amount == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+    } else if (available_space < amount_produced) {
+        status = STATUS_CAPACITY;
+    } else {
+        if (consumed_resource != NULL) {
+            consumed_resource->amount -= amount_consumed;
+            resource_publish(consumed_resource);
+            flow_status = resource_record_flow(consumed_resource, -amount_consumed, 0);
+            amount_left = consumed_resource->amount;
+        }
+        produced_resource->reserved += amount_produced;
+        system->reserved = amount_produced;
+    }
+
+    system_unlock_pair(consumed_resource, produced_resource);
+
+    if (flow_status == STATUS_LOW) {
+        system_warn_low(system, consumed_resource, amount_left);
+    }
+    return status;
+}
+
+/**
+ * Cancels the conversion a `System` has in progress, if it reserved its output.
+ *
+ * The reserved output space is released and the consumed inputs are returned, as far as they fit.
+ * Called when a system is terminated part way through processing.
+ *
+ * @param[in,out] system  Pointer to the `System` whose conversion is cancelled.
+ */
+void system_release(System *system) {
+    Resource *consumed_resource = system->consumed.resource;
+    Resource *produced_resource = system->produced.resource;
+    int available_space, returned;
+
+    if (system->reserved == 0) {
+        return;
+    }
+
+    system_lock_pair(consumed_resource, produced_resource);
+
+    produced_resource->reserved -= system->reserved;
+    system->reserved = 0;
+
+    if (consumed_resource != NULL) {
+        available_space = consumed_resource->max_capacity - consumed_resource->amount - consumed_resource->reserved;
+        returned = (system->consumed.amount < available_space) ? system->consumed.amount : available_space;
+        if (returned > 0) {
+            consumed_resource->amount += returned;
+            resource_publish(consumed_resource);
+            resource_record_flow(consumed_resource, returned, 0);
+        }
+    }
+
+    system_unlock_pair(consumed_resource, produced_resource);
+}
+
+/**
+ * Locks up to two resources in address order, locking a resource only once if both are the same.
+ *
+ * @param[in,out] first   Pointer to a `Resource`, may be NULL.
+ * @param[in,out] second  Pointer to a `Resource`, may be NULL.
+ */
+static void system_lock_pair(Resource *first, Resource *second) {
+    Resource *low = (first < second) ? first : second;
+    Resource *high = (first < second) ? second : first;
+
+    if (low != NULL) {
+        resource_lock(low);
+    }
+    if (high != NULL && high != low) {
+        resource_lock(high);
+    }
+}
+
+/**
+ * Unlocks resources locked by `system_lock_pair`.
+ *
+ * @param[in,out] first   Pointer to a `Resource`, may be NULL.
+ * @param[in,out] second  Pointer to a `Resource`, may be NULL.
+ */
+static void system_unlock_pair(Resource *first, Resource *second) {
+    if (first != NULL) {
+        resource_unlock(first);
+    }
+    if (second != NULL && second != first) {
+        resource_unlock(second);
+    }
+}
+
+/**
+ * Warns the manager that a resource the system consumes is about to run out, so its producers
+ * can be sped up before anything stalls.
+ *
+ * @param[in] system    Pointer to the `System` that consumed from it.
+ * @param[in] resource  Pointer to the `Resource` running low.
+ * @param[in] amount    Amount left after consuming.
+ */
+static void system_warn_low(System *system, Resource *resource, int amount) {
+    Event event;
+
+    event_init(&event, system, resource, STATUS_LOW, PRIORITY_MED, amount);
+    event_queue_push(system->event_queue, &event);
+}
 
 /**
  * Initializes the `SystemArray`.
@@ -240,6 +779,10 @@ static int system_store_resources(System *system) {
  * @param[out] array  Pointer to the `SystemArray` to initialize.
  */
 void system_array_init(SystemArray *array) {
+    retired_list_init(&array->retired);
+    array->next_id = 0;
+    array->view = NULL;
+
     // allocate memory for array of pointers with initial capacity of 1
     array->systems = (System **)malloc(sizeof(System *) * 1);
 
@@ -251,6 +794,7 @@ void system_array_init(SystemArray *array) {
     // initalize other attributes
     array->size = 0;
     array->capacity = 1;
+    system_array_publish(array);
 }
 
 /**
@@ -265,8 +809,10 @@ void system_array_clean(SystemArray *array) {
     for (int i = 0; i < array->size; i++) {
         system_destroy(array->systems[i]);
     }
-    // free the memory allocated for the array of system pointers
+    // free the memory allocated for the array of system pointers, and any it replaced
     free(array->systems);
+    free(array->view);
+    retired_list_clean(&array->retired);
 }
 
 /**
@@ -275,15 +821,25 @@ void system_array_clean(SystemArray *array) {
  * Resizes the array when the capacity is reached and adds the new `System`.
  * Use of realloc is NOT permitted.
  *
+ * Other threads may be iterating the array through `system_array_snapshot` at the same time, so the
+ * replaced array is retired rather than freed, and the new size is only published along with the
+ * array it belongs to. There must only be one thread adding or removing at a time.
+ *
  * @param[in,out] array   Pointer to the `SystemArray`.
  * @param[in]     system  Pointer to the `System` to add.
  */
 void system_array_add(SystemArray *array, System *system) {
+    // a system keeps the id it was given when first added, even if it moves to another array
+    if (system->id < 0) {
+        system->id = array->next_id++;
+    }
+
     // Case 1: sufficient capacity
     if (array->size < array->capacity) {
         // add system to the array and increase the size
         array->systems[array->size] = system;
-        array->size++;
+        __atomic_store_n(&array->size, array->size + 1, __ATOMIC_RELEASE);
+        system_array_publish(array);
     }
     
     // Case 2: insufficient capacity
@@ -299,21 +855,106 @@ void system_array_add(SystemArray *array, System *system) {
             temp_systems[i] = array->systems[i];
         }
         
-        // free the old array and assign the new array to the systemarray
-        free(array->systems);
-        array->systems = temp_systems;
+        // add the new system to the resized array.
+        temp_systems[array->size] = system;
+
+        // publish the new array, then retire the old one since readers may still hold it
+        retired_list_add(&array->retired, array->systems);
+        __atomic_store_n(&array->systems, temp_systems, __ATOMIC_RELEASE);
         array->capacity *= 2;
+        __atomic_store_n(&array->size, array->size + 1, __ATOMIC_RELEASE);
+        system_array_publish(array);
+    }
+}
 
-        // add the new system to the resized array.
-        array->systems[array->size] = system;
-        array->size++;
+/**
+ * Removes a `System` from the `SystemArray`, keeping the order of the others.
+ *
+ * The system is not destroyed. The remaining systems are copied into a new array, so readers of the
+ * old one are undisturbed.
+ *
+ * @param[in,out] array   Pointer to the `SystemArray`.
+ * @param[in]     system  Pointer to the `System` to remove.
+ * @return                0 on success, -1 if the system is not in the array or memory ran out.
+ */
+int system_array_remove(SystemArray *array, System *system) {
+    System **temp_systems;
+    int i, j = 0, found = 0;
+
+    for (i = 0; i < array->size; i++) {
+        found |= (array->systems[i] == system);
+    }
+    if (!found) {
+        return -1;
+    }
+
+    temp_systems = (System **)malloc(sizeof(System *) * array->capacity);
+    if (temp_systems == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < array->size; i++) {
+        if (array->systems[i] != system) {
+            temp_systems[j++] = array->systems[i];
+        }
+    }
+
+    retired_list_add(&array->retired, array->systems);
+    __atomic_store_n(&array->systems, temp_systems, __ATOMIC_RELEASE);
+    __atomic_store_n(&array->size, j, __ATOMIC_RELEASE);
+    system_array_publish(array);
+    return 0;
+}
+
+/**
+ * Takes a consistent view of the `SystemArray` for iterating without a lock.
+ *
+ * The size and the array are read from one published view, so the size always belongs to that
+ * array. Every pointer in the view stays valid until the array is cleaned, even if the system is
+ * removed in the meantime.
+ *
+ * @param[in]  array    Pointer to the `SystemArray`.
+ * @param[out] systems  Set to the array of systems to iterate.
+ * @return              Number of systems that may be read from `*systems`.
+ */
+int system_array_snapshot(const SystemArray *array, System ***systems) {
+    SystemArrayView *view = __atomic_load_n(&array->view, __ATOMIC_ACQUIRE);
+
+    if (view == NULL) {
+        *systems = NULL;
+        return 0;
+    }
+    *systems = view->systems;
+    return view->size;
+}
+
+/**
+ * Publishes the array's current size and backing array to readers as one view.
+ *
+ * The view it replaces is retired, since readers may still hold it. If no view can be allocated,
+ * readers keep seeing the array as it was, which stays valid until the array is cleaned.
+ *
+ * @param[in,out] array  Pointer to the `SystemArray`, after a system was added or removed.
+ */
+static void system_array_publish(SystemArray *array) {
+    SystemArrayView *view = (SystemArrayView *)malloc(sizeof(SystemArrayView));
+
+    if (view == NULL) {
+        return;
+    }
+    view->systems = array->systems;
+    view->size = array->size;
+
+    if (array->view != NULL) {
+        retired_list_add(&array->retired, array->view);
     }
+    __atomic_store_n(&array->view, view, __ATOMIC_RELEASE);
 }
 
 /**
  * Runs the `system_thread` for a given `System`.
  *
- * Continuously executes the `system_run` function for the given `System` until its status is `TERMINATE`.
+ * Continuously executes the loop body chosen for the system's shape (see `system_run`) until its status is `TERMINATE`.
  *
  * @param[in] arg  Pointer to the `System` object.
  * @return    NULL when the thread terminates.
@@ -321,9 +962,11 @@ void system_array_add(SystemArray *array, System *system) {
 void *system_thread(void *arg) {
     // cast argument to system pointer
     System *system = (System *)arg;
+    // charge this thread's lock waits to the system
+    lockprof_set_current(system);
     // run the system until its status is terminate
     while(system->status != TERMINATE) {
-        system_run(system);
+        system->run(system);
     }
      // return NULL to indicate thread has finished execution
     return NULL;
@@ -0,0 +1,367 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// Resource amounts and system statuses are published into a shared memory segment, one seqlock per slot.
+// A resource slot has a single writer, the thread holding `Resource.mutex`, so publishing an amount never
+// waits on anything. A system's status can be changed by the manager, its shards and the control server,
+// so writers of a system slot claim it with a compare-and-swap and may briefly wait for one another.
+// Readers, the built-in display as well as separate monitor processes, never hold up a writer: they retry
+// a slot until they read it between two identical even sequence numbers, so every value they see is one
+// that was actually published.
+
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TELEMETRY_READ_RETRIES 100000   // Give up on a slot whose writer appears to have died mid-write
+
+/**
+ * Creates the telemetry segment and publishes every resource and system of the manager into it.
+ *
+ * With a `name` the segment is created as POSIX shared memory so external monitors can attach to
+ * it. The name must not exist yet, so a second simulation never takes over the segment of one that
+ * is running. If the segment cannot be created for any other reason it falls back to an anonymous
+ * shared mapping, which still serves the built-in display and any processes forked from this one.
+ *
+ * @param[out]    telemetry  Pointer to the `Telemetry` to initialize.
+ * @param[in]     name       Shared memory name (e.g. `TELEMETRY_DEFAULT_NAME`), or NULL for an anonymous segment.
+ * @param[in,out] manager    Pointer to the `Manager` whose resources and systems are published.
+ * @return                   0 on success, -1 if no segment could be mapped, -2 if `name` is already in use.
+ */
+int telemetry_init(Telemetry *telemetry, const char *name, Manager *manager) {
+    int fd = -1;
+    void *mapping = MAP_FAILED;
+
+    telemetry->segment = NULL;
+    telemetry->name[0] = '\0';
+    telemetry->owner = 0;
+
+    if (name != NULL) {
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0 && errno == EEXIST) {
+            return -2;
+        }
+    }
+
+    if (fd >= 0) {
+        // A new segment starts out cleared
+        if (ftruncate(fd, sizeof(TelemetrySegment)) == 0) {
+            mapping = mmap(NULL, sizeof(TelemetrySegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+
+        if (mapping != MAP_FAILED) {
+            strncpy(telemetry->name, name, sizeof(telemetry->name) - 1);
+            telemetry->name[sizeof(telemetry->name) - 1] = '\0';
+        } else {
+            shm_unlink(name);
+        }
+    }
+
+    if (mapping == MAP_FAILED) {
+        mapping = mmap(NULL, sizeof(TelemetrySegment), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+
+    telemetry->segment = (TelemetrySegment *)mapping;
+    telemetry->owner = 1;
+    telemetry->segment->resource_count = 0;
+    telemetry->segment->system_count = 0;
+    telemetry->segment->simulation_running = manager->simulation_running;
+    telemetry->segment->control_mode = manager->control_mode;
+
+    for (int i = 0; i < manager->resource_array.size; i++) {
+        telemetry_add_resource(telemetry, manager->resource_array.resources[i]);
+    }
+    for (int i = 0; i < manager->system_array.size; i++) {
+        telemetry_add_system(telemetry, manager->system_array.systems[i]);
+    }
+
+    // Readers check the magic last, so they never see a half built header
+    __atomic_store_n(&telemetry->segment->magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Attaches read-only to a telemetry segment published by another process.
+ *
+ * @param[out] telemetry  Pointer to the `Telemetry` to initialize.
+ * @param[in]  name       Shared memory name the simulation publishes under.
+ * @return                0 on success, -1 if the segment does not exist or is not initialized.
+ */
+int telemetry_attach(Telemetry *telemetry, const char *name) {
+    struct stat info;
+    void *mapping = MAP_FAILED;
+    int fd;
+
+    telemetry->segment = NULL;
+    telemetry->name[0] = '\0';
+    telemetry->owner = 0;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(TelemetrySegment)) {
+        mapping = mmap(NULL, sizeof(TelemetrySegment), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+
+    telemetry->segment = (TelemetrySegment *)mapping;
+    if (__atomic_load_n(&telemetry->segment->magic, __ATOMIC_ACQUIRE) != TELEMETRY_MAGIC) {
+        telemetry_clean(telemetry);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Unmaps the telemetry segment, removing the shared memory name if this process created it.
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry` to clean.
+ */
+void telemetry_clean(Telemetry *telemetry) {
+    if (telemetry->segment == NULL) {
+        return;
+    }
+
+    munmap(telemetry->segment, sizeof(TelemetrySegment));
+    if (telemetry->owner && telemetry->name[0] != '\0') {
+        shm_unlink(telemetry->name);
+    }
+
+    telemetry->segment = NULL;
+    telemetry->name[0] = '\0';
+    telemetry->owner = 0;
+}
+
+/**
+ * Gives a `Resource` the next free telemetry slot and publishes its current amount.
+ *
+ * Resources beyond `TELEMETRY_MAX_RESOURCES` are not published. Slots are handed out by one thread
+ * at a time (during setup, or by whoever adds resources while running).
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry`.
+ * @param[in,out] resource   Pointer to the `Resource` to publish.
+ */
+void telemetry_add_resource(Telemetry *telemetry, Resource *resource) {
+    TelemetryResource *slot;
+    int index;
+
+    if (telemetry->segment == NULL || telemetry->segment->resource_count >= TELEMETRY_MAX_RESOURCES) {
+        return;
+    }
+
+    index = telemetry->segment->resource_count;
+    slot = &telemetry->segment->resources[index];
+    strncpy(slot->name, resource->name, TELEMETRY_NAME_LENGTH - 1);
+    slot->name[TELEMETRY_NAME_LENGTH - 1] = '\0';
+    slot->removed = 0;
+
+    resource_lock(resource);
+    resource->telemetry = slot;
+    resource_publish(resource);
+    resource_unlock(resource);
+
+    // The slot is fully written before readers can see it counted
+    __atomic_store_n(&telemetry->segment->resource_count, index + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Gives a `System` the next free telemetry slot and publishes its current status.
+ *
+ * Systems beyond `TELEMETRY_MAX_SYSTEMS` are not published.
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry`.
+ * @param[in,out] system     Pointer to the `System` to publish.
+ */
+void telemetry_add_system(Telemetry *telemetry, System *system) {
+    TelemetrySystem *slot;
+    int index;
+
+    if (telemetry->segment == NULL || telemetry->segment->system_count >= TELEMETRY_MAX_SYSTEMS) {
+        return;
+    }
+
+    index = telemetry->segment->system_count;
+    slot = &telemetry->segment->systems[index];
+    strncpy(slot->name, system->name, TELEMETRY_NAME_LENGTH - 1);
+    slot->name[TELEMETRY_NAME_LENGTH - 1] = '\0';
+    slot->removed = 0;
+
+    system->telemetry = slot;
+    system_publish(system);
+
+    __atomic_store_n(&telemetry->segment->system_count, index + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Marks the slot of a removed `Resource` so readers skip it.
+ *
+ * Slots are never reused, since a reader may be part way through one, so the slot keeps its last amount.
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry`.
+ * @param[in]     resource   Pointer to the removed `Resource`.
+ */
+void telemetry_remove_resource(Telemetry *telemetry, Resource *resource) {
+    if (telemetry->segment != NULL && resource->telemetry != NULL) {
+        __atomic_store_n(&resource->telemetry->removed, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Marks the slot of a removed `System` so readers skip it.
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry`.
+ * @param[in]     system     Pointer to the removed `System`.
+ */
+void telemetry_remove_system(Telemetry *telemetry, System *system) {
+    if (telemetry->segment != NULL && system->telemetry != NULL) {
+        __atomic_store_n(&system->telemetry->removed, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Publishes whether the simulation is still running, so monitors know when to stop.
+ *
+ * @param[in,out] telemetry  Pointer to the `Telemetry`.
+ * @param[in]     running    non-zero if the simulation is running.
+ */
+void telemetry_set_running(Telemetry *telemetry, int running) {
+    if (telemetry->segment != NULL) {
+        __atomic_store_n(&telemetry->segment->simulation_running, running, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Reads a consistent copy of one resource slot.
+ *
+ * @param[in]  segment  Pointer to the `TelemetrySegment`.
+ * @param[in]  index    Index of the slot, below `resource_count`.
+ * @param[out] out      Copy of the slot.
+ * @return              0 on success, -1 if the slot stayed mid-write for too long.
+ */
+int telemetry_read_resource(const TelemetrySegment *segment, int index, TelemetryResource *out) {
+    const TelemetryResource *slot = &segment->resources[index];
+    unsigned int before, after;
+
+    for (int attempt = 0; attempt < TELEMETRY_READ_RETRIES; attempt++) {
+        before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        out->amount = __atomic_load_n(&slot->amount, __ATOMIC_RELAXED);
+        out->max_capacity = __atomic_load_n(&slot->max_capacity, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+
+        if ((before & 1) == 0 && before == after) {
+            out->sequence = after;
+            out->removed = __atomic_load_n(&slot->removed, __ATOMIC_ACQUIRE);
+            // The name is written once, before the slot was counted
+            memcpy(out->name, slot->name, TELEMETRY_NAME_LENGTH);
+            return 0;
+        }
+
+        if ((attempt & 63) == 63) {
+            sched_yield();
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Reads a consistent copy of one system slot.
+ *
+ * @param[in]  segment  Pointer to the `TelemetrySegment`.
+ * @param[in]  index    Index of the slot, below `system_count`.
+ * @param[out] out      Copy of the slot.
+ * @return              0 on success, -1 if the slot stayed mid-write for too long.
+ */
+int telemetry_read_system(const TelemetrySegment *segment, int index, TelemetrySystem *out) {
+    const TelemetrySystem *slot = &segment->systems[index];
+    unsigned int before, after;
+
+    for (int attempt = 0; attempt < TELEMETRY_READ_RETRIES; attempt++) {
+        before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        out->status = __atomic_load_n(&slot->status, __ATOMIC_RELAXED);
+        __atomic_load(&slot->rate_multiplier, &out->rate_multiplier, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+
+        if ((before & 1) == 0 && before == after) {
+            out->sequence = after;
+            out->removed = __atomic_load_n(&slot->removed, __ATOMIC_ACQUIRE);
+            memcpy(out->name, slot->name, TELEMETRY_NAME_LENGTH);
+            return 0;
+        }
+
+        if ((attempt & 63) == 63) {
+            sched_yield();
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Prints the resource amounts and system statuses held in a telemetry segment.
+ *
+ * Used both by the manager's display and by `--monitor`. Each line is a consistent read of its slot.
+ *
+ * @param[in] segment  Pointer to the `TelemetrySegment` to print.
+ */
+void telemetry_print(const TelemetrySegment *segment) {
+    TelemetryResource resource;
+    TelemetrySystem system;
+    int resource_count = __atomic_load_n(&segment->resource_count, __ATOMIC_ACQUIRE);
+    int system_count = __atomic_load_n(&segment->system_count, __ATOMIC_ACQUIRE);
+    int control_mode = __atomic_load_n(&segment->control_mode, __ATOMIC_RELAXED);
+
+    printf(ANSI_CLEAR);
+    printf(ANSI_MV_TL);
+
+    // Display Resource Amounts
+    printf(ANSI_LN_CLR "Current Resource Amounts:\n");
+    printf(ANSI_LN_CLR "-------------------------\n");
+
+    for (int i = 0; i < resource_count; i++) {
+        if (telemetry_read_resource(segment, i, &resource) == 0 && !resource.removed) {
+            printf(ANSI_LN_CLR "%s: %d / %d\n", resource.name, resource.amount, resource.max_capacity);
+        }
+    }
+
+    printf(ANSI_LN_CLR "\n");
+
+    // Display System Statuses
+    printf(ANSI_LN_CLR "System Statuses:\n");
+    printf(ANSI_LN_CLR "---------------\n");
+
+    for (int i = 0; i < system_count; i++) {
+        if (telemetry_read_system(segment, i, &system) != 0 || system.removed) {
+            continue;
+        }
+
+        if (control_mode == CONTROL_PID) {
+            printf(ANSI_LN_CLR  "%-20s: %-10s x%.2f\n", system.name, system_status_name(system.status), system.rate_multiplier);
+        } else {
+            printf(ANSI_LN_CLR  "%-20s: %-10s\n", system.name, system_status_name(system.status));
+        }
+    }
+
+    printf(ANSI_LN_CLR  "\n");
+}
@@ -0,0 +1,536 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+// The lockstep engine trades the event-driven timing of the threaded simulation for a fixed timestep,
+// so that very large homogeneous scenarios can be advanced with vectorized kernels.
+//
+// Semantics mirror `system_run`/`system_step`: consuming is all-or-nothing (`system_convert`), storing
+// keeps whatever does not fit (`system_store_resources`), a failure backs off for `SYSTEM_WAIT_TIME`,
+// and a system that finishes processing stores its output and consumes for its next conversion in the
+// same tick. Within a tick all stores happen before all consumes, and contention on a shared resource is
+// resolved in system order starting from a position that rotates every tick, so runs are reproducible.
+//
+// Tolerance: every wait is rounded up to a whole tick, so with integer processing times and
+// `TICK_ENGINE_DT_MS` of 1 ms the timing matches the scheduler exactly. With fractional durations (e.g. a
+// PID rate multiplier) a conversion takes at most one tick longer, so a system's conversion rate is low by
+// at most dt / duration. Resource amounts then agree with the threaded run to within one batch of each
+// producer and consumer that touched the resource in the last tick, plus whatever the threaded run's
+// nondeterministic interleaving changes.
+
+#include "defs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <immintrin.h>
+
+#define TICK_ENGINE_STOPPED 1e30f   // Remaining time of a terminated system, it never acts again
+
+// Helper functions just used by this C file
+
+static void *tick_alloc(int count, size_t size);
+static int tick_engine_alloc(TickEngine *engine, int system_count, int resource_count);
+static void tick_engine_load(TickEngine *engine, int replica, System **systems, int system_count,
+                             Resource **resources, int resource_count, const int *index_of, int index_count);
+static int tick_advance_scalar(float *remaining, int count, float dt, int *ready);
+static int tick_advance_avx2(float *remaining, int count, float dt, int *ready);
+static void tick_mark_extremes_scalar(TickEngine *engine, int from, int to, double time);
+static void tick_mark_extremes_avx2(TickEngine *engine, double time);
+
+/**
+ * Initializes a `TickEngine` from the manager's systems and resources.
+ *
+ * The scenario can be replicated any number of times, each replica with its own copy of every
+ * resource, to build fleet-scale runs out of a small scenario. Each system starts with its current
+ * status, rate multiplier and `amount_stored`, and acts on the first tick.
+ *
+ * @param[out] engine    Pointer to the `TickEngine` to initialize.
+ * @param[in]  manager   Pointer to the `Manager` holding the scenario.
+ * @param[in]  replicas  Number of copies of the scenario to run side by side (at least 1).
+ * @return               0 on success, -1 if memory could not be allocated.
+ */
+int tick_engine_init(TickEngine *engine, Manager *manager, int replicas) {
+    int r, systems, resources;
+
+    if (replicas < 1) {
+        replicas = 1;
+    }
+
+    systems = manager->system_array.size;
+    resources = manager->resource_array.size;
+    if (tick_engine_alloc(engine, systems * replicas, resources * replicas) != 0) {
+        return -1;
+    }
+
+    for (r = 0; r < replicas; r++) {
+        tick_engine_load(engine, r, manager->system_array.systems, systems, manager->resource_array.resources, resources, NULL, 0);
+    }
+
+    engine->tick = 0;
+    return 0;
+}
+
+/**
+ * Loads the live state of running systems and resources into an engine, for a single replica.
+ *
+ * No lock is taken, so the systems never wait on the capture. Each value is read atomically, but
+ * the values are not all read at the same instant: an amount may be off by the conversions that
+ * completed while the capture ran. Systems start idle, so a conversion in progress at the time of
+ * the capture is lost, along with its input. The engine is reallocated only if the number of
+ * systems or resources has changed since the last capture.
+ *
+ * @param[in,out] engine          Pointer to the `TickEngine`, zeroed or previously initialized.
+ * @param[in]     systems         Systems to load, e.g. a `system_array_snapshot`.
+ * @param[in]     system_count    Number of systems.
+ * @param[in]     resources       Resources to load, e.g. a `resource_array_snapshot`.
+ * @param[in]     resource_count  Number of resources.
+ * @return                        0 on success, -1 if memory could not be allocated.
+ */
+int tick_engine_capture(TickEngine *engine, System **systems, int system_count, Resource **resources, int resource_count) {
+    int *index_of;
+    int i, max_id = 0;
+
+    if (engine->system_count != system_count || engine->resource_count != resource_count || engine->remaining == NULL) {
+        tick_engine_clean(engine);
+        if (tick_engine_alloc(engine, system_count, resource_count) != 0) {
+            return -1;
+        }
+    }
+
+    // Ids are never reused, so once resources have been removed they no longer match positions
+    for (i = 0; i < resource_count; i++) {
+        if (resources[i]->id > max_id) {
+            max_id = resources[i]->id;
+        }
+    }
+    index_of = (int *)malloc(sizeof(int) * (max_id + 1));
+    if (index_of == NULL) {
+        return -1;
+    }
+    for (i = 0; i <= max_id; i++) {
+        index_of[i] = -1;
+    }
+    for (i = 0; i < resource_count; i++) {
+        index_of[resources[i]->id] = i;
+    }
+
+    tick_engine_load(engine, 0, systems, system_count, resources, resource_count, index_of, max_id + 1);
+    free(index_of);
+
+    engine->tick = 0;
+    return 0;
+}
+
+/**
+ * Cleans up a `TickEngine`.
+ *
+ * @param[in,out] engine  Pointer to the `TickEngine` to clean.
+ */
+void tick_engine_clean(TickEngine *engine) {
+    free(engine->remaining);
+    free(engine->duration);
+    free(engine->processing_time);
+    free(engine->status);
+    free(engine->rate_multiplier);
+    free(engine->phase);
+    free(engine->amount_stored);
+    free(engine->consumed_index);
+    free(engine->consumed_amount);
+    free(engine->produced_index);
+    free(engine->produced_amount);
+    free(engine->last_result);
+    free(engine->conversions);
+    free(engine->ready);
+    free(engine->amount);
+    free(engine->max_capacity);
+    free(engine->first_empty_time);
+    free(engine->first_full_time);
+    memset(engine, 0, sizeof(TickEngine));
+}
+
+/**
+ * Changes the status of one system in the engine.
+ *
+ * Like `scheduler_reschedule`, a system in the middle of processing has its remaining time scaled
+ * by how much faster or slower the new status makes it, and a terminated system stops for good.
+ *
+ * @param[in,out] engine  Pointer to the `TickEngine`.
+ * @param[in]     index   Index of the system.
+ * @param[in]     status  The new status.
+ */
+void tick_engine_set_status(TickEngine *engine, int index, int status) {
+    float duration;
+
+    if (engine->status[index] == status || engine->status[index] == TERMINATE) {
+        return;
+    }
+
+    engine->status[index] = status;
+    if (status == TERMINATE) {
+        engine->remaining[index] = TICK_ENGINE_STOPPED;
+        return;
+    }
+
+    duration = (float)system_scaled_processing_time(engine->processing_time[index], status, engine->rate_multiplier[index]);
+    if (engine->phase[index] == SYSTEM_PHASE_PROCESSING && engine->duration[index] > 0) {
+        engine->remaining[index] *= duration / engine->duration[index];
+    }
+    engine->duration[index] = duration;
+}
+
+/**
+ * Advances every system and resource by one tick of `TICK_ENGINE_DT_MS`.
+ *
+ * The timer kernel counts every system down and collects the ones that act this tick. Those then
+ * finish processing and store their output, and afterwards consume for their next conversion, each
+ * pass resolving contention in system order from a rotating start.
+ *
+ * @param[in,out] engine  Pointer to the `TickEngine`.
+ */
+void tick_engine_step(TickEngine *engine) {
+    int k, i, start, ready_count, space, need, r, position;
+    float dt = (float)TICK_ENGINE_DT_MS;
+
+    if (engine->use_avx2) {
+        ready_count = tick_advance_avx2(engine->remaining, engine->system_count, dt, engine->ready);
+    } else {
+        ready_count = tick_advance_scalar(engine->remaining, engine->system_count, dt, engine->ready);
+    }
+
+    start = (ready_count > 0) ? (int)(engine->tick % ready_count) : 0;
+
+    // Finish processing and store the output, like `system_store_resources`
+    for (k = 0; k < ready_count; k++) {
+        position = (start + k < ready_count) ? start + k : start + k - ready_count;
+        i = engine->ready[position];
+
+        if (engine->phase[i] == SYSTEM_PHASE_PROCESSING) {
+            engine->amount_stored[i] = (engine->produced_index[i] >= 0) ? engine->amount_stored[i] + engine->produced_amount[i] : 0;
+            engine->phase[i] = SYSTEM_PHASE_IDLE;
+            engine->conversions[i]++;
+        }
+
+        if (engine->amount_stored[i] > 0 && engine->produced_index[i] >= 0) {
+            r = engine->produced_index[i];
+            space = engine->max_capacity[r] - engine->amount[r];
+
+            if (space >= engine->amount_stored[i]) {
+                engine->amount[r] += engine->amount_stored[i];
+                engine->amount_stored[i] = 0;
+            } else if (space > 0) {
+                engine->amount[r] += space;
+                engine->amount_stored[i] -= space;
+            }
+
+            if (engine->amount_stored[i] != 0) {
+                engine->last_result[i] = STATUS_CAPACITY;
+                engine->remaining[i] = SYSTEM_WAIT_TIME;
+            }
+        }
+    }
+
+    // Consume the inputs of the next conversion, like `system_convert`
+    for (k = 0; k < ready_count; k++) {
+        position = (start + k < ready_count) ? start + k : start + k - ready_count;
+        i = engine->ready[position];
+        if (engine->remaining[i] > 0) {
+            continue;
+        }
+
+        r = engine->consumed_index[i];
+        need = engine->consumed_amount[i];
+
+        if (r >= 0 && engine->amount[r] < need) {
+            engine->last_result[i] = (engine->amount[r] == 0) ? STATUS_EMPTY : STATUS_INSUFFICIENT;
+            engine->remaining[i] = SYSTEM_WAIT_TIME;
+            continue;
+        }
+
+        if (r >= 0) {
+            engine->amount[r] -= need;
+        }
+        engine->last_result[i] = STATUS_OK;
+        engine->phase[i] = SYSTEM_PHASE_PROCESSING;
+        engine->remaining[i] = engine->duration[i];
+    }
+
+    engine->ready_count = ready_count;
+    engine->tick++;
+
+    if (engine->use_avx2) {
+        tick_mark_extremes_avx2(engine, engine->tick * TICK_ENGINE_DT_MS);
+    } else {
+        tick_mark_extremes_scalar(engine, 0, engine->resource_count, engine->tick * TICK_ENGINE_DT_MS);
+    }
+}
+
+/**
+ * Prints the final resource amounts, when each first emptied or filled, and each system's conversions.
+ *
+ * Only the first replica is listed, followed by the totals over every replica.
+ *
+ * @param[in] engine   Pointer to the `TickEngine`.
+ * @param[in] manager  Pointer to the `Manager` the engine was initialized from, used for names.
+ */
+void tick_engine_print(const TickEngine *engine, const Manager *manager) {
+    int i;
+    long long total_conversions = 0;
+
+    printf("Lockstep Engine (%s kernels) after %.0f ms:\n", engine->use_avx2 ? "AVX2" : "scalar", engine->tick * TICK_ENGINE_DT_MS);
+    printf("-------------------------\n");
+
+    for (i = 0; i < manager->resource_array.size && i < engine->resource_count; i++) {
+        printf("%-12s: %6d / %-6d", manager->resource_array.resources[i]->name, engine->amount[i], engine->max_capacity[i]);
+        if (engine->first_empty_time[i] > 0) {
+            printf("  emptied at %.0f ms", engine->first_empty_time[i]);
+        }
+        if (engine->first_full_time[i] >= 0) {
+            printf("  filled at %.0f ms", engine->first_full_time[i]);
+        }
+        printf("\n");
+    }
+
+    printf("\n");
+    for (i = 0; i < manager->system_array.size && i < engine->system_count; i++) {
+        printf("%-20s: %-10s %lld conversions\n", manager->system_array.systems[i]->name,
+               system_status_name(engine->status[i]), engine->conversions[i]);
+    }
+
+    for (i = 0; i < engine->system_count; i++) {
+        total_conversions += engine->conversions[i];
+    }
+    printf("\nTotal: %d systems, %d resources, %lld conversions\n", engine->system_count, engine->resource_count, total_conversions);
+}
+
+/**
+ * Allocates a zeroed array aligned for the vector kernels.
+ *
+ * @param[in] count  Number of elements.
+ * @param[in] size   Size of each element.
+ * @return           Pointer to the array, or NULL if allocation failed.
+ */
+static void *tick_alloc(int count, size_t size) {
+    // aligned_alloc needs a size that is a multiple of the alignment, padding also lets kernels read whole vectors
+    size_t bytes = ((count > 0 ? count : 1) * size + 31) & ~(size_t)31;
+    void *array = aligned_alloc(32, bytes);
+
+    if (array != NULL) {
+        memset(array, 0, bytes);
+    }
+    return array;
+}
+
+/**
+ * Allocates every array of an engine, zeroed.
+ *
+ * @param[out] engine          Pointer to the `TickEngine` to allocate.
+ * @param[in]  system_count    Number of systems, over every replica.
+ * @param[in]  resource_count  Number of resources, over every replica.
+ * @return                     0 on success, -1 if memory could not be allocated (the engine is left clean).
+ */
+static int tick_engine_alloc(TickEngine *engine, int system_count, int resource_count) {
+    memset(engine, 0, sizeof(TickEngine));
+    engine->system_count = system_count;
+    engine->resource_count = resource_count;
+
+    engine->remaining = tick_alloc(engine->system_count, sizeof(float));
+    engine->duration = tick_alloc(engine->system_count, sizeof(float));
+    engine->processing_time = tick_alloc(engine->system_count, sizeof(int));
+    engine->status = tick_alloc(engine->system_count, sizeof(int));
+    engine->rate_multiplier = tick_alloc(engine->system_count, sizeof(double));
+    engine->phase = tick_alloc(engine->system_count, sizeof(int));
+    engine->amount_stored = tick_alloc(engine->system_count, sizeof(int));
+    engine->consumed_index = tick_alloc(engine->system_count, sizeof(int));
+    engine->consumed_amount = tick_alloc(engine->system_count, sizeof(int));
+    engine->produced_index = tick_alloc(engine->system_count, sizeof(int));
+    engine->produced_amount = tick_alloc(engine->system_count, sizeof(int));
+    engine->last_result = tick_alloc(engine->system_count, sizeof(int));
+    engine->conversions = tick_alloc(engine->system_count, sizeof(long long));
+    engine->ready = tick_alloc(engine->system_count, sizeof(int));
+    engine->amount = tick_alloc(engine->resource_count, sizeof(int));
+    engine->max_capacity = tick_alloc(engine->resource_count, sizeof(int));
+    engine->first_empty_time = tick_alloc(engine->resource_count, sizeof(double));
+    engine->first_full_time = tick_alloc(engine->resource_count, sizeof(double));
+
+    if (engine->remaining == NULL || engine->duration == NULL || engine->processing_time == NULL ||
+        engine->status == NULL || engine->rate_multiplier == NULL || engine->phase == NULL ||
+        engine->amount_stored == NULL || engine->consumed_index == NULL || engine->consumed_amount == NULL ||
+        engine->produced_index == NULL || engine->produced_amount == NULL || engine->last_result == NULL ||
+        engine->conversions == NULL || engine->ready == NULL || engine->amount == NULL ||
+        engine->max_capacity == NULL || engine->first_empty_time == NULL || engine->first_full_time == NULL) {
+        tick_engine_clean(engine);
+        return -1;
+    }
+
+    engine->use_avx2 = (__builtin_cpu_supports("avx2") != 0);
+    return 0;
+}
+
+/**
+ * Copies the state of systems and resources into one replica of an engine.
+ *
+ * Each system starts with its current status, rate multiplier and `amount_stored`, and acts on the
+ * next tick.
+ *
+ * @param[in,out] engine          Pointer to the allocated `TickEngine`.
+ * @param[in]     replica         Which copy of the scenario to fill.
+ * @param[in]     systems         Systems of the scenario.
+ * @param[in]     system_count    Number of systems in a replica.
+ * @param[in]     resources       Resources of the scenario.
+ * @param[in]     resource_count  Number of resources in a replica.
+ * @param[in]     index_of        Position of each resource by id, -1 if it is not loaded, or NULL if ids are positions.
+ * @param[in]     index_count     Number of ids in `index_of`; a resource added after the snapshot lies past it.
+ */
+static void tick_engine_load(TickEngine *engine, int replica, System **systems, int system_count,
+                             Resource **resources, int resource_count, const int *index_of, int index_count) {
+    int i, index, status, consumed, produced;
+    double rate_multiplier;
+    System *system;
+    Resource *resource;
+
+    for (i = 0; i < resource_count; i++) {
+        resource = resources[i];
+        index = replica * resource_count + i;
+        engine->amount[index] = resource_read_amount(resource);
+        engine->max_capacity[index] = resource->max_capacity;
+        engine->first_empty_time[index] = (engine->amount[index] == 0) ? 0 : -1;
+        engine->first_full_time[index] = -1;
+    }
+
+    for (i = 0; i < system_count; i++) {
+        system = systems[i];
+        index = replica * system_count + i;
+        status = __atomic_load_n(&system->status, __ATOMIC_RELAXED);
+        __atomic_load(&system->rate_multiplier, &rate_multiplier, __ATOMIC_RELAXED);
+
+        consumed = (system->consumed.resource != NULL) ? system->consumed.resource->id : -1;
+        produced = (system->produced.resource != NULL) ? system->produced.resource->id : -1;
+        if (index_of != NULL) {
+            consumed = (consumed >= 0 && consumed < index_count) ? index_of[consumed] : -1;
+            produced = (produced >= 0 && produced < index_count) ? index_of[produced] : -1;
+        }
+
+        engine->processing_time[index] = system->processing_time;
+        engine->rate_multiplier[index] = rate_multiplier;
+        engine->status[index] = status;
+        engine->duration[index] = (float)system_scaled_processing_time(system->processing_time, status, rate_multiplier);
+        engine->remaining[index] = (status == TERMINATE) ? TICK_ENGINE_STOPPED : 0;
+        engine->phase[index] = SYSTEM_PHASE_IDLE;
+        engine->amount_stored[index] = __atomic_load_n(&system->amount_stored, __ATOMIC_RELAXED);
+        engine->consumed_index[index] = (consumed >= 0) ? replica * resource_count + consumed : -1;
+        engine->consumed_amount[index] = system->consumed.amount;
+        engine->produced_index[index] = (produced >= 0) ? replica * resource_count + produced : -1;
+        engine->produced_amount[index] = system->produced.amount;
+        engine->last_result[index] = STATUS_OK;
+        engine->conversions[index] = 0;
+    }
+}
+
+/**
+ * Counts every system down by one tick and lists the ones that act this tick.
+ *
+ * @param[in,out] remaining  Remaining time of each system, clamped at 0.
+ * @param[in]     count      Number of systems.
+ * @param[in]     dt         Length of a tick in milliseconds.
+ * @param[out]    ready      Indices of the systems whose remaining time reached 0, in order.
+ * @return                   Number of systems written to `ready`.
+ */
+static int tick_advance_scalar(float *remaining, int count, float dt, int *ready) {
+    int i, ready_count = 0;
+
+    for (i = 0; i < count; i++) {
+        remaining[i] = (remaining[i] > dt) ? remaining[i] - dt : 0;
+        if (remaining[i] <= 0) {
+            ready[ready_count++] = i;
+        }
+    }
+
+    return ready_count;
+}
+
+/**
+ * AVX2 version of `tick_advance_scalar`, eight systems at a time.
+ *
+ * @param[in,out] remaining  Remaining time of each system (32-byte aligned), clamped at 0.
+ * @param[in]     count      Number of systems.
+ * @param[in]     dt         Length of a tick in milliseconds.
+ * @param[out]    ready      Indices of the systems whose remaining time reached 0, in order.
+ * @return                   Number of systems written to `ready`.
+ */
+__attribute__((target("avx2")))
+static int tick_advance_avx2(float *remaining, int count, float dt, int *ready) {
+    __m256 dt_vector = _mm256_set1_ps(dt);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 values;
+    int i, mask, ready_count = 0;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        values = _mm256_max_ps(_mm256_sub_ps(_mm256_load_ps(remaining + i), dt_vector), zero);
+        _mm256_store_ps(remaining + i, values);
+
+        // One bit per system that reached zero, most of the time none of them have
+        mask = _mm256_movemask_ps(_mm256_cmp_ps(values, zero, _CMP_LE_OQ));
+        while (mask != 0) {
+            ready[ready_count++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+
+    // Finish the systems that do not fill a whole vector
+    for (; i < count; i++) {
+        remaining[i] = (remaining[i] > dt) ? remaining[i] - dt : 0;
+        if (remaining[i] <= 0) {
+            ready[ready_count++] = i;
+        }
+    }
+
+    return ready_count;
+}
+
+/**
+ * Records the first time each resource in a range is empty or full.
+ *
+ * @param[in,out] engine  Pointer to the `TickEngine`.
+ * @param[in]     from    Index of the first resource to check.
+ * @param[in]     to      One past the index of the last resource to check.
+ * @param[in]     time    Virtual milliseconds elapsed at the end of the tick.
+ */
+static void tick_mark_extremes_scalar(TickEngine *engine, int from, int to, double time) {
+    int i;
+
+    for (i = from; i < to; i++) {
+        if (engine->amount[i] == 0 && engine->first_empty_time[i] < 0) {
+            engine->first_empty_time[i] = time;
+        }
+        if (engine->amount[i] >= engine->max_capacity[i] && engine->first_full_time[i] < 0) {
+            engine->first_full_time[i] = time;
+        }
+    }
+}
+
+/**
+ * AVX2 version of `tick_mark_extremes_scalar`, comparing eight resources at a time.
+ *
+ * @param[in,out] engine  Pointer to the `TickEngine`.
+ * @param[in]     time    Virtual milliseconds elapsed at the end of the tick.
+ */
+__attribute__((target("avx2")))
+static void tick_mark_extremes_avx2(TickEngine *engine, double time) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i amounts, capacities, hits;
+    int i, j, mask;
+
+    for (i = 0; i + 8 <= engine->resource_count; i += 8) {
+        amounts = _mm256_load_si256((const __m256i *)(engine->amount + i));
+        capacities = _mm256_load_si256((const __m256i *)(engine->max_capacity + i));
+        hits = _mm256_or_si256(_mm256_cmpeq_epi32(amounts, zero), _mm256_cmpeq_epi32(amounts, capacities));
+        mask = _mm256_movemask_ps(_mm256_castsi256_ps(hits));
+
+        while (mask != 0) {
+            j = i + __builtin_ctz(mask);
+            tick_mark_extremes_scalar(engine, j, j + 1, time);
+            mask &= mask - 1;
+        }
+    }
+
+    tick_mark_extremes_scalar(engine, i, engine->resource_count, time);
+}
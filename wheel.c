@@ -0,0 +1,194 @@
+// Ahmad Baytamouni 101335293
+// Austin Pham 101333594
+
+#include "defs.h"
+#include <stdlib.h>
+
+// Helper functions just used by this C file
+
+static void timer_wheel_place(TimerWheel *wheel, TimerNode *node);
+static void timer_wheel_cascade(TimerWheel *wheel, int level, int index);
+
+/**
+ * Initializes a `TimerWheel`.
+ *
+ * Every slot is an empty circular list whose sentinel points at itself.
+ *
+ * @param[out] wheel  Pointer to the `TimerWheel` to initialize.
+ * @param[in]  start  Tick the wheel starts at.
+ */
+void timer_wheel_init(TimerWheel *wheel, unsigned long long start) {
+    int level, slot;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+            wheel->slots[level][slot].next = &wheel->slots[level][slot];
+            wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+        }
+    }
+
+    wheel->current = start;
+    wheel->count = 0;
+}
+
+/**
+ * Inserts a timer into the `TimerWheel`.
+ *
+ * A timer that is already pending is moved to its new expiry. Expiries in the past fire on the
+ * next advance.
+ *
+ * @param[in,out] wheel    Pointer to the `TimerWheel`.
+ * @param[in,out] node     Pointer to the `TimerNode` to insert.
+ * @param[in]     expires  Tick at which the timer should fire.
+ */
+void timer_wheel_insert(TimerWheel *wheel, TimerNode *node, unsigned long long expires) {
+    if (node->pending) {
+        timer_wheel_cancel(wheel, node);
+    }
+
+    // Never place a timer in a slot the wheel has already passed
+    node->expires = (expires > wheel->current) ? expires : wheel->current + 1;
+    timer_wheel_place(wheel, node);
+    node->pending = 1;
+    wheel->count++;
+}
+
+/**
+ * Cancels a pending timer.
+ *
+ * Does nothing if the timer is not pending.
+ *
+ * @param[in,out] wheel  Pointer to the `TimerWheel`.
+ * @param[in,out] node   Pointer to the `TimerNode` to cancel.
+ */
+void timer_wheel_cancel(TimerWheel *wheel, TimerNode *node) {
+    if (!node->pending) {
+        return;
+    }
+
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = NULL;
+    node->prev = NULL;
+    node->pending = 0;
+    wheel->count--;
+}
+
+/**
+ * Advances the `TimerWheel` up to and including the tick `now`.
+ *
+ * Each tick empties one slot of the finest level. Whenever a level wraps around, the next slot of
+ * the level above is cascaded down, so each timer is moved at most once per level.
+ *
+ * @param[in,out] wheel  Pointer to the `TimerWheel`.
+ * @param[in]     now    Tick to advance to.
+ * @return               Singly linked list (through `next`) of the expired timers, no longer pending.
+ */
+TimerNode *timer_wheel_advance(TimerWheel *wheel, unsigned long long now) {
+    TimerNode *expired = NULL, *tail = NULL, *head, *node;
+    int level, index;
+
+    while (wheel->current < now) {
+        // Nothing can expire in an empty wheel, so jump straight to the target tick
+        if (wheel->count == 0) {
+            wheel->current = now;
+            break;
+        }
+
+        wheel->current++;
+
+        // Cascade down from each level whose lower levels have just wrapped around
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            if ((wheel->current & ((1ULL << (WHEEL_SLOT_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            index = (int)((wheel->current >> (WHEEL_SLOT_BITS * level)) & (WHEEL_SLOTS - 1));
+            timer_wheel_cascade(wheel, level, index);
+        }
+
+        // Detach everything in the current slot of the finest level
+        head = &wheel->slots[0][wheel->current & (WHEEL_SLOTS - 1)];
+        while (head->next != head) {
+            node = head->next;
+            timer_wheel_cancel(wheel, node);
+
+            if (tail == NULL) {
+                expired = node;
+            } else {
+                tail->next = node;
+            }
+            tail = node;
+        }
+    }
+
+    return expired;
+}
+
+/**
+ * Links a timer into the slot matching its distance from the current tick.
+ *
+ * Level L holds timers that expire less than 64^(L+1) ticks away, indexed by their expiry's
+ * L-th group of bits. Timers beyond the range of the top level wait in its furthest slot and
+ * are placed again when it cascades.
+ *
+ * @param[in,out] wheel  Pointer to the `TimerWheel`.
+ * @param[in,out] node   Pointer to the `TimerNode` to place.
+ */
+static void timer_wheel_place(TimerWheel *wheel, TimerNode *node) {
+    unsigned long long delta = node->expires - wheel->current;
+    int level = 0, index;
+    TimerNode *head;
+
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+
+    if (delta >= (1ULL << (WHEEL_SLOT_BITS * WHEEL_LEVELS))) {
+        index = (int)(((wheel->current >> (WHEEL_SLOT_BITS * level)) - 1) & (WHEEL_SLOTS - 1));
+    } else {
+        index = (int)((node->expires >> (WHEEL_SLOT_BITS * level)) & (WHEEL_SLOTS - 1));
+    }
+
+    // Append at the tail so timers with the same expiry fire in insertion order
+    head = &wheel->slots[level][index];
+    node->next = head;
+    node->prev = head->prev;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+/**
+ * Moves every timer in one slot of a coarse level down to the finer levels.
+ *
+ * @param[in,out] wheel  Pointer to the `TimerWheel`.
+ * @param[in]     level  Level of the slot to cascade.
+ * @param[in]     index  Index of the slot to cascade.
+ */
+static void timer_wheel_cascade(TimerWheel *wheel, int level, int index) {
+    TimerNode *head = &wheel->slots[level][index];
+    TimerNode *node;
+    TimerNode list;
+
+    // Detach the whole slot first, since placing a timer may put it back in this same slot
+    if (head->next == head) {
+        return;
+    }
+    list.next = head->next;
+    list.prev = head->prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head->next = head;
+    head->prev = head;
+
+    while (list.next != &list) {
+        node = list.next;
+        list.next = node->next;
+        node->next->prev = &list;
+
+        // Expiries that are due right now go to the slot about to be emptied
+        if (node->expires < wheel->current) {
+            node->expires = wheel->current;
+        }
+        timer_wheel_place(wheel, node);
+    }
+}